@@ -119,6 +119,11 @@ typedef struct amdgpu_bo *amdgpu_bo_handle;
  */
 typedef struct amdgpu_bo_list *amdgpu_bo_list_handle;
 
+/**
+ * Define handle for a cache of BO lists
+ */
+typedef struct amdgpu_bo_list_cache *amdgpu_bo_list_cache_handle;
+
 /**
  * Define handle to be used to work with VA allocated ranges
  */
@@ -779,6 +784,68 @@ int amdgpu_bo_list_update(amdgpu_bo_list_handle handle,
 			  amdgpu_bo_handle *resources,
 			  uint8_t *resource_prios);
 
+/**
+ * Create a cache of BO lists
+ *
+ * Submitting the same set of BOs again and again, as most clients do every
+ * frame, does not need a list creation and destruction per submission. The
+ * cache keeps up to max_lists kernel lists alive, keyed by their content.
+ *
+ * \param   dev			- \c [in] Device handle.
+ *				   See #amdgpu_device_initialize()
+ * \param   max_lists		- \c [in] Number of lists to keep
+ * \param   cache		- \c [out] Created BO list cache
+ *
+ * \return   0 on success\n
+ *          <0 - Negative POSIX Error code
+ *
+ * \sa amdgpu_bo_list_cache_get(), amdgpu_bo_list_cache_destroy()
+*/
+int amdgpu_bo_list_cache_create(amdgpu_device_handle dev,
+				uint32_t max_lists,
+				amdgpu_bo_list_cache_handle *cache);
+
+/**
+ * Destroy a cache of BO lists and the lists it holds
+ *
+ * \param   cache	- \c [in] BO list cache
+ *
+ * \return   0 on success\n
+ *          <0 - Negative POSIX Error code
+ *
+ * \sa amdgpu_bo_list_cache_create()
+*/
+int amdgpu_bo_list_cache_destroy(amdgpu_bo_list_cache_handle cache);
+
+/**
+ * Get a BO list handle for a set of BOs from a cache
+ *
+ * The order of the BOs does not matter. A set that is in the cache costs
+ * no ioctl. Otherwise a new list is created, or when the cache is full,
+ * the least recently used list is updated with the new set.
+ *
+ * \param   cache		- \c [in] BO list cache
+ * \param   number_of_resources	- \c [in] Number of BOs in the list
+ * \param   resources		- \c [in] List of BO handles
+ * \param   resource_prios	- \c [in] Optional priority for each handle
+ * \param   result		- \c [out] BO list handle
+ *
+ * \return   0 on success\n
+ *          <0 - Negative POSIX Error code
+ *
+ * \note The list belongs to the cache and must not be destroyed. It is
+ *	 valid until the next call on the same cache or until one of its
+ *	 BOs is freed, so a cache must not be shared between threads
+ *	 submitting concurrently.
+ *
+ * \sa amdgpu_cs_submit()
+*/
+int amdgpu_bo_list_cache_get(amdgpu_bo_list_cache_handle cache,
+			     uint32_t number_of_resources,
+			     amdgpu_bo_handle *resources,
+			     uint8_t *resource_prios,
+			     amdgpu_bo_list_handle *result);
+
 /*
  * GPU Execution context
  *
@@ -907,6 +974,33 @@ int amdgpu_cs_query_fence_status(struct amdgpu_cs_fence *fence,
 				 uint64_t flags,
 				 uint32_t *expired);
 
+/**
+ *  Wait for multiple fences
+ *
+ * \param   fences      - \c [in] The fence array to wait
+ * \param   fence_count - \c [in] The fence count
+ * \param   wait_all    - \c [in] If true, wait all fences to be signaled,
+ *				  otherwise, wait at least one fence
+ * \param   timeout_ns  - \c [in] The timeout to wait, in nanoseconds
+ * \param   status      - \c [out] '1' for signaled, '0' for timeout
+ * \param   first       - \c [out] the index of the first signaled fence,
+ *				   only set when waiting for any fence
+ *
+ * \return  0 on success\n
+ *          <0 - Negative POSIX Error code
+ *
+ * \note    All the fences must be from the same device. Kernels without
+ *	    the multiple fence wait ioctl are handled by waiting for the
+ *	    fences one at a time.
+ *
+ * \sa amdgpu_cs_query_fence_status()
+*/
+int amdgpu_cs_wait_fences(struct amdgpu_cs_fence *fences,
+			  uint32_t fence_count,
+			  bool wait_all,
+			  uint64_t timeout_ns,
+			  uint32_t *status, uint32_t *first);
+
 /*
  * Query / Info API
  *
@@ -65,6 +65,8 @@ drm_private void amdgpu_bo_free_internal(amdgpu_bo_handle bo)
 	}
 	pthread_mutex_unlock(&bo->dev->bo_table_mutex);
 
+	amdgpu_bo_list_cache_invalidate(bo->dev, bo->handle);
+
 	/* Release CPU access. */
 	if (bo->cpu_map_count > 0) {
 		bo->cpu_map_count = 1;
@@ -675,6 +677,211 @@ int amdgpu_bo_list_update(amdgpu_bo_list_handle handle,
 	return r;
 }
 
+static int amdgpu_bo_list_entry_compare(const void *a, const void *b)
+{
+	const struct drm_amdgpu_bo_list_entry *x = a, *y = b;
+
+	if (x->bo_handle != y->bo_handle)
+		return x->bo_handle < y->bo_handle ? -1 : 1;
+	return (int)x->bo_priority - (int)y->bo_priority;
+}
+
+static int amdgpu_bo_list_handle_compare(const void *key, const void *entry)
+{
+	uint32_t handle = *(const uint32_t *)key;
+	const struct drm_amdgpu_bo_list_entry *e = entry;
+
+	return handle < e->bo_handle ? -1 : handle > e->bo_handle;
+}
+
+static void amdgpu_bo_list_cache_evict(struct amdgpu_bo_list_cache *cache,
+				       struct amdgpu_bo_list_cache_entry *entry)
+{
+	amdgpu_bo_list_destroy(entry->bo_list);
+	list_del(&entry->list);
+	free(entry->entries);
+	free(entry);
+	cache->count--;
+}
+
+int amdgpu_bo_list_cache_create(amdgpu_device_handle dev,
+				uint32_t max_lists,
+				amdgpu_bo_list_cache_handle *cache)
+{
+	struct amdgpu_bo_list_cache *c;
+
+	if (!dev || !max_lists || !cache)
+		return -EINVAL;
+
+	c = calloc(1, sizeof(struct amdgpu_bo_list_cache));
+	if (!c)
+		return -ENOMEM;
+
+	c->dev = dev;
+	c->max_lists = max_lists;
+	list_inithead(&c->lru);
+	pthread_mutex_init(&c->mutex, NULL);
+
+	pthread_mutex_lock(&dev->bo_table_mutex);
+	list_add(&c->link, &dev->bo_list_caches);
+	pthread_mutex_unlock(&dev->bo_table_mutex);
+
+	*cache = c;
+	return 0;
+}
+
+int amdgpu_bo_list_cache_destroy(amdgpu_bo_list_cache_handle cache)
+{
+	struct amdgpu_bo_list_cache_entry *entry, *tmp;
+
+	if (!cache)
+		return -EINVAL;
+
+	pthread_mutex_lock(&cache->dev->bo_table_mutex);
+	list_del(&cache->link);
+	pthread_mutex_unlock(&cache->dev->bo_table_mutex);
+
+	LIST_FOR_EACH_ENTRY_SAFE(entry, tmp, &cache->lru, list)
+		amdgpu_bo_list_cache_evict(cache, entry);
+
+	pthread_mutex_destroy(&cache->mutex);
+	free(cache->scratch);
+	free(cache);
+	return 0;
+}
+
+int amdgpu_bo_list_cache_get(amdgpu_bo_list_cache_handle cache,
+			     uint32_t number_of_resources,
+			     amdgpu_bo_handle *resources,
+			     uint8_t *resource_prios,
+			     amdgpu_bo_list_handle *result)
+{
+	struct amdgpu_bo_list_cache_entry *entry;
+	struct drm_amdgpu_bo_list_entry *entries;
+	size_t size = number_of_resources * sizeof(*entries);
+	uint64_t hash = 0xcbf29ce484222325ull;
+	const uint8_t *bytes;
+	unsigned i;
+	int r = 0;
+
+	if (!cache || !number_of_resources || !resources || !result)
+		return -EINVAL;
+
+	/* overflow check for multiplication */
+	if (number_of_resources > UINT32_MAX / sizeof(struct drm_amdgpu_bo_list_entry))
+		return -EINVAL;
+
+	pthread_mutex_lock(&cache->mutex);
+
+	if (cache->scratch_size < number_of_resources) {
+		entries = realloc(cache->scratch, size);
+		if (!entries) {
+			r = -ENOMEM;
+			goto out;
+		}
+		cache->scratch = entries;
+		cache->scratch_size = number_of_resources;
+	}
+
+	/* the key is the sorted set of handles and priorities */
+	entries = cache->scratch;
+	for (i = 0; i < number_of_resources; i++) {
+		entries[i].bo_handle = resources[i]->handle;
+		entries[i].bo_priority = resource_prios ? resource_prios[i] : 0;
+	}
+	qsort(entries, number_of_resources, sizeof(*entries),
+	      amdgpu_bo_list_entry_compare);
+
+	/* FNV-1a */
+	bytes = (const uint8_t *)entries;
+	for (i = 0; i < size; i++)
+		hash = (hash ^ bytes[i]) * 0x100000001b3ull;
+
+	LIST_FOR_EACH_ENTRY(entry, &cache->lru, list) {
+		if (entry->hash == hash &&
+		    entry->count == number_of_resources &&
+		    !memcmp(entry->entries, entries, size)) {
+			list_del(&entry->list);
+			list_add(&entry->list, &cache->lru);
+			*result = entry->bo_list;
+			goto out;
+		}
+	}
+
+	entries = malloc(size);
+	if (!entries) {
+		r = -ENOMEM;
+		goto out;
+	}
+	memcpy(entries, cache->scratch, size);
+
+	if (cache->count < cache->max_lists) {
+		entry = calloc(1, sizeof(struct amdgpu_bo_list_cache_entry));
+		if (!entry) {
+			free(entries);
+			r = -ENOMEM;
+			goto out;
+		}
+
+		r = amdgpu_bo_list_create(cache->dev, number_of_resources,
+					  resources, resource_prios,
+					  &entry->bo_list);
+		if (r) {
+			free(entries);
+			free(entry);
+			goto out;
+		}
+		cache->count++;
+	} else {
+		/* reuse the kernel list of the least recently used set */
+		entry = LIST_ENTRY(struct amdgpu_bo_list_cache_entry,
+				   cache->lru.prev, list);
+		r = amdgpu_bo_list_update(entry->bo_list, number_of_resources,
+					  resources, resource_prios);
+		if (r) {
+			free(entries);
+			goto out;
+		}
+		list_del(&entry->list);
+		free(entry->entries);
+	}
+
+	entry->hash = hash;
+	entry->count = number_of_resources;
+	entry->entries = entries;
+	list_add(&entry->list, &cache->lru);
+	*result = entry->bo_list;
+
+out:
+	pthread_mutex_unlock(&cache->mutex);
+	return r;
+}
+
+/*
+ * Kernel BO lists keep the BOs they contain alive, and the handle of a
+ * freed BO can be reused by a new one, so cached lists containing a BO
+ * must go when the BO is freed.
+ */
+drm_private void amdgpu_bo_list_cache_invalidate(amdgpu_device_handle dev,
+						 uint32_t bo_handle)
+{
+	struct amdgpu_bo_list_cache_entry *entry, *tmp;
+	struct amdgpu_bo_list_cache *cache;
+
+	pthread_mutex_lock(&dev->bo_table_mutex);
+	LIST_FOR_EACH_ENTRY(cache, &dev->bo_list_caches, link) {
+		pthread_mutex_lock(&cache->mutex);
+		LIST_FOR_EACH_ENTRY_SAFE(entry, tmp, &cache->lru, list) {
+			if (bsearch(&bo_handle, entry->entries, entry->count,
+				    sizeof(*entry->entries),
+				    amdgpu_bo_list_handle_compare))
+				amdgpu_bo_list_cache_evict(cache, entry);
+		}
+		pthread_mutex_unlock(&cache->mutex);
+	}
+	pthread_mutex_unlock(&dev->bo_table_mutex);
+}
+
 int amdgpu_bo_va_op(amdgpu_bo_handle bo,
 		     uint64_t offset,
 		     uint64_t size,
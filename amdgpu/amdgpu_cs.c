@@ -39,6 +39,7 @@
 #include "xf86drm.h"
 #include "amdgpu_drm.h"
 #include "amdgpu_internal.h"
+#include "util_math.h"
 
 static int amdgpu_cs_unreference_sem(amdgpu_semaphore_handle sem);
 static int amdgpu_cs_reset_sem(amdgpu_semaphore_handle sem);
@@ -443,6 +444,192 @@ int amdgpu_cs_query_fence_status(struct amdgpu_cs_fence *fence,
 	return r;
 }
 
+static int amdgpu_ioctl_wait_fences(struct amdgpu_cs_fence *fences,
+				    uint32_t fence_count,
+				    bool wait_all,
+				    uint64_t timeout,
+				    uint32_t *status,
+				    uint32_t *first)
+{
+	amdgpu_device_handle dev = fences[0].context->dev;
+	struct drm_amdgpu_fence *drm_fences;
+	union drm_amdgpu_wait_fences args;
+	uint32_t *index, i, count = 0;
+	int r;
+
+	drm_fences = malloc(sizeof(struct drm_amdgpu_fence) * fence_count);
+	index = malloc(sizeof(uint32_t) * fence_count);
+	if (!drm_fences || !index) {
+		r = -ENOMEM;
+		goto out;
+	}
+
+	/* fences that were never submitted are signaled */
+	for (i = 0; i < fence_count; i++) {
+		if (fences[i].fence == AMDGPU_NULL_SUBMIT_SEQ)
+			continue;
+
+		drm_fences[count].ctx_id = fences[i].context->id;
+		drm_fences[count].ip_type = fences[i].ip_type;
+		drm_fences[count].ip_instance = fences[i].ip_instance;
+		drm_fences[count].ring = fences[i].ring;
+		drm_fences[count].seq_no = fences[i].fence;
+		index[count++] = i;
+	}
+
+	if (!count) {
+		*status = 1;
+		r = 0;
+		goto out;
+	}
+
+	memset(&args, 0, sizeof(args));
+	args.in.fences = (uint64_t)(uintptr_t)drm_fences;
+	args.in.fence_count = count;
+	args.in.wait_all = wait_all;
+	args.in.timeout_ns = timeout;
+
+	r = drmIoctl(dev->fd, DRM_IOCTL_AMDGPU_WAIT_FENCES, &args);
+	if (r) {
+		r = -errno;
+		goto out;
+	}
+
+	*status = args.out.status;
+	if (!wait_all && *status && args.out.first_signaled < count)
+		*first = index[args.out.first_signaled];
+
+out:
+	free(index);
+	free(drm_fences);
+	return r;
+}
+
+/*
+ * Fallback for kernels without DRM_IOCTL_AMDGPU_WAIT_FENCES. Waiting for
+ * any fence polls all of them and then sleeps on the first one for at
+ * most a millisecond, so others signaling meanwhile are noticed late.
+ */
+static int amdgpu_cs_wait_fences_loop(struct amdgpu_cs_fence *fences,
+				      uint32_t fence_count,
+				      bool wait_all,
+				      uint64_t timeout,
+				      uint32_t *status,
+				      uint32_t *first)
+{
+	uint64_t flags = AMDGPU_QUERY_FENCE_TIMEOUT_IS_ABSOLUTE;
+	uint64_t now, slice;
+	bool busy;
+	uint32_t i;
+	int r;
+
+	*status = 0;
+
+	if (wait_all) {
+		for (i = 0; i < fence_count; i++) {
+			if (fences[i].fence == AMDGPU_NULL_SUBMIT_SEQ)
+				continue;
+
+			r = amdgpu_ioctl_wait_cs(fences[i].context,
+						 fences[i].ip_type,
+						 fences[i].ip_instance,
+						 fences[i].ring, fences[i].fence,
+						 timeout, flags, &busy);
+			if (r || busy)
+				return r;
+		}
+
+		*status = 1;
+		return 0;
+	}
+
+	for (;;) {
+		for (i = 0; i < fence_count; i++) {
+			r = amdgpu_ioctl_wait_cs(fences[i].context,
+						 fences[i].ip_type,
+						 fences[i].ip_instance,
+						 fences[i].ring, fences[i].fence,
+						 0, flags, &busy);
+			if (r)
+				return r;
+			if (!busy) {
+				*status = 1;
+				*first = i;
+				return 0;
+			}
+		}
+
+		now = amdgpu_cs_calculate_timeout(0);
+		if (now >= timeout)
+			return 0;
+
+		slice = MIN2(timeout, now + 1000000);
+		r = amdgpu_ioctl_wait_cs(fences[0].context, fences[0].ip_type,
+					 fences[0].ip_instance, fences[0].ring,
+					 fences[0].fence, slice, flags, &busy);
+		if (r)
+			return r;
+		if (!busy) {
+			*status = 1;
+			*first = 0;
+			return 0;
+		}
+	}
+}
+
+int amdgpu_cs_wait_fences(struct amdgpu_cs_fence *fences,
+			  uint32_t fence_count,
+			  bool wait_all,
+			  uint64_t timeout_ns,
+			  uint32_t *status,
+			  uint32_t *first)
+{
+	amdgpu_device_handle dev;
+	uint32_t i, unused;
+	uint64_t timeout;
+
+	if (NULL == fences || NULL == status || !fence_count)
+		return -EINVAL;
+	if (NULL == fences[0].context)
+		return -EINVAL;
+	if (NULL == first)
+		first = &unused;
+
+	dev = fences[0].context->dev;
+
+	for (i = 0; i < fence_count; i++) {
+		if (NULL == fences[i].context)
+			return -EINVAL;
+		if (fences[i].context->dev != dev)
+			return -EINVAL;
+		if (fences[i].ip_type >= AMDGPU_HW_IP_NUM)
+			return -EINVAL;
+		if (fences[i].ring >= AMDGPU_CS_MAX_RINGS)
+			return -EINVAL;
+	}
+
+	if (!wait_all) {
+		for (i = 0; i < fence_count; i++) {
+			if (fences[i].fence == AMDGPU_NULL_SUBMIT_SEQ) {
+				*status = 1;
+				*first = i;
+				return 0;
+			}
+		}
+	}
+
+	timeout = amdgpu_cs_calculate_timeout(timeout_ns);
+
+	/* DRM_IOCTL_AMDGPU_WAIT_FENCES was added in amdgpu DRM 3.10 */
+	if (dev->major_version > 3 ||
+	    (dev->major_version == 3 && dev->minor_version >= 10))
+		return amdgpu_ioctl_wait_fences(fences, fence_count, wait_all,
+						timeout, status, first);
+
+	return amdgpu_cs_wait_fences_loop(fences, fence_count, wait_all,
+					  timeout, status, first);
+}
+
 int amdgpu_cs_create_semaphore(amdgpu_semaphore_handle *sem)
 {
 	struct amdgpu_semaphore *gpu_semaphore;
@@ -46,8 +46,15 @@
 #define AMDGPU_INVALID_VA_ADDRESS	0xffffffffffffffff
 #define AMDGPU_NULL_SUBMIT_SEQ		0
 
+/* AVL tree link, the holes are in one tree by address and one by size */
+struct amdgpu_va_node {
+	struct amdgpu_va_node *child[2];
+	int height;
+};
+
 struct amdgpu_bo_va_hole {
-	struct list_head list;
+	struct amdgpu_va_node by_offset;
+	struct amdgpu_va_node by_size;
 	uint64_t offset;
 	uint64_t size;
 };
@@ -56,7 +63,9 @@ struct amdgpu_bo_va_mgr {
 	/* the start virtual address */
 	uint64_t va_offset;
 	uint64_t va_max;
-	struct list_head va_holes;
+	/* free ranges below va_offset, never adjacent to each other */
+	struct amdgpu_va_node *holes_by_offset;
+	struct amdgpu_va_node *holes_by_size;
 	pthread_mutex_t bo_va_mutex;
 	uint32_t va_alignment;
 };
@@ -88,6 +97,9 @@ struct amdgpu_device {
 	struct amdgpu_bo_va_mgr *vamgr;
 	/** The VA manager for the 32bit address space */
 	struct amdgpu_bo_va_mgr *vamgr_32;
+	/** BO list caches, to drop lists of freed BOs. Protected by
+	 *  bo_table_mutex. */
+	struct list_head bo_list_caches;
 };
 
 struct amdgpu_bo {
@@ -110,6 +122,29 @@ struct amdgpu_bo_list {
 	uint32_t handle;
 };
 
+struct amdgpu_bo_list_cache_entry {
+	/** Link in the LRU list of the cache, most recently used first */
+	struct list_head list;
+	uint64_t hash;
+	uint32_t count;
+	/** The BOs of the list, sorted by handle and priority */
+	struct drm_amdgpu_bo_list_entry *entries;
+	struct amdgpu_bo_list *bo_list;
+};
+
+struct amdgpu_bo_list_cache {
+	struct amdgpu_device *dev;
+	/** Link in the list of caches of the device */
+	struct list_head link;
+	pthread_mutex_t mutex;
+	struct list_head lru;
+	uint32_t count;
+	uint32_t max_lists;
+	/** Sort buffer of amdgpu_bo_list_cache_get() */
+	struct drm_amdgpu_bo_list_entry *scratch;
+	uint32_t scratch_size;
+};
+
 struct amdgpu_context {
 	struct amdgpu_device *dev;
 	/** Mutex for accessing fences and to maintain command submissions
@@ -137,6 +172,9 @@ struct amdgpu_semaphore {
 
 drm_private void amdgpu_bo_free_internal(amdgpu_bo_handle bo);
 
+drm_private void amdgpu_bo_list_cache_invalidate(amdgpu_device_handle dev,
+						 uint32_t bo_handle);
+
 drm_private void amdgpu_vamgr_init(struct amdgpu_bo_va_mgr *mgr, uint64_t start,
 		       uint64_t max, uint64_t alignment);
 
@@ -44,6 +44,275 @@ int amdgpu_va_range_query(amdgpu_device_handle dev,
 	return -EINVAL;
 }
 
+/*
+ * The holes are kept in two AVL trees: one ordered by address to find the
+ * neighbours to coalesce with on free, and one ordered by size (then
+ * address) to find the best fitting hole on allocation. Both make
+ * allocating and freeing O(log n) in the number of holes.
+ */
+/* misaligned best fitting holes to try before taking a larger one */
+#define AMDGPU_VA_FIT_TRIES 8
+
+#define hole_by_offset(n) LIST_ENTRY(struct amdgpu_bo_va_hole, n, by_offset)
+#define hole_by_size(n) LIST_ENTRY(struct amdgpu_bo_va_hole, n, by_size)
+
+typedef int (*amdgpu_va_node_cmp)(const struct amdgpu_va_node *a,
+				  const struct amdgpu_va_node *b);
+
+static int amdgpu_va_offset_cmp(const struct amdgpu_va_node *a,
+				const struct amdgpu_va_node *b)
+{
+	uint64_t x = hole_by_offset(a)->offset, y = hole_by_offset(b)->offset;
+
+	return x < y ? -1 : x > y;
+}
+
+static int amdgpu_va_size_cmp(const struct amdgpu_va_node *a,
+			      const struct amdgpu_va_node *b)
+{
+	const struct amdgpu_bo_va_hole *x = hole_by_size(a);
+	const struct amdgpu_bo_va_hole *y = hole_by_size(b);
+
+	if (x->size != y->size)
+		return x->size < y->size ? -1 : 1;
+	return x->offset < y->offset ? -1 : x->offset > y->offset;
+}
+
+static int amdgpu_va_height(const struct amdgpu_va_node *node)
+{
+	return node ? node->height : 0;
+}
+
+static void amdgpu_va_update(struct amdgpu_va_node *node)
+{
+	node->height = MAX2(amdgpu_va_height(node->child[0]),
+			    amdgpu_va_height(node->child[1])) + 1;
+}
+
+/* rotate the child on side dir up, returns the new subtree root */
+static struct amdgpu_va_node *amdgpu_va_rotate(struct amdgpu_va_node *node,
+					       int dir)
+{
+	struct amdgpu_va_node *child = node->child[dir];
+
+	node->child[dir] = child->child[!dir];
+	child->child[!dir] = node;
+	amdgpu_va_update(node);
+	amdgpu_va_update(child);
+
+	return child;
+}
+
+static struct amdgpu_va_node *amdgpu_va_balance(struct amdgpu_va_node *node)
+{
+	int diff = amdgpu_va_height(node->child[1]) -
+		   amdgpu_va_height(node->child[0]);
+	int dir = diff > 0;
+	struct amdgpu_va_node *child;
+
+	if (diff >= -1 && diff <= 1) {
+		amdgpu_va_update(node);
+		return node;
+	}
+
+	child = node->child[dir];
+	if (amdgpu_va_height(child->child[!dir]) >
+	    amdgpu_va_height(child->child[dir]))
+		node->child[dir] = amdgpu_va_rotate(child, !dir);
+
+	return amdgpu_va_rotate(node, dir);
+}
+
+static struct amdgpu_va_node *amdgpu_va_insert(struct amdgpu_va_node *root,
+					       struct amdgpu_va_node *node,
+					       amdgpu_va_node_cmp cmp)
+{
+	int dir;
+
+	if (!root) {
+		node->child[0] = node->child[1] = NULL;
+		node->height = 1;
+		return node;
+	}
+
+	dir = cmp(node, root) > 0;
+	root->child[dir] = amdgpu_va_insert(root->child[dir], node, cmp);
+
+	return amdgpu_va_balance(root);
+}
+
+static struct amdgpu_va_node *
+amdgpu_va_remove_min(struct amdgpu_va_node *root, struct amdgpu_va_node **min)
+{
+	if (!root->child[0]) {
+		*min = root;
+		return root->child[1];
+	}
+
+	root->child[0] = amdgpu_va_remove_min(root->child[0], min);
+
+	return amdgpu_va_balance(root);
+}
+
+static struct amdgpu_va_node *amdgpu_va_remove(struct amdgpu_va_node *root,
+					       struct amdgpu_va_node *node,
+					       amdgpu_va_node_cmp cmp)
+{
+	struct amdgpu_va_node *min;
+	int dir;
+
+	if (root == node) {
+		if (!node->child[0] || !node->child[1])
+			return node->child[!node->child[0]];
+
+		min = NULL;
+		node->child[1] = amdgpu_va_remove_min(node->child[1], &min);
+		min->child[0] = node->child[0];
+		min->child[1] = node->child[1];
+
+		return amdgpu_va_balance(min);
+	}
+
+	dir = cmp(node, root) > 0;
+	root->child[dir] = amdgpu_va_remove(root->child[dir], node, cmp);
+
+	return amdgpu_va_balance(root);
+}
+
+/* last hole starting at or below va (dir = 0) or first one above (dir = 1) */
+static struct amdgpu_bo_va_hole *
+amdgpu_vamgr_neighbour(struct amdgpu_bo_va_mgr *mgr, uint64_t va, int dir)
+{
+	struct amdgpu_va_node *node = mgr->holes_by_offset, *found = NULL;
+
+	while (node) {
+		int above = hole_by_offset(node)->offset > va;
+
+		if (above == dir)
+			found = node;
+		node = node->child[!above];
+	}
+
+	return found ? hole_by_offset(found) : NULL;
+}
+
+/* smallest hole of at least size bytes that sorts after (size, offset) */
+static struct amdgpu_bo_va_hole *
+amdgpu_vamgr_fit(struct amdgpu_bo_va_mgr *mgr, uint64_t size, uint64_t offset)
+{
+	struct amdgpu_va_node *node = mgr->holes_by_size, *found = NULL;
+
+	while (node) {
+		struct amdgpu_bo_va_hole *hole = hole_by_size(node);
+		int after = hole->size > size ||
+			    (hole->size == size && hole->offset >= offset);
+
+		if (after)
+			found = node;
+		node = node->child[!after];
+	}
+
+	return found ? hole_by_size(found) : NULL;
+}
+
+static void amdgpu_vamgr_link(struct amdgpu_bo_va_mgr *mgr,
+			      struct amdgpu_bo_va_hole *hole)
+{
+	mgr->holes_by_offset = amdgpu_va_insert(mgr->holes_by_offset,
+						&hole->by_offset,
+						amdgpu_va_offset_cmp);
+	mgr->holes_by_size = amdgpu_va_insert(mgr->holes_by_size,
+					      &hole->by_size,
+					      amdgpu_va_size_cmp);
+}
+
+static void amdgpu_vamgr_unlink(struct amdgpu_bo_va_mgr *mgr,
+				struct amdgpu_bo_va_hole *hole)
+{
+	mgr->holes_by_offset = amdgpu_va_remove(mgr->holes_by_offset,
+						&hole->by_offset,
+						amdgpu_va_offset_cmp);
+	mgr->holes_by_size = amdgpu_va_remove(mgr->holes_by_size,
+					      &hole->by_size,
+					      amdgpu_va_size_cmp);
+}
+
+/*
+ * Change the range of a hole. The new range never crosses a neighbour, so
+ * only the position in the size tree changes.
+ */
+static void amdgpu_vamgr_resize(struct amdgpu_bo_va_mgr *mgr,
+				struct amdgpu_bo_va_hole *hole,
+				uint64_t offset, uint64_t size)
+{
+	mgr->holes_by_size = amdgpu_va_remove(mgr->holes_by_size,
+					      &hole->by_size,
+					      amdgpu_va_size_cmp);
+	hole->offset = offset;
+	hole->size = size;
+	mgr->holes_by_size = amdgpu_va_insert(mgr->holes_by_size,
+					      &hole->by_size,
+					      amdgpu_va_size_cmp);
+}
+
+/* add a free range below va_offset, merging it with adjacent holes */
+static void amdgpu_vamgr_add_hole(struct amdgpu_bo_va_mgr *mgr, uint64_t va,
+				  uint64_t size)
+{
+	struct amdgpu_bo_va_hole *prev, *next;
+
+	prev = amdgpu_vamgr_neighbour(mgr, va, 0);
+	next = amdgpu_vamgr_neighbour(mgr, va, 1);
+
+	if (prev && prev->offset + prev->size != va)
+		prev = NULL;
+	if (next && next->offset != va + size)
+		next = NULL;
+
+	if (prev && next) {
+		amdgpu_vamgr_unlink(mgr, next);
+		amdgpu_vamgr_resize(mgr, prev, prev->offset,
+				    prev->size + size + next->size);
+		free(next);
+	} else if (prev) {
+		amdgpu_vamgr_resize(mgr, prev, prev->offset, prev->size + size);
+	} else if (next) {
+		amdgpu_vamgr_resize(mgr, next, va, next->size + size);
+	} else {
+		/* FIXME on allocation failure we just lose virtual address space
+		 * maybe print a warning
+		 */
+		next = calloc(1, sizeof(struct amdgpu_bo_va_hole));
+		if (next) {
+			next->offset = va;
+			next->size = size;
+			amdgpu_vamgr_link(mgr, next);
+		}
+	}
+}
+
+/* allocate [offset, offset + size) out of a hole containing it */
+static void amdgpu_vamgr_carve(struct amdgpu_bo_va_mgr *mgr,
+			       struct amdgpu_bo_va_hole *hole,
+			       uint64_t offset, uint64_t size)
+{
+	uint64_t end = hole->offset + hole->size;
+	uint64_t waste = offset - hole->offset;
+
+	if (!waste && end == offset + size) {
+		amdgpu_vamgr_unlink(mgr, hole);
+		free(hole);
+	} else if (!waste) {
+		amdgpu_vamgr_resize(mgr, hole, offset + size,
+				    end - offset - size);
+	} else {
+		amdgpu_vamgr_resize(mgr, hole, hole->offset, waste);
+		if (end != offset + size)
+			amdgpu_vamgr_add_hole(mgr, offset + size,
+					      end - offset - size);
+	}
+}
+
 drm_private void amdgpu_vamgr_init(struct amdgpu_bo_va_mgr *mgr, uint64_t start,
 			      uint64_t max, uint64_t alignment)
 {
@@ -51,15 +320,18 @@ drm_private void amdgpu_vamgr_init(struct amdgpu_bo_va_mgr *mgr, uint64_t start,
 	mgr->va_max = max;
 	mgr->va_alignment = alignment;
 
-	list_inithead(&mgr->va_holes);
+	mgr->holes_by_offset = NULL;
+	mgr->holes_by_size = NULL;
 	pthread_mutex_init(&mgr->bo_va_mutex, NULL);
 }
 
 drm_private void amdgpu_vamgr_deinit(struct amdgpu_bo_va_mgr *mgr)
 {
-	struct amdgpu_bo_va_hole *hole, *tmp;
-	LIST_FOR_EACH_ENTRY_SAFE(hole, tmp, &mgr->va_holes, list) {
-		list_del(&hole->list);
+	struct amdgpu_bo_va_hole *hole;
+
+	while (mgr->holes_by_offset) {
+		hole = hole_by_offset(mgr->holes_by_offset);
+		amdgpu_vamgr_unlink(mgr, hole);
 		free(hole);
 	}
 	pthread_mutex_destroy(&mgr->bo_va_mutex);
@@ -69,7 +341,7 @@ drm_private uint64_t
 amdgpu_vamgr_find_va(struct amdgpu_bo_va_mgr *mgr, uint64_t size,
 		     uint64_t alignment, uint64_t base_required)
 {
-	struct amdgpu_bo_va_hole *hole, *n;
+	struct amdgpu_bo_va_hole *hole;
 	uint64_t offset = 0, waste = 0;
 
 	alignment = MAX2(alignment, mgr->va_alignment);
@@ -79,47 +351,36 @@ amdgpu_vamgr_find_va(struct amdgpu_bo_va_mgr *mgr, uint64_t size,
 		return AMDGPU_INVALID_VA_ADDRESS;
 
 	pthread_mutex_lock(&mgr->bo_va_mutex);
-	/* TODO: using more appropriate way to track the holes */
 	/* first look for a hole */
-	LIST_FOR_EACH_ENTRY_SAFE(hole, n, &mgr->va_holes, list) {
-		if (base_required) {
-			if(hole->offset > base_required ||
-				(hole->offset + hole->size) < (base_required + size))
-				continue;
-			waste = base_required - hole->offset;
-			offset = base_required;
-		} else {
-			offset = hole->offset;
-			waste = offset % alignment;
-			waste = waste ? alignment - waste : 0;
-			offset += waste;
-			if (offset >= (hole->offset + hole->size)) {
-				continue;
-			}
-		}
-		if (!waste && hole->size == size) {
-			offset = hole->offset;
-			list_del(&hole->list);
-			free(hole);
+	if (base_required) {
+		hole = amdgpu_vamgr_neighbour(mgr, base_required, 0);
+		if (hole && hole->offset + hole->size >= base_required + size) {
+			amdgpu_vamgr_carve(mgr, hole, base_required, size);
 			pthread_mutex_unlock(&mgr->bo_va_mutex);
-			return offset;
+			return base_required;
 		}
-		if ((hole->size - waste) > size) {
-			if (waste) {
-				n = calloc(1, sizeof(struct amdgpu_bo_va_hole));
-				n->size = waste;
-				n->offset = hole->offset;
-				list_add(&n->list, &hole->list);
+	} else {
+		/*
+		 * Best fit. A hole that is large enough may still be too small
+		 * once aligned. After a few of those skip to the holes at least
+		 * alignment - va_alignment bytes larger, which always fit.
+		 */
+		unsigned tries = 0;
+
+		for (hole = amdgpu_vamgr_fit(mgr, size, 0); hole; tries++) {
+			offset = ALIGN(hole->offset, alignment);
+			if (offset - hole->offset <= hole->size - size) {
+				amdgpu_vamgr_carve(mgr, hole, offset, size);
+				pthread_mutex_unlock(&mgr->bo_va_mutex);
+				return offset;
 			}
-			hole->size -= (size + waste);
-			hole->offset += size + waste;
-			pthread_mutex_unlock(&mgr->bo_va_mutex);
-			return offset;
-		}
-		if ((hole->size - waste) == size) {
-			hole->size = waste;
-			pthread_mutex_unlock(&mgr->bo_va_mutex);
-			return offset;
+
+			if (tries < AMDGPU_VA_FIT_TRIES)
+				hole = amdgpu_vamgr_fit(mgr, hole->size,
+							hole->offset + 1);
+			else
+				hole = amdgpu_vamgr_fit(mgr, size + alignment -
+							mgr->va_alignment, 0);
 		}
 	}
 
@@ -141,12 +402,8 @@ amdgpu_vamgr_find_va(struct amdgpu_bo_va_mgr *mgr, uint64_t size,
 		return AMDGPU_INVALID_VA_ADDRESS;
 	}
 
-	if (waste) {
-		n = calloc(1, sizeof(struct amdgpu_bo_va_hole));
-		n->size = waste;
-		n->offset = offset;
-		list_add(&n->list, &mgr->va_holes);
-	}
+	if (waste)
+		amdgpu_vamgr_add_hole(mgr, offset, waste);
 
 	offset += waste;
 	mgr->va_offset += size + waste;
@@ -168,59 +425,15 @@ amdgpu_vamgr_free_va(struct amdgpu_bo_va_mgr *mgr, uint64_t va, uint64_t size)
 	if ((va + size) == mgr->va_offset) {
 		mgr->va_offset = va;
 		/* Delete uppermost hole if it reaches the new top */
-		if (!LIST_IS_EMPTY(&mgr->va_holes)) {
-			hole = container_of(mgr->va_holes.next, hole, list);
-			if ((hole->offset + hole->size) == va) {
-				mgr->va_offset = hole->offset;
-				list_del(&hole->list);
-				free(hole);
-			}
+		hole = amdgpu_vamgr_neighbour(mgr, va, 0);
+		if (hole && (hole->offset + hole->size) == va) {
+			mgr->va_offset = hole->offset;
+			amdgpu_vamgr_unlink(mgr, hole);
+			free(hole);
 		}
 	} else {
-		struct amdgpu_bo_va_hole *next;
-
-		hole = container_of(&mgr->va_holes, hole, list);
-		LIST_FOR_EACH_ENTRY(next, &mgr->va_holes, list) {
-			if (next->offset < va)
-				break;
-			hole = next;
-		}
-
-		if (&hole->list != &mgr->va_holes) {
-			/* Grow upper hole if it's adjacent */
-			if (hole->offset == (va + size)) {
-				hole->offset = va;
-				hole->size += size;
-				/* Merge lower hole if it's adjacent */
-				if (next != hole
-						&& &next->list != &mgr->va_holes
-						&& (next->offset + next->size) == va) {
-					next->size += hole->size;
-					list_del(&hole->list);
-					free(hole);
-				}
-				goto out;
-			}
-		}
-
-		/* Grow lower hole if it's adjacent */
-		if (next != hole && &next->list != &mgr->va_holes &&
-				(next->offset + next->size) == va) {
-			next->size += size;
-			goto out;
-		}
-
-		/* FIXME on allocation failure we just lose virtual address space
-		 * maybe print a warning
-		 */
-		next = calloc(1, sizeof(struct amdgpu_bo_va_hole));
-		if (next) {
-			next->size = size;
-			next->offset = va;
-			list_add(&next->list, &hole->list);
-		}
+		amdgpu_vamgr_add_hole(mgr, va, size);
 	}
-out:
 	pthread_mutex_unlock(&mgr->bo_va_mutex);
 }
 
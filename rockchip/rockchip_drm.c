@@ -31,9 +31,14 @@
 
 #include <stdlib.h>
 #include <stdio.h>
+#include <inttypes.h>
 #include <string.h>
 #include <errno.h>
 
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <sys/ioctl.h>
 #include <sys/mman.h>
 #include <linux/stddef.h>
 
@@ -42,6 +47,76 @@
 #include "rockchip_drm.h"
 #include "rockchip_drmif.h"
 
+#ifndef DMA_BUF_IOCTL_SYNC
+struct dma_buf_sync {
+	uint64_t flags;
+};
+
+#define DMA_BUF_SYNC_READ	(1 << 0)
+#define DMA_BUF_SYNC_WRITE	(2 << 0)
+#define DMA_BUF_SYNC_START	(0 << 2)
+#define DMA_BUF_SYNC_END	(1 << 2)
+
+#define DMA_BUF_BASE		'b'
+#define DMA_BUF_IOCTL_SYNC	_IOW(DMA_BUF_BASE, 0, struct dma_buf_sync)
+#endif
+
+static uint64_t rockchip_gettime_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+/*
+ * Issue an ioctl and account for it in the device statistics, dumping them
+ * when the ROCKCHIP_DRM_STATS interval has elapsed.
+ */
+static int rockchip_ioctl(struct rockchip_device *dev, int fd,
+			  unsigned long request, void *arg)
+{
+	uint64_t start, end;
+	int dump = 0;
+	int ret;
+
+	start = rockchip_gettime_ns();
+	ret = drmIoctl(fd, request, arg);
+	end = rockchip_gettime_ns();
+
+	pthread_mutex_lock(&dev->lock);
+	dev->stats.ioctl_count++;
+	dev->stats.ioctl_ns += end - start;
+	if (dev->dump_interval &&
+	    end / 1000000000 >= dev->last_dump + dev->dump_interval) {
+		dev->last_dump = end / 1000000000;
+		dump = 1;
+	}
+	pthread_mutex_unlock(&dev->lock);
+
+	if (dump)
+		rockchip_device_dump_stats(dev);
+
+	return ret;
+}
+
+static void rockchip_account_bo(struct rockchip_bo *bo, int live)
+{
+	struct rockchip_device *dev = bo->dev;
+	uint64_t *bytes = &dev->stats.bo_bytes[bo->flags & ROCKCHIP_BO_MASK];
+
+	pthread_mutex_lock(&dev->lock);
+	if (live) {
+		dev->stats.bo_count++;
+		*bytes += bo->size;
+	} else {
+		dev->stats.bo_count--;
+		*bytes -= bo->size;
+	}
+	pthread_mutex_unlock(&dev->lock);
+}
+
 /*
  * Create rockchip drm device object.
  *
@@ -52,6 +127,7 @@
 struct rockchip_device *rockchip_device_create(int fd)
 {
 	struct rockchip_device *dev;
+	const char *env;
 
 	dev = calloc(1, sizeof(*dev));
 	if (!dev) {
@@ -61,6 +137,13 @@ struct rockchip_device *rockchip_device_create(int fd)
 	}
 
 	dev->fd = fd;
+	pthread_mutex_init(&dev->lock, NULL);
+
+	env = getenv("ROCKCHIP_DRM_STATS");
+	if (env) {
+		dev->dump_interval = atoi(env);
+		dev->last_dump = rockchip_gettime_ns() / 1000000000;
+	}
 
 	return dev;
 }
@@ -72,9 +155,57 @@ struct rockchip_device *rockchip_device_create(int fd)
  */
 void rockchip_device_destroy(struct rockchip_device *dev)
 {
+	if (!dev)
+		return;
+
+	if (dev->dump_interval)
+		rockchip_device_dump_stats(dev);
+
+	pthread_mutex_destroy(&dev->lock);
 	free(dev);
 }
 
+/*
+ * Get a snapshot of the rockchip drm device statistics.
+ *
+ * @dev: rockchip drm device object.
+ * @stats: returns the statistics.
+ */
+void rockchip_device_get_stats(struct rockchip_device *dev,
+			       struct rockchip_device_stats *stats)
+{
+	pthread_mutex_lock(&dev->lock);
+	*stats = dev->stats;
+	pthread_mutex_unlock(&dev->lock);
+}
+
+/*
+ * Print the rockchip drm device statistics to stderr.
+ *
+ * @dev: rockchip drm device object.
+ */
+void rockchip_device_dump_stats(struct rockchip_device *dev)
+{
+	struct rockchip_device_stats stats;
+	unsigned int i;
+
+	rockchip_device_get_stats(dev, &stats);
+
+	fprintf(stderr, "rockchip drm stats (fd %d):\n", dev->fd);
+	fprintf(stderr, "  bos: %" PRIu64 "\n", stats.bo_count);
+	for (i = 0; i <= ROCKCHIP_BO_MASK; i++) {
+		if (!stats.bo_bytes[i])
+			continue;
+		fprintf(stderr, "  bytes (flags 0x%x): %" PRIu64 "\n",
+			i, stats.bo_bytes[i]);
+	}
+	fprintf(stderr, "  mapped bytes: %" PRIu64 "\n", stats.mapped_bytes);
+	fprintf(stderr, "  slab hits/misses: %" PRIu64 "/%" PRIu64 "\n",
+		stats.slab_hits, stats.slab_misses);
+	fprintf(stderr, "  ioctls: %" PRIu64 " (%" PRIu64 " us)\n",
+		stats.ioctl_count, stats.ioctl_ns / 1000);
+}
+
 /*
  * Create a rockchip buffer object to rockchip drm device.
  *
@@ -111,7 +242,7 @@ struct rockchip_bo *rockchip_bo_create(struct rockchip_device *dev,
 
 	bo->dev = dev;
 
-	if (drmIoctl(dev->fd, DRM_IOCTL_ROCKCHIP_GEM_CREATE, &req)){
+	if (rockchip_ioctl(dev, dev->fd, DRM_IOCTL_ROCKCHIP_GEM_CREATE, &req)){
 		fprintf(stderr, "failed to create gem object[%s].\n",
 				strerror(errno));
 		goto err_free_bo;
@@ -120,6 +251,9 @@ struct rockchip_bo *rockchip_bo_create(struct rockchip_device *dev,
 	bo->handle = req.handle;
 	bo->size = size;
 	bo->flags = flags;
+	bo->dmabuf_fd = -1;
+
+	rockchip_account_bo(bo, 1);
 
 	return bo;
 
@@ -150,6 +284,9 @@ struct rockchip_bo *rockchip_bo_from_handle(struct rockchip_device *dev,
 	bo->handle = handle;
 	bo->size = size;
 	bo->flags = flags;
+	bo->dmabuf_fd = -1;
+
+	rockchip_account_bo(bo, 1);
 
 	return bo;
 }
@@ -164,17 +301,26 @@ void rockchip_bo_destroy(struct rockchip_bo *bo)
 	if (!bo)
 		return;
 
-	if (bo->vaddr)
+	if (bo->vaddr) {
 		munmap(bo->vaddr, bo->size);
 
+		pthread_mutex_lock(&bo->dev->lock);
+		bo->dev->stats.mapped_bytes -= bo->size;
+		pthread_mutex_unlock(&bo->dev->lock);
+	}
+
+	if (bo->dmabuf_fd >= 0)
+		close(bo->dmabuf_fd);
+
 	if (bo->handle) {
 		struct drm_gem_close req = {
 			.handle = bo->handle,
 		};
 
-		drmIoctl(bo->dev->fd, DRM_IOCTL_GEM_CLOSE, &req);
+		rockchip_ioctl(bo->dev, bo->dev->fd, DRM_IOCTL_GEM_CLOSE, &req);
 	}
 
+	rockchip_account_bo(bo, 0);
 	free(bo);
 }
 
@@ -206,7 +352,7 @@ struct rockchip_bo *rockchip_bo_from_name(struct rockchip_device *dev,
 		return NULL;
 	}
 
-	if (drmIoctl(dev->fd, DRM_IOCTL_GEM_OPEN, &req)) {
+	if (rockchip_ioctl(dev, dev->fd, DRM_IOCTL_GEM_OPEN, &req)) {
 		fprintf(stderr, "failed to open gem object[%s].\n",
 				strerror(errno));
 		goto err_free_bo;
@@ -215,6 +361,9 @@ struct rockchip_bo *rockchip_bo_from_name(struct rockchip_device *dev,
 	bo->dev = dev;
 	bo->name = name;
 	bo->handle = req.handle;
+	bo->dmabuf_fd = -1;
+
+	rockchip_account_bo(bo, 1);
 
 	return bo;
 
@@ -242,7 +391,8 @@ int rockchip_bo_get_name(struct rockchip_bo *bo, uint32_t *name)
 		};
 		int ret;
 
-		ret = drmIoctl(bo->dev->fd, DRM_IOCTL_GEM_FLINK, &req);
+		ret = rockchip_ioctl(bo->dev, bo->dev->fd, DRM_IOCTL_GEM_FLINK,
+				     &req);
 		if (ret) {
 			fprintf(stderr, "failed to get gem global name[%s].\n",
 					strerror(errno));
@@ -279,7 +429,8 @@ void *rockchip_bo_map(struct rockchip_bo *bo)
 		};
 		int ret;
 
-		ret = drmIoctl(dev->fd, DRM_IOCTL_ROCKCHIP_GEM_MAP_OFFSET, &req);
+		ret = rockchip_ioctl(dev, dev->fd,
+				     DRM_IOCTL_ROCKCHIP_GEM_MAP_OFFSET, &req);
 		if (ret) {
 			fprintf(stderr, "failed to ioctl gem map offset[%s].\n",
 				strerror(errno));
@@ -291,9 +442,75 @@ void *rockchip_bo_map(struct rockchip_bo *bo)
 		if (bo->vaddr == MAP_FAILED) {
 			fprintf(stderr, "failed to mmap buffer[%s].\n",
 				strerror(errno));
+			bo->vaddr = NULL;
 			return NULL;
 		}
+
+		pthread_mutex_lock(&dev->lock);
+		dev->stats.mapped_bytes += bo->size;
+		pthread_mutex_unlock(&dev->lock);
 	}
 
 	return bo->vaddr;
 }
+
+static int rockchip_bo_sync(struct rockchip_bo *bo, enum rockchip_gem_op op,
+			    uint64_t flags)
+{
+	struct dma_buf_sync req = {
+		.flags = flags,
+	};
+
+	if (bo->dmabuf_fd < 0) {
+		int ret;
+
+		ret = drmPrimeHandleToFD(bo->dev->fd, bo->handle, DRM_CLOEXEC,
+					 &bo->dmabuf_fd);
+		if (ret) {
+			fprintf(stderr, "failed to export gem object[%s].\n",
+				strerror(errno));
+			bo->dmabuf_fd = -1;
+			return ret;
+		}
+	}
+
+	if (op & ROCKCHIP_GEM_READ)
+		req.flags |= DMA_BUF_SYNC_READ;
+	if (op & ROCKCHIP_GEM_WRITE)
+		req.flags |= DMA_BUF_SYNC_WRITE;
+
+	return rockchip_ioctl(bo->dev, bo->dmabuf_fd, DMA_BUF_IOCTL_SYNC, &req);
+}
+
+/*
+ * Begin cpu access to a buffer mmapped by rockchip_bo_map().
+ *
+ * @bo: a rockchip buffer object.
+ * @op: mask of ROCKCHIP_GEM_READ and ROCKCHIP_GEM_WRITE.
+ *
+ * for buffers created with ROCKCHIP_BO_CACHABLE this invalidates the cpu
+ * caches, so the cpu sees what the hardware wrote. Every call must be
+ * paired with rockchip_bo_cpu_fini() using the same op.
+ *
+ * if true, return 0 else negative.
+ */
+int rockchip_bo_cpu_prep(struct rockchip_bo *bo, enum rockchip_gem_op op)
+{
+	return rockchip_bo_sync(bo, op, DMA_BUF_SYNC_START);
+}
+
+/*
+ * End cpu access to a buffer started by rockchip_bo_cpu_prep().
+ *
+ * @bo: a rockchip buffer object.
+ * @op: mask of ROCKCHIP_GEM_READ and ROCKCHIP_GEM_WRITE.
+ *
+ * for buffers created with ROCKCHIP_BO_CACHABLE this writes back the cpu
+ * caches, so the hardware sees what the cpu wrote.
+ *
+ * if true, return 0 else negative.
+ */
+int rockchip_bo_cpu_fini(struct rockchip_bo *bo, enum rockchip_gem_op op)
+{
+	return rockchip_bo_sync(bo, op, DMA_BUF_SYNC_END);
+}
@@ -32,6 +32,18 @@
 #include <stdint.h>
 #include "drm.h"
 
+/* memory type definitions. */
+enum rockchip_bo_flags {
+	/* Physically contiguous memory, otherwise mapped through the IOMMU. */
+	ROCKCHIP_BO_CONTIG	= 1 << 0,
+	/* Cachable mapping. */
+	ROCKCHIP_BO_CACHABLE	= 1 << 1,
+	/* Write-combine mapping. */
+	ROCKCHIP_BO_WC		= 1 << 2,
+	ROCKCHIP_BO_MASK	= ROCKCHIP_BO_CONTIG | ROCKCHIP_BO_CACHABLE |
+				  ROCKCHIP_BO_WC
+};
+
 /**
  * User-desired buffer creation information structure.
  *
@@ -61,6 +73,11 @@ struct drm_rockchip_gem_map_off {
 	uint64_t offset;
 };
 
+enum rockchip_gem_op {
+	ROCKCHIP_GEM_READ = 0x01,
+	ROCKCHIP_GEM_WRITE = 0x02,
+};
+
 struct drm_rockchip_rga_get_ver {
 	__u32   major;
 	__u32   minor;
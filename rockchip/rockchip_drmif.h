@@ -30,10 +30,49 @@
 
 #include <xf86drm.h>
 #include <stdint.h>
+#include <pthread.h>
 #include "rockchip_drm.h"
 
+struct rockchip_slab;
+
+/*
+ * Rockchip device statistics.
+ *
+ * @bo_count: number of live buffer objects.
+ * @bo_bytes: bytes of live buffer objects, indexed by their memory type
+ *	flags (see enum rockchip_bo_flags).
+ * @mapped_bytes: bytes currently mmapped to user space.
+ * @slab_hits: slab allocations served from an existing backing buffer.
+ * @slab_misses: slab allocations that had to create a backing buffer.
+ * @ioctl_count: number of ioctls issued through the device.
+ * @ioctl_ns: total time spent in those ioctls, in nanoseconds.
+ */
+struct rockchip_device_stats {
+	uint64_t	bo_count;
+	uint64_t	bo_bytes[ROCKCHIP_BO_MASK + 1];
+	uint64_t	mapped_bytes;
+	uint64_t	slab_hits;
+	uint64_t	slab_misses;
+	uint64_t	ioctl_count;
+	uint64_t	ioctl_ns;
+};
+
+/*
+ * Rockchip Device structure.
+ *
+ * @fd: file descriptor to the rockchip drm driver.
+ * @lock: protects the statistics.
+ * @stats: memory and object accounting of the device.
+ * @dump_interval: seconds between automatic statistics dumps, 0 if
+ *	disabled. Set from the ROCKCHIP_DRM_STATS environment variable.
+ * @last_dump: monotonic time in seconds of the last automatic dump.
+ */
 struct rockchip_device {
-	int fd;
+	int				fd;
+	pthread_mutex_t			lock;
+	struct rockchip_device_stats	stats;
+	unsigned int			dump_interval;
+	uint64_t			last_dump;
 };
 
 /*
@@ -45,6 +84,7 @@ struct rockchip_device {
  * @size: size to the buffer created.
  * @vaddr: user space address to a gem buffer mmaped.
  * @name: a gem global handle from flink request.
+ * @dmabuf_fd: dma-buf fd used for cpu access synchronization, -1 if none.
  */
 struct rockchip_bo {
 	struct rockchip_device	*dev;
@@ -53,6 +93,7 @@ struct rockchip_bo {
 	size_t			size;
 	void			*vaddr;
 	uint32_t		name;
+	int			dmabuf_fd;
 };
 
 /*
@@ -60,6 +101,9 @@ struct rockchip_bo {
  */
 struct rockchip_device *rockchip_device_create(int fd);
 void rockchip_device_destroy(struct rockchip_device *dev);
+void rockchip_device_get_stats(struct rockchip_device *dev,
+			struct rockchip_device_stats *stats);
+void rockchip_device_dump_stats(struct rockchip_device *dev);
 
 /*
  * buffer-object related functions:
@@ -76,4 +120,17 @@ uint32_t rockchip_bo_handle(struct rockchip_bo *bo);
 struct rockchip_bo *rockchip_bo_from_handle(struct rockchip_device *dev,
 			uint32_t handle, uint32_t flags, uint32_t size);
 void *rockchip_bo_map(struct rockchip_bo *bo);
+int rockchip_bo_cpu_prep(struct rockchip_bo *bo, enum rockchip_gem_op op);
+int rockchip_bo_cpu_fini(struct rockchip_bo *bo, enum rockchip_gem_op op);
+
+/*
+ * small buffer sub-allocation functions:
+ */
+struct rockchip_slab *rockchip_slab_create(struct rockchip_device *dev,
+			uint32_t flags);
+void rockchip_slab_destroy(struct rockchip_slab *slab);
+struct rockchip_bo *rockchip_slab_alloc(struct rockchip_slab *slab,
+			size_t size, uint32_t *offset);
+void rockchip_slab_free(struct rockchip_slab *slab, struct rockchip_bo *bo,
+			uint32_t offset);
 #endif /* ROCKCHIP_DRMIF_H_ */
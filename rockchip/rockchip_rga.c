@@ -81,7 +81,7 @@ static int rga_get_uv_factor(int drm_color_format)
 	case DRM_FORMAT_NV21:
 	case DRM_FORMAT_NV12:
 	case DRM_FORMAT_NV12_10:
-	//case DRM_FORMAT_NV21_10:
+	case DRM_FORMAT_NV21_10:
 		ydiv = 4;
 		break;
 
@@ -109,7 +109,7 @@ static int rga_get_ydiv(int drm_color_format)
 	case DRM_FORMAT_NV21:
 	case DRM_FORMAT_NV12:
 	case DRM_FORMAT_NV12_10:
-	//case DRM_FORMAT_NV21_10:
+	case DRM_FORMAT_NV21_10:
 		ydiv = 2;
 		break;
 
@@ -130,7 +130,7 @@ static int rga_get_xdiv(int drm_color_format)
 	case DRM_FORMAT_NV21:
 	case DRM_FORMAT_NV12:
 	case DRM_FORMAT_NV12_10:
-	//case DRM_FORMAT_NV21_10:
+	case DRM_FORMAT_NV21_10:
 		xdiv = 1;
 		break;
 
@@ -148,6 +148,59 @@ static int rga_get_xdiv(int drm_color_format)
 	return xdiv;
 }
 
+static int rga_is_yuv_ten(int drm_color_format)
+{
+	switch (drm_color_format) {
+	case DRM_FORMAT_NV12_10:
+	case DRM_FORMAT_NV21_10:
+		return 1;
+
+	default:
+		return 0;
+	}
+}
+
+/*
+ * The 10-bit formats are packed without padding, four samples in five
+ * bytes, so pixel positions have to be converted to byte offsets.
+ */
+static unsigned int rga_get_byte_offset(struct rga_image *img, unsigned int x,
+					unsigned int pixel_width)
+{
+	if (rga_is_yuv_ten(img->color_mode))
+		return x * 10 / 8;
+
+	return x * pixel_width;
+}
+
+/*
+ * Returns the dither-down mode matching a low depth destination format,
+ * or -EINVAL when the format keeps the full 8 bits per channel.
+ */
+static int rga_get_dither_down_mode(int drm_color_format)
+{
+	switch (drm_color_format) {
+	case DRM_FORMAT_RGB565:
+	case DRM_FORMAT_BGR565:
+		return RGA_DST_DITHER_MODE_888_TO_565;
+
+	case DRM_FORMAT_ARGB1555:
+	case DRM_FORMAT_ABGR1555:
+	case DRM_FORMAT_RGBA5551:
+	case DRM_FORMAT_BGRA5551:
+		return RGA_DST_DITHER_MODE_888_TO_555;
+
+	case DRM_FORMAT_ARGB4444:
+	case DRM_FORMAT_ABGR4444:
+	case DRM_FORMAT_RGBA4444:
+	case DRM_FORMAT_BGRA4444:
+		return RGA_DST_DITHER_MODE_888_TO_444;
+
+	default:
+		return -EINVAL;
+	}
+}
+
 static int rga_get_color_swap(int drm_color_format)
 {
 	unsigned int swap = 0;
@@ -187,7 +240,7 @@ static int rga_get_color_swap(int drm_color_format)
 		case DRM_FORMAT_YVU420:
 		case DRM_FORMAT_NV21:
 		case DRM_FORMAT_NV61:
-		//case DRM_FORMAT_NV21_10:
+		case DRM_FORMAT_NV21_10:
 			swap |= RGA_SRC_COLOR_UV_SWAP;
 			break;
 
@@ -245,7 +298,7 @@ static int rga_get_color_format(int drm_color_format)
 		case DRM_FORMAT_NV12:
 		case DRM_FORMAT_NV21:
 		case DRM_FORMAT_NV12_10:
-			//case DRM_FORMAT_NV21_10:
+		case DRM_FORMAT_NV21_10:
 			return RGA_SRC_COLOR_FMT_YUV420SP;
 
 		case DRM_FORMAT_YUV420:
@@ -296,6 +349,10 @@ int get_string_of_cmd(int index,char *buf)
 					 strcpy(buf,"SRC_Y_RGB_BASE_ADDR");break;
 		case RGA_BUF_TYPE_GEMFD | DST_Y_RGB_BASE_ADDR:
 					 strcpy(buf,"DST_Y_RGB_BASE_ADDR");break;
+		case RGA_BUF_TYPE_USERPTR | SRC_Y_RGB_BASE_ADDR:
+					 strcpy(buf,"SRC_Y_RGB_BASE_ADDR");break;
+		case RGA_BUF_TYPE_USERPTR | DST_Y_RGB_BASE_ADDR:
+					 strcpy(buf,"DST_Y_RGB_BASE_ADDR");break;
 		default			:strcpy(buf,"ERROR_OFFSET       ");break;
 	}
 	return 0;
@@ -332,20 +389,22 @@ rga_get_addr_offset(struct rga_image *img, unsigned int x, unsigned int y,
 	uv_stride = img->stride / x_div;
 	pixel_width = img->stride / img->width;
 
-	lt->y_off = y * img->stride + x * pixel_width;
-	lt->u_off = img->stride * img->hstride + (y / y_div) * uv_stride + x / x_div;
+	lt->y_off = img->offset + y * img->stride +
+		    rga_get_byte_offset(img, x, pixel_width);
+	lt->u_off = img->offset + img->stride * img->hstride +
+		    (y / y_div) * uv_stride + rga_get_byte_offset(img, x / x_div, 1);
 	lt->v_off = lt->u_off + img->width * img->hstride / uv_factor;
 
 	lb->y_off = lt->y_off + (h - 1) * img->stride;
 	lb->u_off = lt->u_off + (h / y_div - 1) * uv_stride;
 	lb->v_off = lt->v_off + (h / y_div - 1) * uv_stride;
 
-	rt->y_off = lt->y_off + (w - 1) * pixel_width;
-	rt->u_off = lt->u_off + w / x_div - 1;
+	rt->y_off = lt->y_off + rga_get_byte_offset(img, w - 1, pixel_width);
+	rt->u_off = lt->u_off + rga_get_byte_offset(img, w / x_div - 1, 1);
 	rt->v_off = lt->v_off + w / x_div - 1;
 
-	rb->y_off = lb->y_off + (w - 1) * pixel_width;
-	rb->u_off = lb->u_off + w / x_div - 1;
+	rb->y_off = lb->y_off + rga_get_byte_offset(img, w - 1, pixel_width);
+	rb->u_off = lb->u_off + rga_get_byte_offset(img, w / x_div - 1, 1);
 	rb->v_off = lb->v_off + w / x_div - 1;
 
 	return offsets;
@@ -399,7 +458,7 @@ static int rga_add_cmd(struct rga_context *ctx, unsigned long cmd,
 		//LOGI("%s:%8x:  0x%x\n",buf,cmd,value);
 	}
 
-	switch (cmd & ~(RGA_IMGBUF_USERPTR)) {
+	switch (cmd & ~(RGA_BUF_TYPE_USERPTR | RGA_BUF_TYPE_GEMFD)) {
 	case SRC_Y_RGB_BASE_ADDR:
 	case SRC_CB_BASE_ADDR:
 	case SRC_CR_BASE_ADDR:
@@ -503,19 +562,24 @@ int rga_dst_color_is_yuv(int format)
  * @ctx: a pointer to rga_context structure.
  * @img: a pointer to the dst/src rga_image structure.
  * @reg: the register that should be set.
+ *
+ * The buffers are handed to the kernel as dma-buf fds, the kernel driver
+ * then builds the RGA MMU page tables (MMU_CTRL1 and the MMU_*_BASE
+ * registers) for them, so they need not be physically contiguous.
  */
-static void rga_add_base_addr(struct rga_context *ctx, struct rga_image *img,
-			      enum rga_base_addr_reg reg)
+static int rga_add_base_addr(struct rga_context *ctx, struct rga_image *img,
+			     enum rga_base_addr_reg reg)
 {
 	const unsigned long cmd = (reg == rga_dst) ?
 		DST_Y_RGB_BASE_ADDR : SRC_Y_RGB_BASE_ADDR;
 
 	if (img->buf_type == RGA_IMGBUF_USERPTR) {
-		fprintf(stderr, "Can't support userptr now!\n");
-		return;
-	} else {
-		rga_add_cmd(ctx, cmd | RGA_BUF_TYPE_GEMFD, img->bo[0]);
+		fprintf(stderr, "userptr images are not supported, "
+			"use a GEM buffer.\n");
+		return -EINVAL;
 	}
+
+	return rga_add_cmd(ctx, cmd | RGA_BUF_TYPE_GEMFD, img->bo[0]);
 }
 
 /*
@@ -659,6 +723,12 @@ int rga_solid_fill(struct rga_context *ctx, struct rga_image *img,
 
 	struct rga_corners_addr_offset offsets;
 
+	if (rga_is_yuv_ten(img->color_mode) ||
+	    rga_get_color_format(img->color_mode) < 0) {
+		fprintf(stderr, "unsupported destination color format.\n");
+		return -EINVAL;
+	}
+
 	if (x + w > img->width)
 		w = img->width - x;
 	if (y + h > img->height)
@@ -729,7 +799,10 @@ int rga_solid_fill(struct rga_context *ctx, struct rga_image *img,
 	rga_add_cmd(ctx, DST_CB_BASE_ADDR, offsets.left_top.u_off);
 	rga_add_cmd(ctx, DST_CR_BASE_ADDR, offsets.left_top.v_off);
 
-	rga_add_base_addr(ctx, img, rga_dst);
+	if (rga_add_base_addr(ctx, img, rga_dst)) {
+		rga_reset(ctx);
+		return -EINVAL;
+	}
 
 
 	/* Start to flush RGA device */
@@ -761,6 +834,7 @@ int rga_multiple_transform(struct rga_context *ctx, struct rga_image *src,
 	struct rga_corners_addr_offset src_offsets;
 
 	unsigned int scale_dst_w, scale_dst_h;
+	int dither_mode;
 
 	if (degree != 0 && degree != 90 && degree != 180 && degree != 270) {
 		fprintf(stderr, "invalid rotate degree.\n");
@@ -774,6 +848,23 @@ int rga_multiple_transform(struct rga_context *ctx, struct rga_image *src,
 		return -EINVAL;
 	}
 
+	/*
+	 * The RGA reads the packed 10-bit YUV layouts, but it can only write
+	 * 8-bit formats, so 10-bit content is always down-converted.
+	 */
+	if (rga_get_color_format(src->color_mode) < 0) {
+		fprintf(stderr, "unsupported source color format.\n");
+		rga_reset(ctx);
+		return -EINVAL;
+	}
+
+	if (rga_is_yuv_ten(dst->color_mode) ||
+	    rga_get_color_format(dst->color_mode) < 0) {
+		fprintf(stderr, "unsupported destination color format.\n");
+		rga_reset(ctx);
+		return -EINVAL;
+	}
+
 	if (src_x + src_w > src->width)
 		src_w = src->width - src_x;
 	if (src_y + src_h > src->height)
@@ -821,9 +912,12 @@ int rga_multiple_transform(struct rga_context *ctx, struct rga_image *src,
 	src_info.data.swap     = rga_get_color_swap(src->color_mode);
 	dst_info.data.swap     = rga_get_color_swap(dst->color_mode);
 
-	if (src->color_mode == DRM_FORMAT_NV12_10) {
+	if (rga_is_yuv_ten(src->color_mode)) {
 		src_info.data.yuv_ten_en = RGA_SRC_YUV_TEN_ENABLE;
-		src_info.data.yuv_ten_round_en = RGA_SRC_YUV_TEN_ROUND_ENABLE;
+		if (src->yuv_ten_mode == RGA_YUV_TEN_ROUND)
+			src_info.data.yuv_ten_round_en = RGA_SRC_YUV_TEN_ROUND_ENABLE;
+		else
+			src_info.data.yuv_ten_round_en = RGA_SRC_YUV_TEN_ROUND_DISABLE;
 	}
 
 	switch (degree) {
@@ -871,7 +965,7 @@ int rga_multiple_transform(struct rga_context *ctx, struct rga_image *src,
 	if (src_w == scale_dst_w) {
 		src_info.data.hscl_mode = RGA_SRC_HSCL_MODE_NO;
 		x_factor.val = 0;
-		if (src->color_mode == DRM_FORMAT_NV12_10)
+		if (rga_is_yuv_ten(src->color_mode))
 		    src_info.data.hscl_mode = RGA_SRC_HSCL_MODE_DOWN | RGA_SRC_HSCL_MODE_UP;
 	} else if(src_w > scale_dst_w) {
 		src_info.data.hscl_mode = RGA_SRC_HSCL_MODE_DOWN;
@@ -884,7 +978,7 @@ int rga_multiple_transform(struct rga_context *ctx, struct rga_image *src,
 	if (src_h == scale_dst_h) {
 		src_info.data.vscl_mode = RGA_SRC_VSCL_MODE_NO;
 		y_factor.val = 0;
-		if (src->color_mode == DRM_FORMAT_NV12_10)
+		if (rga_is_yuv_ten(src->color_mode))
 		    src_info.data.vscl_mode = RGA_SRC_VSCL_MODE_DOWN | RGA_SRC_VSCL_MODE_UP;
 	} else if(src_h > scale_dst_h) {
 		src_info.data.vscl_mode = RGA_SRC_VSCL_MODE_DOWN;
@@ -911,6 +1005,16 @@ int rga_multiple_transform(struct rga_context *ctx, struct rga_image *src,
 			&& rga_dst_color_is_yuv(dst_info.data.format))
 		dst_info.data.csc_mode = RGA_SRC_CSC_MODE_BT601_R1;
 
+	/*
+	 * Dither instead of truncating when reducing to a low depth
+	 * destination, if the caller asked for it.
+	 */
+	dither_mode = rga_get_dither_down_mode(dst->color_mode);
+	if (dst->dither && dither_mode >= 0) {
+		dst_info.data.dither_down_en = 1;
+		dst_info.data.dither_down_mode = dither_mode;
+	}
+
 	rga_add_cmd(ctx, SRC_INFO, src_info.val);
 	rga_add_cmd(ctx, DST_INFO, dst_info.val);
 
@@ -945,7 +1049,10 @@ int rga_multiple_transform(struct rga_context *ctx, struct rga_image *src,
 	rga_add_cmd(ctx, SRC_CB_BASE_ADDR, src_offsets.left_top.u_off);
 	rga_add_cmd(ctx, SRC_CR_BASE_ADDR, src_offsets.left_top.v_off);
 
-	rga_add_base_addr(ctx, src, rga_src);
+	if (rga_add_base_addr(ctx, src, rga_src)) {
+		rga_reset(ctx);
+		return -EINVAL;
+	}
 
 
 	/*
@@ -959,7 +1066,10 @@ int rga_multiple_transform(struct rga_context *ctx, struct rga_image *src,
 	rga_add_cmd(ctx, DST_CB_BASE_ADDR, dst_offset->u_off);
 	rga_add_cmd(ctx, DST_CR_BASE_ADDR, dst_offset->v_off);
 
-	rga_add_base_addr(ctx, dst, rga_dst);
+	if (rga_add_base_addr(ctx, dst, rga_dst)) {
+		rga_reset(ctx);
+		return -EINVAL;
+	}
 
 
 	/* Start to flush RGA device */
@@ -1084,3 +1194,141 @@ int rga_copy(struct rga_context *ctx, struct rga_image *src,
 				      src_h, dst_x, dst_y, dst_w, dst_h,
 				      0, 0, 0);
 }
+
+/**
+ * rga_fit - fit the source rectangle into the destination rectangle,
+ *	preserving the aspect ratio according to the given mode.
+ *
+ * @ctx: a pointer to rga_context structure.
+ * @src: a pointer to rga_image structure including image and buffer
+ *	information to source.
+ * @dst: a pointer to rga_image structure including image and buffer
+ *	information to destination. Its fill_color is used for the bars.
+ * @src_x: x start position to source buffer.
+ * @src_y: y start position to source buffer.
+ * @src_w: width value to source buffer.
+ * @src_h: height value to source buffer.
+ * @dst_x: x start position to destination buffer.
+ * @dst_y: y start position to destination buffer.
+ * @dst_w: width value to destination buffer.
+ * @dst_h: height value to destination buffer.
+ * @mode: RGA_FIT_LETTERBOX scales the whole source into the destination and
+ *	fills the uncovered bars, RGA_FIT_CROP crops the source centrally so
+ *	that it covers the whole destination, RGA_FIT_STRETCH ignores the
+ *	aspect ratio.
+ *
+ * The bar fills and the scaled copy are queued together, so a single
+ * rga_exec() afterwards runs the whole operation.
+ */
+int rga_fit(struct rga_context *ctx, struct rga_image *src,
+	    struct rga_image *dst, unsigned int src_x, unsigned int src_y,
+	    unsigned int src_w, unsigned int src_h, unsigned int dst_x,
+	    unsigned int dst_y, unsigned int dst_w, unsigned int dst_h,
+	    enum e_rga_fit_mode mode)
+{
+	unsigned int fit_x = dst_x, fit_y = dst_y, fit_w = dst_w, fit_h = dst_h;
+	unsigned int align = 1;
+	uint64_t src_ratio, dst_ratio;
+	unsigned int fills;
+	int ret = 0;
+
+	if (src_x + src_w > src->width)
+		src_w = src->width - src_x;
+	if (src_y + src_h > src->height)
+		src_h = src->height - src_y;
+
+	if (dst_x + dst_w > dst->width)
+		dst_w = dst->width - dst_x;
+	if (dst_y + dst_h > dst->height)
+		dst_h = dst->height - dst_y;
+
+	if (src_w == 0 || src_h == 0 || dst_w == 0 || dst_h == 0) {
+		fprintf(stderr, "invalid width or height.\n");
+		return -EINVAL;
+	}
+
+	/*
+	 * Compare the aspect ratios by cross multiplication, so the geometry
+	 * stays exact and both axes end up with the same rga_get_scaling()
+	 * factor up to the final pixel rounding.
+	 */
+	src_ratio = (uint64_t)src_w * dst_h;
+	dst_ratio = (uint64_t)src_h * dst_w;
+
+	/* Chroma subsampled targets need even offsets and sizes */
+	if (rga_dst_color_is_yuv(rga_get_color_format(dst->color_mode)))
+		align = 2;
+
+	switch (mode) {
+	case RGA_FIT_LETTERBOX:
+		if (src_ratio > dst_ratio)
+			fit_h = (uint64_t)src_h * dst_w / src_w & ~(align - 1);
+		else if (src_ratio < dst_ratio)
+			fit_w = (uint64_t)src_w * dst_h / src_h & ~(align - 1);
+
+		fit_x = dst_x + ((dst_w - fit_w) / 2 & ~(align - 1));
+		fit_y = dst_y + ((dst_h - fit_h) / 2 & ~(align - 1));
+		break;
+	case RGA_FIT_CROP:
+		if (src_ratio > dst_ratio) {
+			unsigned int crop_w = (uint64_t)src_h * dst_w / dst_h;
+
+			src_x += (src_w - crop_w) / 2;
+			src_w = crop_w;
+		} else if (src_ratio < dst_ratio) {
+			unsigned int crop_h = (uint64_t)src_w * dst_h / dst_w;
+
+			src_y += (src_h - crop_h) / 2;
+			src_h = crop_h;
+		}
+		break;
+	case RGA_FIT_STRETCH:
+		break;
+	default:
+		fprintf(stderr, "invalid fit mode %d.\n", mode);
+		return -EINVAL;
+	}
+
+	/* Reject geometry the scaler cannot handle before queuing any fill */
+	if (src_w < 32 || src_h < 34 || fit_w < 32 || fit_h < 34) {
+		fprintf(stderr, "invalid src/dst width or height.\n");
+		return -EINVAL;
+	}
+
+	if (rga_get_color_format(src->color_mode) < 0) {
+		fprintf(stderr, "unsupported source color format.\n");
+		return -EINVAL;
+	}
+
+	/*
+	 * Each bar and the copy take a cmdlist. Make sure they all fit, so
+	 * that no bar is left queued without the content.
+	 */
+	fills = (fit_y > dst_y) + (fit_y + fit_h < dst_y + dst_h) +
+		(fit_x > dst_x) + (fit_x + fit_w < dst_x + dst_w);
+	if (ctx->cmdlist_nr + fills + 1 > RGA_MAX_CMD_LIST_NR) {
+		fprintf(stderr, "Overflow cmdlist.\n");
+		return -EINVAL;
+	}
+
+	if (fit_y > dst_y)
+		ret = rga_solid_fill(ctx, dst, dst_x, dst_y, dst_w,
+				     fit_y - dst_y);
+	if (!ret && fit_y + fit_h < dst_y + dst_h)
+		ret = rga_solid_fill(ctx, dst, dst_x, fit_y + fit_h, dst_w,
+				     dst_y + dst_h - fit_y - fit_h);
+
+	if (!ret && fit_x > dst_x)
+		ret = rga_solid_fill(ctx, dst, dst_x, fit_y, fit_x - dst_x,
+				     fit_h);
+	if (!ret && fit_x + fit_w < dst_x + dst_w)
+		ret = rga_solid_fill(ctx, dst, fit_x + fit_w, fit_y,
+				     dst_x + dst_w - fit_x - fit_w, fit_h);
+
+	if (ret)
+		return ret;
+
+	return rga_multiple_transform(ctx, src, dst, src_x, src_y, src_w,
+				      src_h, fit_x, fit_y, fit_w, fit_h,
+				      0, 0, 0);
+}
@@ -13,12 +13,32 @@
 #ifndef _FIMrga_H_
 #define _FIMrga_H_
 
+/*
+ * RGA_IMGBUF_USERPTR images are rejected with -EINVAL: the kernel takes
+ * buffers in 32-bit command words, which cannot hold a user pointer in a
+ * 64-bit process. Use GEM buffers (dma-buf fds) instead.
+ */
 enum e_rga_buf_type {
 	RGA_IMGBUF_COLOR,
 	RGA_IMGBUF_GEM,
 	RGA_IMGBUF_USERPTR,
 };
 
+/*
+ * How 10-bit YUV sources (DRM_FORMAT_NV12_10 / NV21_10) are reduced to the
+ * 8-bit precision of the destination.
+ */
+enum e_rga_yuv_ten_mode {
+	RGA_YUV_TEN_ROUND,
+	RGA_YUV_TEN_TRUNCATE,
+};
+
+enum e_rga_fit_mode {
+	RGA_FIT_LETTERBOX,
+	RGA_FIT_CROP,
+	RGA_FIT_STRETCH,
+};
+
 #define RGA_PLANE_MAX_NR	3
 #define RGA_MAX_CMD_NR		32
 #define RGA_MAX_GEM_CMD_NR	10
@@ -34,6 +54,9 @@ struct rga_image {
 	enum e_rga_buf_type		buf_type;
 	unsigned int			bo[RGA_PLANE_MAX_NR];
 	struct drm_rockchip_rga_userptr	user_ptr[RGA_PLANE_MAX_NR];
+	enum e_rga_yuv_ten_mode		yuv_ten_mode;
+	unsigned int			dither;
+	unsigned int			offset;
 };
 
 struct rga_context {
@@ -84,4 +107,10 @@ int rga_multiple_transform(struct rga_context *ctx, struct rga_image *src,
 			   unsigned int dst_y, unsigned int dst_w,
 			   unsigned int dst_h, unsigned int degree,
 			   unsigned int x_mirr, unsigned int y_mirr);
+
+int rga_fit(struct rga_context *ctx, struct rga_image *src,
+	    struct rga_image *dst, unsigned int src_x, unsigned int src_y,
+	    unsigned int src_w, unsigned int src_h, unsigned int dst_x,
+	    unsigned int dst_y, unsigned int dst_w, unsigned int dst_h,
+	    enum e_rga_fit_mode mode);
 #endif /* _RGA_H_ */
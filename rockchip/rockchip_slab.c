@@ -0,0 +1,330 @@
+/*
+ * Copyright (C) ROCKCHIP, Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <strings.h>
+#include <pthread.h>
+
+#include <xf86drm.h>
+
+#include "libdrm_lists.h"
+#include "rockchip_drm.h"
+#include "rockchip_drmif.h"
+
+/*
+ * Small allocations are carved out of ROCKCHIP_SLAB_PAGE_SIZE sized buffer
+ * objects. Every page serves a single power of two chunk size, between
+ * ROCKCHIP_SLAB_MIN_SIZE and ROCKCHIP_SLAB_MAX_SIZE, and tracks its free
+ * chunks in a bitmap. Bigger allocations get a buffer object of their own.
+ */
+#define ROCKCHIP_SLAB_PAGE_SIZE		(256 * 1024U)
+#define ROCKCHIP_SLAB_MIN_SHIFT		6
+#define ROCKCHIP_SLAB_MAX_SHIFT		15
+#define ROCKCHIP_SLAB_MIN_SIZE		(1 << ROCKCHIP_SLAB_MIN_SHIFT)
+#define ROCKCHIP_SLAB_MAX_SIZE		(1 << ROCKCHIP_SLAB_MAX_SHIFT)
+#define ROCKCHIP_SLAB_NR_CLASSES	\
+	(ROCKCHIP_SLAB_MAX_SHIFT - ROCKCHIP_SLAB_MIN_SHIFT + 1)
+#define ROCKCHIP_SLAB_MAP_WORDS		\
+	(ROCKCHIP_SLAB_PAGE_SIZE / ROCKCHIP_SLAB_MIN_SIZE / 32)
+
+struct rockchip_slab_page {
+	drmMMListHead		link;
+	struct rockchip_bo	*bo;
+	unsigned int		shift;
+	unsigned int		nr_free;
+	/* set bits are free chunks */
+	uint32_t		map[ROCKCHIP_SLAB_MAP_WORDS];
+};
+
+struct rockchip_slab {
+	struct rockchip_device	*dev;
+	uint32_t		flags;
+	pthread_mutex_t		lock;
+	/* pages with at least one free chunk, per size class */
+	drmMMListHead		partial[ROCKCHIP_SLAB_NR_CLASSES];
+	/* completely used pages, per size class */
+	drmMMListHead		full[ROCKCHIP_SLAB_NR_CLASSES];
+	/* gem handle -> struct rockchip_slab_page */
+	void			*pages;
+};
+
+static unsigned int rockchip_slab_shift(size_t size)
+{
+	unsigned int shift = ROCKCHIP_SLAB_MIN_SHIFT;
+
+	while ((1UL << shift) < size)
+		shift++;
+
+	return shift;
+}
+
+static struct rockchip_slab_page *
+rockchip_slab_page_create(struct rockchip_slab *slab, unsigned int shift)
+{
+	struct rockchip_slab_page *page;
+	unsigned int nr_chunks = ROCKCHIP_SLAB_PAGE_SIZE >> shift;
+	unsigned int i;
+
+	page = calloc(1, sizeof(*page));
+	if (!page) {
+		fprintf(stderr, "failed to allocate slab page[%s].\n",
+				strerror(errno));
+		return NULL;
+	}
+
+	page->bo = rockchip_bo_create(slab->dev, ROCKCHIP_SLAB_PAGE_SIZE,
+				      slab->flags);
+	if (!page->bo) {
+		free(page);
+		return NULL;
+	}
+
+	page->shift = shift;
+	page->nr_free = nr_chunks;
+	for (i = 0; i < nr_chunks / 32; i++)
+		page->map[i] = ~0U;
+	if (nr_chunks % 32)
+		page->map[i] = (1U << (nr_chunks % 32)) - 1;
+
+	if (drmHashInsert(slab->pages, page->bo->handle, page)) {
+		fprintf(stderr, "failed to track slab page.\n");
+		rockchip_bo_destroy(page->bo);
+		free(page);
+		return NULL;
+	}
+
+	return page;
+}
+
+static void rockchip_slab_page_destroy(struct rockchip_slab *slab,
+				       struct rockchip_slab_page *page)
+{
+	drmHashDelete(slab->pages, page->bo->handle);
+	DRMLISTDEL(&page->link);
+	rockchip_bo_destroy(page->bo);
+	free(page);
+}
+
+/*
+ * Create a sub-allocator for small rockchip buffer objects.
+ *
+ * @dev: rockchip drm device object.
+ * @flags: memory type of the backing buffer objects, see
+ *	rockchip_bo_create().
+ *
+ * if true, return the slab object else NULL.
+ */
+struct rockchip_slab *rockchip_slab_create(struct rockchip_device *dev,
+					   uint32_t flags)
+{
+	struct rockchip_slab *slab;
+	unsigned int i;
+
+	slab = calloc(1, sizeof(*slab));
+	if (!slab) {
+		fprintf(stderr, "failed to create slab[%s].\n",
+				strerror(errno));
+		return NULL;
+	}
+
+	slab->pages = drmHashCreate();
+	if (!slab->pages) {
+		free(slab);
+		return NULL;
+	}
+
+	slab->dev = dev;
+	slab->flags = flags;
+	pthread_mutex_init(&slab->lock, NULL);
+
+	for (i = 0; i < ROCKCHIP_SLAB_NR_CLASSES; i++) {
+		DRMINITLISTHEAD(&slab->partial[i]);
+		DRMINITLISTHEAD(&slab->full[i]);
+	}
+
+	return slab;
+}
+
+/*
+ * Destroy a sub-allocator and all of its backing buffer objects.
+ *
+ * @slab: a slab object. Allocations still in use become invalid.
+ */
+void rockchip_slab_destroy(struct rockchip_slab *slab)
+{
+	struct rockchip_slab_page *page, *tmp;
+	unsigned int i;
+
+	if (!slab)
+		return;
+
+	for (i = 0; i < ROCKCHIP_SLAB_NR_CLASSES; i++) {
+		DRMLISTFOREACHENTRYSAFE(page, tmp, &slab->partial[i], link)
+			rockchip_slab_page_destroy(slab, page);
+		DRMLISTFOREACHENTRYSAFE(page, tmp, &slab->full[i], link)
+			rockchip_slab_page_destroy(slab, page);
+	}
+
+	drmHashDestroy(slab->pages);
+	pthread_mutex_destroy(&slab->lock);
+	free(slab);
+}
+
+/*
+ * Allocate a small buffer from the slab.
+ *
+ * @slab: a slab object.
+ * @size: user-desired size.
+ * @offset: returns the offset of the allocation in the returned buffer
+ *	object, aligned to the allocation size rounded up to a power of two.
+ *
+ * the returned buffer object is shared with other allocations and must not
+ * be destroyed by the caller, release the allocation with
+ * rockchip_slab_free() instead. Sizes above the slab limit get a buffer
+ * object of their own at offset 0.
+ *
+ * if true, return the backing buffer object else NULL.
+ */
+struct rockchip_bo *rockchip_slab_alloc(struct rockchip_slab *slab,
+					size_t size, uint32_t *offset)
+{
+	struct rockchip_slab_page *page;
+	unsigned int shift, class, i, bit;
+	int miss = 0;
+
+	if (size == 0) {
+		fprintf(stderr, "invalid size.\n");
+		return NULL;
+	}
+
+	if (size > ROCKCHIP_SLAB_MAX_SIZE) {
+		*offset = 0;
+		return rockchip_bo_create(slab->dev, size, slab->flags);
+	}
+
+	shift = rockchip_slab_shift(size);
+	class = shift - ROCKCHIP_SLAB_MIN_SHIFT;
+
+	pthread_mutex_lock(&slab->lock);
+
+	if (DRMLISTEMPTY(&slab->partial[class])) {
+		page = rockchip_slab_page_create(slab, shift);
+		if (!page) {
+			pthread_mutex_unlock(&slab->lock);
+			return NULL;
+		}
+		DRMLISTADD(&page->link, &slab->partial[class]);
+		miss = 1;
+	} else {
+		page = DRMLISTENTRY(struct rockchip_slab_page,
+				    slab->partial[class].next, link);
+	}
+
+	for (i = 0; !page->map[i]; i++)
+		;
+
+	bit = ffs(page->map[i]) - 1;
+	page->map[i] &= ~(1U << bit);
+
+	if (--page->nr_free == 0) {
+		DRMLISTDEL(&page->link);
+		DRMLISTADD(&page->link, &slab->full[class]);
+	}
+
+	pthread_mutex_unlock(&slab->lock);
+
+	pthread_mutex_lock(&slab->dev->lock);
+	if (miss)
+		slab->dev->stats.slab_misses++;
+	else
+		slab->dev->stats.slab_hits++;
+	pthread_mutex_unlock(&slab->dev->lock);
+
+	*offset = (i * 32 + bit) << shift;
+
+	return page->bo;
+}
+
+/*
+ * Release an allocation returned by rockchip_slab_alloc().
+ *
+ * @slab: a slab object.
+ * @bo: the buffer object returned by rockchip_slab_alloc().
+ * @offset: the offset returned by rockchip_slab_alloc().
+ */
+void rockchip_slab_free(struct rockchip_slab *slab, struct rockchip_bo *bo,
+			uint32_t offset)
+{
+	struct rockchip_slab_page *page;
+	unsigned int class, chunk;
+	void *value;
+
+	if (!bo)
+		return;
+
+	pthread_mutex_lock(&slab->lock);
+
+	if (drmHashLookup(slab->pages, bo->handle, &value)) {
+		pthread_mutex_unlock(&slab->lock);
+		rockchip_bo_destroy(bo);
+		return;
+	}
+
+	page = value;
+	class = page->shift - ROCKCHIP_SLAB_MIN_SHIFT;
+	chunk = offset >> page->shift;
+
+	if (offset & ((1U << page->shift) - 1) ||
+	    chunk >= ROCKCHIP_SLAB_PAGE_SIZE >> page->shift ||
+	    page->map[chunk / 32] & 1U << (chunk % 32)) {
+		fprintf(stderr, "invalid or double slab free at offset %u.\n",
+			offset);
+		pthread_mutex_unlock(&slab->lock);
+		return;
+	}
+
+	page->map[chunk / 32] |= 1U << (chunk % 32);
+
+	if (page->nr_free++ == 0) {
+		DRMLISTDEL(&page->link);
+		DRMLISTADD(&page->link, &slab->partial[class]);
+	}
+
+	/*
+	 * Give empty pages back to the kernel, but keep one around per size
+	 * class so that alloc/free cycles don't thrash GEM objects.
+	 */
+	if (page->nr_free == ROCKCHIP_SLAB_PAGE_SIZE >> page->shift &&
+	    slab->partial[class].next != slab->partial[class].prev)
+		rockchip_slab_page_destroy(slab, page);
+
+	pthread_mutex_unlock(&slab->lock);
+}
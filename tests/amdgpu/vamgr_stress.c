@@ -0,0 +1,207 @@
+/*
+ * Copyright (C) 2026 ROCKCHIP, Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+
+/*
+ * Fragmentation stress test of the VA manager: fill the address space
+ * with ranges of random size and alignment, free a random half of them and
+ * then time alloc/free pairs in the resulting swiss cheese.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <getopt.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "xf86drm.h"
+#include "amdgpu.h"
+
+#define MAX_CARDS_SUPPORTED	128
+
+struct va_range {
+	amdgpu_va_handle handle;
+	uint64_t address;
+	uint64_t size;
+};
+
+static unsigned long long timespec_us(const struct timespec *ts)
+{
+	return (unsigned long long)ts->tv_sec * 1000000 + ts->tv_nsec / 1000;
+}
+
+static int open_amdgpu_render_node(void)
+{
+	drmDevicePtr devices[MAX_CARDS_SUPPORTED];
+	int i, count, fd = -1;
+
+	count = drmGetDevices2(0, devices, MAX_CARDS_SUPPORTED);
+	if (count < 0)
+		return -1;
+
+	for (i = 0; i < count && fd < 0; i++) {
+		if (devices[i]->bustype != DRM_BUS_PCI ||
+		    devices[i]->deviceinfo.pci->vendor_id != 0x1002 ||
+		    !(devices[i]->available_nodes & 1 << DRM_NODE_RENDER))
+			continue;
+
+		fd = open(devices[i]->nodes[DRM_NODE_RENDER], O_RDWR | O_CLOEXEC);
+	}
+
+	drmFreeDevices(devices, count);
+
+	return fd;
+}
+
+static int range_alloc(amdgpu_device_handle dev, struct va_range *range)
+{
+	uint64_t size = (1 + rand() % 64) * 4096;
+	uint64_t alignment = 4096ULL << (rand() % 5);
+
+	range->size = size;
+
+	return amdgpu_va_range_alloc(dev, amdgpu_gpu_va_range_general, size,
+				     alignment, 0, &range->address,
+				     &range->handle, 0);
+}
+
+static void range_free(struct va_range *range)
+{
+	amdgpu_va_range_free(range->handle);
+	range->handle = NULL;
+}
+
+static void usage(const char *name)
+{
+	fprintf(stderr, "usage: %s [-d device] [-r ranges] [-i iterations]\n",
+		name);
+	exit(1);
+}
+
+int main(int argc, char **argv)
+{
+	unsigned int ranges = 100000, iterations = 1000000;
+	amdgpu_device_handle dev;
+	uint32_t major, minor;
+	struct va_range *va;
+	struct timespec start, end;
+	unsigned long long elapsed;
+	unsigned int i, live, failed = 0;
+	const char *device = NULL;
+	int fd, c, ret = 1;
+
+	while ((c = getopt(argc, argv, "d:r:i:")) != -1) {
+		switch (c) {
+		case 'd':
+			device = optarg;
+			break;
+		case 'r':
+			ranges = atoi(optarg);
+			break;
+		case 'i':
+			iterations = atoi(optarg);
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+
+	if (!ranges)
+		usage(argv[0]);
+
+	fd = device ? open(device, O_RDWR | O_CLOEXEC) :
+		      open_amdgpu_render_node();
+	if (fd < 0) {
+		perror("Cannot open AMDGPU device");
+		return 1;
+	}
+
+	if (amdgpu_device_initialize(fd, &major, &minor, &dev)) {
+		fprintf(stderr, "amdgpu_device_initialize() failed\n");
+		goto out_close;
+	}
+
+	va = calloc(ranges, sizeof(*va));
+	if (!va)
+		goto out_device;
+
+	srand(time(NULL));
+
+	/* fill, then punch holes */
+	for (i = 0; i < ranges; i++) {
+		if (range_alloc(dev, &va[i])) {
+			fprintf(stderr, "address space exhausted after %u "
+				"ranges\n", i);
+			ranges = i;
+			break;
+		}
+	}
+
+	for (live = ranges, i = 0; i < ranges; i++) {
+		if (rand() & 1) {
+			range_free(&va[i]);
+			live--;
+		}
+	}
+
+	printf("%u of %u ranges left\n", live, ranges);
+
+	/* steady state: free a random range and allocate a new one */
+	clock_gettime(CLOCK_MONOTONIC, &start);
+
+	for (i = 0; ranges && i < iterations; i++) {
+		struct va_range *range = &va[rand() % ranges];
+
+		if (range->handle)
+			range_free(range);
+		else if (range_alloc(dev, range))
+			failed++;
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	elapsed = timespec_us(&end) - timespec_us(&start);
+
+	printf("%u alloc/free in %llu us, %.3f us/op, %u failed\n", iterations,
+	       elapsed, iterations ? (double)elapsed / iterations : 0.0,
+	       failed);
+
+	for (i = 0; i < ranges; i++)
+		if (va[i].handle)
+			range_free(&va[i]);
+
+	free(va);
+	ret = 0;
+
+out_device:
+	amdgpu_device_deinitialize(dev);
+out_close:
+	close(fd);
+
+	return ret;
+}
@@ -0,0 +1,180 @@
+/*
+ * Copyright (C) 2026 ROCKCHIP, Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+
+/*
+ * Host side test of the VA manager, no GPU needed: allocate and free random
+ * ranges, checking that no two allocations overlap and that the hole trees
+ * stay balanced and never hold adjacent holes, then free everything and
+ * check that the address space coalesced back into one piece.
+ */
+
+#include "amdgpu_vamgr.c"
+
+#include <stdio.h>
+
+#define PAGE		4096ULL
+#define PAGES		200000
+#define RANGES		4000
+#define ITERATIONS	400000
+
+struct va_range {
+	uint64_t address;
+	uint64_t size;
+};
+
+static int failed;
+
+#define check(cond) do { \
+	if (!(cond)) { \
+		fprintf(stderr, "%s:%d: check failed: %s\n", \
+			__FILE__, __LINE__, #cond); \
+		failed = 1; \
+	} \
+} while (0)
+
+/* returns the height of the tree, counting its nodes in count */
+static int check_tree(struct amdgpu_va_node *node, unsigned *count)
+{
+	int left, right;
+
+	if (!node)
+		return 0;
+
+	left = check_tree(node->child[0], count);
+	right = check_tree(node->child[1], count);
+	check(node->height == (left > right ? left : right) + 1);
+	check(left - right <= 1 && right - left <= 1);
+	(*count)++;
+
+	return node->height;
+}
+
+/* in order walk, returns the end of the last hole */
+static uint64_t check_holes(struct amdgpu_va_node *node, uint64_t end)
+{
+	struct amdgpu_bo_va_hole *hole;
+
+	if (!node)
+		return end;
+
+	end = check_holes(node->child[0], end);
+	hole = hole_by_offset(node);
+	check(hole->size > 0);
+	/* adjacent holes must have been merged */
+	check(!end || hole->offset > end);
+	end = hole->offset + hole->size;
+
+	return check_holes(node->child[1], end);
+}
+
+static void check_mgr(struct amdgpu_bo_va_mgr *mgr)
+{
+	unsigned by_offset = 0, by_size = 0;
+	uint64_t end;
+
+	check_tree(mgr->holes_by_offset, &by_offset);
+	check_tree(mgr->holes_by_size, &by_size);
+	check(by_offset == by_size);
+
+	end = check_holes(mgr->holes_by_offset, 0);
+	check(!by_offset || end < mgr->va_offset);
+}
+
+static void mark(unsigned char *used, uint64_t start, struct va_range *range,
+		 unsigned char value)
+{
+	uint64_t page;
+
+	for (page = (range->address - start) / PAGE;
+	     page < (range->address - start + range->size) / PAGE; page++) {
+		check(used[page] != value);
+		used[page] = value;
+	}
+}
+
+int main(void)
+{
+	uint64_t start = 0x100000, max = start + PAGE * PAGES;
+	struct amdgpu_bo_va_mgr mgr;
+	struct va_range *ranges;
+	unsigned char *used;
+	unsigned i, iteration;
+
+	ranges = calloc(RANGES, sizeof(*ranges));
+	used = calloc(PAGES, 1);
+	if (!ranges || !used)
+		return 1;
+
+	amdgpu_vamgr_init(&mgr, start, max, PAGE);
+	srand(1);
+
+	for (iteration = 0; iteration < ITERATIONS && !failed; iteration++) {
+		struct va_range *range = &ranges[rand() % RANGES];
+		uint64_t alignment, base = 0;
+
+		if (range->size) {
+			amdgpu_vamgr_free_va(&mgr, range->address, range->size);
+			mark(used, start, range, 0);
+			range->size = 0;
+			continue;
+		}
+
+		/* mostly small ranges, some large ones to fragment the space */
+		range->size = PAGE * (1 + rand() % (rand() % 8 ? 8 : 300));
+		alignment = PAGE << (rand() % 4);
+		if (rand() % 50 == 0)
+			base = ALIGN(start + PAGE * (rand() % PAGES), alignment);
+
+		range->address = amdgpu_vamgr_find_va(&mgr, range->size,
+						      alignment, base);
+		if (range->address == AMDGPU_INVALID_VA_ADDRESS) {
+			range->size = 0;
+			continue;
+		}
+
+		check(range->address % alignment == 0);
+		check(!base || range->address == base);
+		check(range->address >= start &&
+		      range->address + range->size <= max);
+		mark(used, start, range, 1);
+
+		if (iteration % 10000 == 0)
+			check_mgr(&mgr);
+	}
+
+	for (i = 0; i < RANGES; i++)
+		if (ranges[i].size)
+			amdgpu_vamgr_free_va(&mgr, ranges[i].address,
+					     ranges[i].size);
+
+	check_mgr(&mgr);
+	check(mgr.va_offset == start);
+	check(!mgr.holes_by_offset && !mgr.holes_by_size);
+
+	amdgpu_vamgr_deinit(&mgr);
+	free(used);
+	free(ranges);
+
+	return failed;
+}
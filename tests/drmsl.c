@@ -40,133 +40,327 @@
 
 #include <stdio.h>
 #include <stdlib.h>
-#include <sys/time.h>
+#include <time.h>
 
 #include "xf86drm.h"
 
-static void print(void* list)
+/* The skip list and the B+ tree share their interface. */
+
+struct ordered_map {
+    const char *name;
+    void *(*create)(void);
+    int  (*destroy)(void *map);
+    int  (*insert)(void *map, unsigned long key, void *value);
+    int  (*lookup)(void *map, unsigned long key, void **value);
+    int  (*delete)(void *map, unsigned long key);
+    int  (*first)(void *map, unsigned long *key, void **value);
+    int  (*next)(void *map, unsigned long *key, void **value);
+    int  (*neighbors)(void *map, unsigned long key,
+                      unsigned long *prev_key, void **prev_value,
+                      unsigned long *next_key, void **next_value);
+    void (*dump)(void *map);
+};
+
+static const struct ordered_map maps[] = {
+    { "skip list", drmSLCreate, drmSLDestroy, drmSLInsert, drmSLLookup,
+      drmSLDelete, drmSLFirst, drmSLNext, drmSLLookupNeighbors, drmSLDump },
+    { "B+ tree", drmBTCreate, drmBTDestroy, drmBTInsert, drmBTLookup,
+      drmBTDelete, drmBTFirst, drmBTNext, drmBTLookupNeighbors, drmBTDump },
+};
+
+#define NUM_MAPS (sizeof(maps) / sizeof(maps[0]))
+
+static void print(const struct ordered_map *map, void *list)
 {
     unsigned long key;
     void          *value;
 
-    if (drmSLFirst(list, &key, &value)) {
+    if (map->first(list, &key, &value)) {
 	do {
 	    printf("key = %5lu, value = %p\n", key, value);
-	} while (drmSLNext(list, &key, &value));
+	} while (map->next(list, &key, &value));
     }
 }
 
-static double do_time(int size, int iter)
+static void print_neighbors(const struct ordered_map *map, void *list,
+			    unsigned long key)
 {
-    void           *list;
-    int            i, j;
-    unsigned long  keys[1000000];
-    unsigned long  previous;
-    unsigned long  key;
-    void           *value;
-    struct timeval start, stop;
-    double         usec;
-    void           *ranstate;
-
-    list = drmSLCreate();
-    ranstate = drmRandomCreate(12345);
+    unsigned long prev_key = 0;
+    unsigned long next_key = 0;
+    void          *prev_value;
+    void          *next_value;
+    int           retval;
 
-    for (i = 0; i < size; i++) {
-	keys[i] = drmRandom(ranstate);
-	drmSLInsert(list, keys[i], NULL);
+    retval = map->neighbors(list, key,
+			    &prev_key, &prev_value,
+			    &next_key, &next_value);
+    printf("Neighbors of %5lu: %d %5lu %5lu\n",
+	   key, retval, prev_key, next_key);
+}
+
+static void demo(const struct ordered_map *map)
+{
+    void *list;
+
+    printf("\n***** %s *****\n\n", map->name);
+
+    list = map->create();
+    print(map, list);
+    printf("\n==============================\n\n");
+
+    map->insert(list, 123, NULL);
+    map->insert(list, 213, NULL);
+    map->insert(list, 50, NULL);
+    print(map, list);
+    printf("\n==============================\n\n");
+
+    print_neighbors(map, list, 0);
+    print_neighbors(map, list, 50);
+    print_neighbors(map, list, 51);
+    print_neighbors(map, list, 123);
+    print_neighbors(map, list, 200);
+    print_neighbors(map, list, 213);
+    print_neighbors(map, list, 256);
+    printf("\n==============================\n\n");
+
+    map->delete(list, 50);
+    print(map, list);
+    printf("\n==============================\n\n");
+
+    map->dump(list);
+    map->destroy(list);
+}
+
+/* Run the same random operations on both maps and compare the results. */
+
+static int check_consistency(unsigned long range, int ops)
+{
+    void          *sl = drmSLCreate();
+    void          *bt = drmBTCreate();
+    unsigned long sl_key, bt_key, sl_next, bt_next, key;
+    void          *sl_value, *bt_value, *sl_nvalue, *bt_nvalue;
+    void          *ranstate = drmRandomCreate(54321);
+    int           i, sl_ret, bt_ret, ret = 0;
+
+    for (i = 0; i < ops && !ret; i++) {
+	key = drmRandom(ranstate) % range;
+
+	switch (drmRandom(ranstate) % 4) {
+	case 0:
+	case 1:
+	    sl_ret = drmSLInsert(sl, key, (void *)(key + 1));
+	    bt_ret = drmBTInsert(bt, key, (void *)(key + 1));
+	    break;
+	case 2:
+	    sl_ret = drmSLDelete(sl, key);
+	    bt_ret = drmBTDelete(bt, key);
+	    break;
+	default:
+	    sl_ret = drmSLLookup(sl, key, &sl_value);
+	    bt_ret = drmBTLookup(bt, key, &bt_value);
+	    if (!bt_ret && bt_value != (void *)(key + 1))
+		bt_ret = -2;
+	    break;
+	}
+	if (sl_ret != bt_ret) {
+	    printf("Operation %d on %lu: skip list %d, B+ tree %d\n",
+		   i, key, sl_ret, bt_ret);
+	    ret = -1;
+	}
+
+	sl_ret = drmSLLookupNeighbors(sl, key, &sl_key, &sl_value,
+				      &sl_next, &sl_nvalue);
+	bt_ret = drmBTLookupNeighbors(bt, key, &bt_key, &bt_value,
+				      &bt_next, &bt_nvalue);
+	if (sl_ret != bt_ret || sl_key != bt_key || sl_next != bt_next ||
+	    sl_value != bt_value || sl_nvalue != bt_nvalue) {
+	    printf("Neighbors of %lu: skip list %d %lu %lu, "
+		   "B+ tree %d %lu %lu\n", key, sl_ret, sl_key, sl_next,
+		   bt_ret, bt_key, bt_next);
+	    ret = -1;
+	}
     }
 
-    previous = 0;
-    if (drmSLFirst(list, &key, &value)) {
-	do {
-	    if (key <= previous) {
-		printf( "%lu !< %lu\n", previous, key);
-	    }
-	    previous = key;
-	} while (drmSLNext(list, &key, &value));
+    sl_ret = drmSLFirst(sl, &sl_key, &sl_value);
+    bt_ret = drmBTFirst(bt, &bt_key, &bt_value);
+    while (sl_ret == 1 && bt_ret == 1 && !ret) {
+	if (sl_key != bt_key || sl_value != bt_value) {
+	    printf("Iteration: skip list %lu, B+ tree %lu\n", sl_key, bt_key);
+	    ret = -1;
+	}
+	sl_ret = drmSLNext(sl, &sl_key, &sl_value);
+	bt_ret = drmBTNext(bt, &bt_key, &bt_value);
+    }
+    if (sl_ret != bt_ret) {
+	printf("Iteration ended with skip list %d, B+ tree %d\n",
+	       sl_ret, bt_ret);
+	ret = -1;
     }
 
-    gettimeofday(&start, NULL);
-    for (j = 0; j < iter; j++) {
-	for (i = 0; i < size; i++) {
-	    if (drmSLLookup(list, keys[i], &value))
-		printf("Error %lu %d\n", keys[i], i);
+    printf("%d random operations on keys below %lu: %s\n", ops, range,
+	   ret ? "FAILED" : "ok");
+
+    drmRandomDestroy(ranstate);
+    drmSLDestroy(sl);
+    drmBTDestroy(bt);
+    return ret;
+}
+
+/* Bulk load every other key, then iterate over ranges with drmBTSeek(). */
+
+static int check_bulk_load(int count)
+{
+    unsigned long *keys = malloc(count * sizeof(*keys));
+    void          **values = malloc(count * sizeof(*values));
+    void          *bt = drmBTCreate();
+    unsigned long key, lo, hi, expect;
+    void          *value;
+    int           i, ret = 0;
+
+    for (i = 0; i < count; i++) {
+	keys[i]   = 2 * i + 2;
+	values[i] = (void *)(unsigned long)i;
+    }
+
+    if (drmBTBulkLoad(bt, keys, values, count))
+	ret = -1;
+
+    for (i = 0; i < count && !ret; i++)
+	if (drmBTLookup(bt, keys[i], &value) || value != values[i])
+	    ret = -1;
+
+    for (lo = 0; lo < 2UL * count + 4 && !ret; lo += count / 7 + 1) {
+	hi     = lo + 100;
+	expect = lo < 2 ? 2 : (lo + 1) & ~1UL;
+	for (i = drmBTSeek(bt, lo, &key, &value); i == 1 && key <= hi;
+	     i = drmBTNext(bt, &key, &value)) {
+	    if (key != expect || value != (void *)(key / 2 - 1))
+		ret = -1;
+	    expect += 2;
 	}
+	if (expect <= hi && expect <= 2UL * count)
+	    ret = -1;
     }
-    gettimeofday(&stop, NULL);
 
-    usec = (double)(stop.tv_sec * 1000000 + stop.tv_usec
-		    - start.tv_sec * 1000000 - start.tv_usec) / (size * iter);
+    /* The bulk loaded tree must survive regular updates */
+    for (i = 0; i < count && !ret; i += 2)
+	if (drmBTDelete(bt, keys[i]) || drmBTInsert(bt, keys[i] + 1, NULL))
+	    ret = -1;
+
+    printf("bulk load and range iteration of %d keys: %s\n", count,
+	   ret ? "FAILED" : "ok");
 
-    printf("%0.2f microseconds for list length %d\n", usec, size);
+    drmBTDestroy(bt);
+    free(values);
+    free(keys);
+    return ret;
+}
 
-    drmRandomDouble(ranstate);
-    drmSLDestroy(list);
+static double elapsed_ns(const struct timespec *start)
+{
+    struct timespec end;
 
-    return usec;
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    return (end.tv_sec - start->tv_sec) * 1e9 + (end.tv_nsec - start->tv_nsec);
 }
 
-static void print_neighbors(void *list, unsigned long key)
+struct timing {
+    double insert;
+    double lookup;
+    double iterate;
+    double delete;
+};
+
+static void do_time(const struct ordered_map *map, unsigned long *keys,
+		    int size, int iter, struct timing *t)
 {
-    unsigned long prev_key = 0;
-    unsigned long next_key = 0;
-    void          *prev_value;
-    void          *next_value;
-    int           retval;
+    struct timespec start;
+    unsigned long   previous, key;
+    void            *list, *value;
+    int             i, j;
 
-    retval = drmSLLookupNeighbors(list, key,
-				  &prev_key, &prev_value,
-				  &next_key, &next_value);
-    printf("Neighbors of %5lu: %d %5lu %5lu\n",
-	   key, retval, prev_key, next_key);
+    list = map->create();
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (i = 0; i < size; i++)
+	map->insert(list, keys[i], NULL);
+    t->insert = elapsed_ns(&start) / size;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (j = 0; j < iter; j++) {
+	for (i = 0; i < size; i++) {
+	    if (map->lookup(list, keys[i], &value))
+		printf("Error %lu %d\n", keys[i], i);
+	}
+    }
+    t->lookup = elapsed_ns(&start) / ((double)size * iter);
+
+    previous = 0;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    if (map->first(list, &key, &value)) {
+	do {
+	    if (key <= previous) {
+		printf( "%lu !< %lu\n", previous, key);
+	    }
+	    previous = key;
+	} while (map->next(list, &key, &value));
+    }
+    t->iterate = elapsed_ns(&start) / size;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (i = 0; i < size; i++)
+	map->delete(list, keys[i]);
+    t->delete = elapsed_ns(&start) / size;
+
+    map->destroy(list);
 }
 
-int main(void)
+static void benchmark(int size, int iter)
 {
-    void*    list;
-    double   usec, usec2, usec3, usec4;
+    struct timing t[NUM_MAPS];
+    unsigned long *keys;
+    void          *ranstate;
+    unsigned int  m;
+    int           i;
 
-    list = drmSLCreate();
-    printf( "list at %p\n", list);
+    keys     = malloc(size * sizeof(*keys));
+    ranstate = drmRandomCreate(12345);
+    for (i = 0; i < size; i++)
+	keys[i] = drmRandom(ranstate);
+    drmRandomDestroy(ranstate);
 
-    print(list);
-    printf("\n==============================\n\n");
+    for (m = 0; m < NUM_MAPS; m++) {
+	do_time(&maps[m], keys, size, iter, &t[m]);
+	printf("%-10s %7d keys: insert %7.1f, lookup %7.1f, "
+	       "iterate %5.1f, delete %7.1f ns/op\n", maps[m].name, size,
+	       t[m].insert, t[m].lookup, t[m].iterate, t[m].delete);
+    }
+    printf("%-10s %7d keys: lookup speedup %.2fx\n", "", size,
+	   t[0].lookup / t[1].lookup);
 
-    drmSLInsert(list, 123, NULL);
-    drmSLInsert(list, 213, NULL);
-    drmSLInsert(list, 50, NULL);
-    print(list);
-    printf("\n==============================\n\n");
+    free(keys);
+}
 
-    print_neighbors(list, 0);
-    print_neighbors(list, 50);
-    print_neighbors(list, 51);
-    print_neighbors(list, 123);
-    print_neighbors(list, 200);
-    print_neighbors(list, 213);
-    print_neighbors(list, 256);
-    printf("\n==============================\n\n");
+int main(void)
+{
+    unsigned int m;
+    int          ret = 0;
 
-    drmSLDelete(list, 50);
-    print(list);
+    for (m = 0; m < NUM_MAPS; m++)
+	demo(&maps[m]);
     printf("\n==============================\n\n");
 
-    drmSLDump(list);
-    drmSLDestroy(list);
+    ret |= check_consistency(100, 10000);
+    ret |= check_consistency(5000, 200000);
+    ret |= check_bulk_load(1);
+    ret |= check_bulk_load(33);
+    ret |= check_bulk_load(100000);
     printf("\n==============================\n\n");
 
-    usec  = do_time(100, 10000);
-    usec2 = do_time(1000, 500);
-    printf("Table size increased by %0.2f, search time increased by %0.2f\n",
-	   1000.0/100.0, usec2 / usec);
-
-    usec3 = do_time(10000, 50);
-    printf("Table size increased by %0.2f, search time increased by %0.2f\n",
-	   10000.0/100.0, usec3 / usec);
-
-    usec4 = do_time(100000, 4);
-    printf("Table size increased by %0.2f, search time increased by %0.2f\n",
-	   100000.0/100.0, usec4 / usec);
+    benchmark(100, 10000);
+    benchmark(1000, 500);
+    benchmark(10000, 50);
+    benchmark(100000, 4);
 
-    return 0;
+    return ret;
 }
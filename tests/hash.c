@@ -70,6 +70,9 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
 
 #include "xf86drm.h"
 #include "xf86drmHash.h"
@@ -103,19 +106,20 @@ static void update_dist(int count)
 
 static void compute_dist(HashTablePtr table)
 {
-    int           i;
+    unsigned long i;
     HashBucketPtr bucket;
 
-    printf("Entries = %ld, hits = %ld, partials = %ld, misses = %ld\n",
-          table->entries, table->hits, table->partials, table->misses);
+    printf("Entries = %ld, buckets = %ld, hits = %ld, partials = %ld, misses = %ld\n",
+          table->entries, table->maxp + table->p, table->hits,
+          table->partials, table->misses);
     clear_dist();
-    for (i = 0; i < HASH_SIZE; i++) {
-        bucket = table->buckets[i];
+    for (i = 0; i < table->maxp + table->p; i++) {
+        bucket = table->segments[i / HASH_SEGMENT_SIZE][i % HASH_SEGMENT_SIZE];
         update_dist(count_entries(bucket));
     }
     for (i = 0; i < DIST_LIMIT; i++) {
         if (i != DIST_LIMIT-1)
-            printf("%5d %10d\n", i, dist[i]);
+            printf("%5lu %10d\n", i, dist[i]);
         else
             printf("other %10d\n", dist[i]);
     }
@@ -152,6 +156,139 @@ static int check_table(HashTablePtr table,
     return retcode;
 }
 
+static int check_iteration(HashTablePtr table, unsigned long count)
+{
+    unsigned long key, seen = 0;
+    void          *value;
+
+    if (drmHashFirst(table, &key, &value)) {
+        do {
+            if (value != (void *)(key << 16 | key)) {
+                printf("Bad value during iteration: key = %lu\n", key);
+                return -1;
+            }
+            seen++;
+        } while (drmHashNext(table, &key, &value));
+    }
+
+    if (seen != count) {
+        printf("Iteration returned %lu entries, expected %lu\n", seen, count);
+        return -1;
+    }
+    return 0;
+}
+
+static double elapsed_ns(const struct timespec *start)
+{
+    struct timespec end;
+
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    return (end.tv_sec - start->tv_sec) * 1e9 + (end.tv_nsec - start->tv_nsec);
+}
+
+/* Insert, look up and delete count keys, and report the cost per op. */
+
+static int bench(const char *name, unsigned int flags, unsigned long count,
+                 unsigned long stride)
+{
+    struct timespec start;
+    HashTablePtr    table;
+    unsigned long   i;
+    void            *value;
+    int             ret = 0;
+
+    table = drmHashCreate2(flags);
+    if (!table)
+        return -1;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (i = 0; i < count; i++)
+        drmHashInsert(table, i * stride, (void *)i);
+    printf("%-12s %7lu keys: insert %6.1f ns/op", name, count,
+           elapsed_ns(&start) / count);
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (i = 0; i < count; i++)
+        if (drmHashLookup(table, i * stride, &value) || value != (void *)i)
+            ret = -1;
+    printf(", lookup %6.1f ns/op", elapsed_ns(&start) / count);
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (i = 0; i < count; i++)
+        if (drmHashDelete(table, i * stride))
+            ret = -1;
+    printf(", delete %6.1f ns/op\n", elapsed_ns(&start) / count);
+
+    if (table->entries)
+        ret = -1;
+    drmHashDestroy(table);
+    return ret;
+}
+
+#define THREADS        4
+#define THREAD_KEYS    20000
+
+struct worker {
+    pthread_t     thread;
+    HashTablePtr  table;
+    unsigned long base;
+    int           ret;
+};
+
+static void *worker_run(void *arg)
+{
+    struct worker *w = arg;
+    unsigned long i, key;
+    void          *value;
+
+    for (i = 0; i < THREAD_KEYS; i++) {
+        key = w->base + i;
+        if (drmHashInsert(w->table, key, (void *)(key << 16 | key)))
+            w->ret = -1;
+        /* Also look up the keys of the other threads, found or not */
+        drmHashLookup(w->table, (key + THREAD_KEYS) % (THREADS * THREAD_KEYS),
+                      &value);
+    }
+    for (i = 0; i < THREAD_KEYS; i++) {
+        key = w->base + i;
+        if (drmHashLookup(w->table, key, &value) ||
+            value != (void *)(key << 16 | key))
+            w->ret = -1;
+    }
+    return NULL;
+}
+
+static int bench_threads(void)
+{
+    struct worker   workers[THREADS];
+    struct timespec start;
+    HashTablePtr    table;
+    int             i, ret = 0;
+
+    table = drmHashCreate2(DRM_HASH_THREAD_SAFE);
+    if (!table)
+        return -1;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (i = 0; i < THREADS; i++) {
+        workers[i].table = table;
+        workers[i].base  = i * THREAD_KEYS;
+        workers[i].ret   = 0;
+        pthread_create(&workers[i].thread, NULL, worker_run, &workers[i]);
+    }
+    for (i = 0; i < THREADS; i++) {
+        pthread_join(workers[i].thread, NULL);
+        ret |= workers[i].ret;
+    }
+    printf("%d threads    %7d keys: %6.1f ns/op\n", THREADS,
+           THREADS * THREAD_KEYS,
+           elapsed_ns(&start) / (THREADS * THREAD_KEYS * 3));
+
+    ret |= check_iteration(table, THREADS * THREAD_KEYS);
+    drmHashDestroy(table);
+    return ret;
+}
+
 int main(void)
 {
     HashTablePtr  table;
@@ -213,5 +350,25 @@ int main(void)
     compute_dist(table);
     drmHashDestroy(table);
 
+    printf("\n***** 100000 consecutive integers, iterated ****\n");
+    table = drmHashCreate();
+    for (i = 0; i < 100000; i++)
+        drmHashInsert(table, i, (void *)(i << 16 | i));
+    for (i = 0; i < 100000; i++)
+        ret |= check_table(table, i, (void *)(i << 16 | i));
+    ret |= check_iteration(table, 100000);
+    for (i = 0; i < 100000; i += 2)
+        drmHashDelete(table, i);
+    ret |= check_iteration(table, 50000);
+    compute_dist(table);
+    drmHashDestroy(table);
+
+    printf("\n***** throughput ****\n");
+    ret |= bench("unlocked", 0, 1000, 1);
+    ret |= bench("unlocked", 0, 100000, 1);
+    ret |= bench("unlocked", 0, 100000, 4096);
+    ret |= bench("thread-safe", DRM_HASH_THREAD_SAFE, 100000, 1);
+    ret |= bench_threads();
+
     return ret;
 }
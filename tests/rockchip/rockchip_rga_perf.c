@@ -0,0 +1,188 @@
+/*
+ * Copyright (C) ROCKCHIP, Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#  include "config.h"
+#endif
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <getopt.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <xf86drm.h>
+
+#include "drm_fourcc.h"
+#include "rockchip_drm.h"
+#include "rockchip_drmif.h"
+#include "rockchip_rga.h"
+#include "rockchip_virtual.h"
+
+static unsigned long long timespec_us(const struct timespec *ts)
+{
+	return (unsigned long long)ts->tv_sec * 1000000 + ts->tv_nsec / 1000;
+}
+
+/*
+ * Queue 'batch' random fills per rga_exec() and report the average cost
+ * of a single fill.
+ */
+static int rga_perf_fill(struct rga_context *ctx, struct rga_image *img,
+			 unsigned int iterations, unsigned int batch)
+{
+	struct timespec start, end;
+	unsigned long long elapsed;
+	unsigned int i, j;
+	int ret;
+
+	srand(time(NULL));
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+
+	for (i = 0; i < iterations; i++) {
+		for (j = 0; j < batch; j++) {
+			unsigned int x = rand() % img->width;
+			unsigned int y = rand() % img->height;
+			unsigned int w = rand() % (img->width - x) + 1;
+			unsigned int h = rand() % (img->height - y) + 1;
+
+			img->fill_color = rand();
+			ret = rga_solid_fill(ctx, img, x, y, w, h);
+			if (ret)
+				return ret;
+		}
+
+		ret = rga_exec(ctx);
+		if (ret)
+			return ret;
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	elapsed = timespec_us(&end) - timespec_us(&start);
+
+	printf("fill: %u x %u ops in %llu us, %.2f us/op\n", iterations,
+	       batch, elapsed, (double)elapsed / (iterations * batch));
+
+	return 0;
+}
+
+static void usage(const char *name)
+{
+	fprintf(stderr, "usage: %s [-d device] [-i iterations] [-b batch] "
+		"[-w width] [-h height] [-l latency_us]\n\n", name);
+	fprintf(stderr, "without -d the virtual rockchip device is used\n");
+	exit(1);
+}
+
+int main(int argc, char *argv[])
+{
+	unsigned int width = 1024, height = 768, iterations = 1000, batch = 1;
+	struct rockchip_device *dev;
+	struct rockchip_bo *bo;
+	struct rga_context *ctx;
+	struct rga_image img;
+	const char *device = NULL;
+	int fd, prime_fd, c, ret = 1;
+
+	while ((c = getopt(argc, argv, "d:i:b:w:h:l:")) != -1) {
+		switch (c) {
+		case 'd':
+			device = optarg;
+			break;
+		case 'i':
+			iterations = atoi(optarg);
+			break;
+		case 'b':
+			batch = atoi(optarg);
+			break;
+		case 'w':
+			width = atoi(optarg);
+			break;
+		case 'h':
+			height = atoi(optarg);
+			break;
+		case 'l':
+			rockchip_virtual_set_latency(atoi(optarg));
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+
+	if (!iterations || !batch || batch > RGA_MAX_CMD_LIST_NR ||
+	    !width || !height)
+		usage(argv[0]);
+
+	fd = device ? open(device, O_RDWR) : rockchip_virtual_open();
+	if (fd < 0) {
+		fprintf(stderr, "failed to open device.\n");
+		return 1;
+	}
+
+	dev = rockchip_device_create(fd);
+	if (!dev)
+		goto out_close;
+
+	ctx = rga_init(fd);
+	if (!ctx)
+		goto out_device;
+
+	bo = rockchip_bo_create(dev, width * height * 4, 0);
+	if (!bo)
+		goto out_rga;
+
+	if (drmPrimeHandleToFD(fd, bo->handle, 0, &prime_fd))
+		goto out_bo;
+
+	memset(&img, 0, sizeof(img));
+	img.color_mode = DRM_FORMAT_XBGR8888;
+	img.width = width;
+	img.height = height;
+	img.stride = width * 4;
+	img.hstride = height;
+	img.buf_type = RGA_IMGBUF_GEM;
+	img.bo[0] = prime_fd;
+
+	ret = rga_perf_fill(ctx, &img, iterations, batch);
+
+	rockchip_device_dump_stats(dev);
+
+	close(prime_fd);
+out_bo:
+	rockchip_bo_destroy(bo);
+out_rga:
+	rga_fini(ctx);
+out_device:
+	rockchip_device_destroy(dev);
+out_close:
+	if (device)
+		close(fd);
+	else
+		rockchip_virtual_close(fd);
+
+	return ret ? 1 : 0;
+}
@@ -0,0 +1,385 @@
+/*
+ * Copyright (C) ROCKCHIP, Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#  include "config.h"
+#endif
+
+#undef NDEBUG
+#include <assert.h>
+
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "xf86drm.h"
+#include "drm_fourcc.h"
+#include "rockchip_drm.h"
+#include "rockchip_drmif.h"
+#include "rockchip_rga.h"
+#include "rockchip_virtual.h"
+
+struct test_buffer {
+	struct rockchip_bo	*bo;
+	struct rga_image	img;
+	uint32_t		*map;
+	int			prime_fd;
+};
+
+static void buffer_init(struct rockchip_device *dev, struct test_buffer *buf,
+			unsigned int width, unsigned int height)
+{
+	int ret;
+
+	memset(buf, 0, sizeof(*buf));
+
+	buf->bo = rockchip_bo_create(dev, width * height * 4, 0);
+	assert(buf->bo);
+	buf->map = rockchip_bo_map(buf->bo);
+	assert(buf->map);
+
+	ret = drmPrimeHandleToFD(dev->fd, buf->bo->handle, 0, &buf->prime_fd);
+	assert(ret == 0);
+
+	buf->img.color_mode = DRM_FORMAT_XBGR8888;
+	buf->img.width = width;
+	buf->img.height = height;
+	buf->img.stride = width * 4;
+	buf->img.hstride = height;
+	buf->img.buf_type = RGA_IMGBUF_GEM;
+	buf->img.bo[0] = buf->prime_fd;
+}
+
+static void buffer_fini(struct test_buffer *buf)
+{
+	close(buf->prime_fd);
+	rockchip_bo_destroy(buf->bo);
+}
+
+static uint32_t buffer_pixel(struct test_buffer *buf, unsigned int x,
+			     unsigned int y)
+{
+	return buf->map[y * buf->img.width + x] & 0xffffff;
+}
+
+static void test_bo(struct rockchip_device *dev)
+{
+	struct rockchip_device_stats stats;
+	struct rockchip_bo *bo;
+	uint32_t name, *map;
+
+	printf("testing bo ... ");
+
+	bo = rockchip_bo_create(dev, 4096, 0);
+	assert(bo);
+
+	map = rockchip_bo_map(bo);
+	assert(map);
+	map[0] = 0xdeadbeef;
+	assert(rockchip_bo_map(bo) == map);
+
+	assert(rockchip_bo_get_name(bo, &name) == 0);
+
+	rockchip_device_get_stats(dev, &stats);
+	assert(stats.bo_count == 1);
+	assert(stats.bo_bytes[0] == 4096);
+	assert(stats.mapped_bytes == 4096);
+
+	rockchip_bo_destroy(bo);
+
+	rockchip_device_get_stats(dev, &stats);
+	assert(stats.bo_count == 0);
+	assert(stats.mapped_bytes == 0);
+
+	printf("ok\n");
+}
+
+static void test_solid_fill(struct rockchip_device *dev,
+			    struct rga_context *ctx)
+{
+	struct test_buffer buf;
+
+	printf("testing solid fill ... ");
+
+	buffer_init(dev, &buf, 64, 64);
+
+	buf.img.fill_color = 0x00112233;
+	assert(rga_solid_fill(ctx, &buf.img, 8, 8, 16, 16) == 0);
+	assert(rga_exec(ctx) == 0);
+
+	assert(buffer_pixel(&buf, 7, 8) == 0);
+	assert(buffer_pixel(&buf, 8, 8) == 0x112233);
+	assert(buffer_pixel(&buf, 23, 23) == 0x112233);
+	assert(buffer_pixel(&buf, 24, 23) == 0);
+
+	buffer_fini(&buf);
+
+	printf("ok\n");
+}
+
+static void test_copy(struct rockchip_device *dev, struct rga_context *ctx)
+{
+	struct test_buffer src, dst;
+	unsigned int x, y;
+
+	printf("testing copy ... ");
+
+	buffer_init(dev, &src, 64, 64);
+	buffer_init(dev, &dst, 128, 128);
+
+	for (y = 0; y < 64; y++)
+		for (x = 0; x < 64; x++)
+			src.map[y * 64 + x] = y << 8 | x;
+
+	assert(rga_copy(ctx, &src.img, &dst.img, 0, 0, 32, 32, 64, 64) == 0);
+	assert(rga_exec(ctx) == 0);
+
+	for (y = 0; y < 64; y++)
+		for (x = 0; x < 64; x++)
+			assert(buffer_pixel(&dst, x + 32, y + 32) ==
+			       (y << 8 | x));
+	assert(buffer_pixel(&dst, 31, 32) == 0);
+
+	/* user pointers do not fit the 32-bit command words */
+	src.img.buf_type = RGA_IMGBUF_USERPTR;
+	assert(rga_copy(ctx, &src.img, &dst.img, 0, 0, 32, 32, 64, 64) ==
+	       -EINVAL);
+	assert(ctx->cmd_nr == 0 && ctx->cmd_buf_nr == 0);
+
+	buffer_fini(&src);
+	buffer_fini(&dst);
+
+	printf("ok\n");
+}
+
+static void test_scale(struct rockchip_device *dev, struct rga_context *ctx)
+{
+	struct test_buffer src, dst;
+	unsigned int x, y;
+
+	printf("testing scale ... ");
+
+	buffer_init(dev, &src, 64, 64);
+	buffer_init(dev, &dst, 128, 128);
+
+	for (y = 0; y < 64; y++)
+		for (x = 0; x < 64; x++)
+			src.map[y * 64 + x] = y << 8 | x;
+
+	assert(rga_copy_with_scale(ctx, &src.img, &dst.img, 0, 0, 64, 64,
+				   0, 0, 128, 128) == 0);
+	assert(rga_exec(ctx) == 0);
+
+	for (y = 0; y < 128; y++)
+		for (x = 0; x < 128; x++)
+			assert(buffer_pixel(&dst, x, y) ==
+			       ((y / 2) << 8 | x / 2));
+
+	buffer_fini(&src);
+	buffer_fini(&dst);
+
+	printf("ok\n");
+}
+
+static void test_dither(struct rockchip_device *dev, struct rga_context *ctx)
+{
+	struct test_buffer src, dst;
+	uint16_t *pixels;
+	unsigned int x, y;
+
+	printf("testing dither ... ");
+
+	buffer_init(dev, &src, 64, 64);
+	buffer_init(dev, &dst, 64, 64);
+
+	dst.img.color_mode = DRM_FORMAT_RGB565;
+	dst.img.stride = 64 * 2;
+	pixels = (uint16_t *)dst.map;
+
+	for (y = 0; y < 64; y++)
+		for (x = 0; x < 64; x++)
+			src.map[y * 64 + x] = 0x0f0f0f;
+
+	/* without dither the low bits are cut off: 1, 3, 1 */
+	assert(rga_copy(ctx, &src.img, &dst.img, 0, 0, 0, 0, 64, 64) == 0);
+	assert(rga_exec(ctx) == 0);
+
+	for (y = 0; y < 64; y++)
+		for (x = 0; x < 64; x++)
+			assert(pixels[y * 64 + x] == (1 << 11 | 3 << 5 | 1));
+
+	/* dither-down keeps the average closer to the source: 2, 4, 2 */
+	dst.img.dither = 1;
+	assert(rga_copy(ctx, &src.img, &dst.img, 0, 0, 0, 0, 64, 64) == 0);
+	assert(rga_exec(ctx) == 0);
+
+	for (y = 0; y < 64; y++)
+		for (x = 0; x < 64; x++)
+			assert(pixels[y * 64 + x] == (2 << 11 | 4 << 5 | 2));
+
+	buffer_fini(&src);
+	buffer_fini(&dst);
+
+	printf("ok\n");
+}
+
+static void test_fit(struct rockchip_device *dev, struct rga_context *ctx)
+{
+	struct test_buffer src, dst;
+	unsigned int x, y;
+
+	printf("testing fit ... ");
+
+	buffer_init(dev, &src, 128, 64);
+	buffer_init(dev, &dst, 128, 128);
+
+	for (y = 0; y < 64; y++)
+		for (x = 0; x < 128; x++)
+			src.map[y * 128 + x] = 0x00ff00;
+
+	/* letterbox: 128x64 content centered between two 128x32 bars */
+	dst.img.fill_color = 0x0000ff;
+	assert(rga_fit(ctx, &src.img, &dst.img, 0, 0, 128, 64, 0, 0, 128, 128,
+		       RGA_FIT_LETTERBOX) == 0);
+	assert(rga_exec(ctx) == 0);
+
+	for (x = 0; x < 128; x++) {
+		assert(buffer_pixel(&dst, x, 0) == 0x0000ff);
+		assert(buffer_pixel(&dst, x, 31) == 0x0000ff);
+		assert(buffer_pixel(&dst, x, 32) == 0x00ff00);
+		assert(buffer_pixel(&dst, x, 95) == 0x00ff00);
+		assert(buffer_pixel(&dst, x, 96) == 0x0000ff);
+		assert(buffer_pixel(&dst, x, 127) == 0x0000ff);
+	}
+
+	/* crop: the content covers the whole destination */
+	assert(rga_fit(ctx, &src.img, &dst.img, 0, 0, 128, 64, 0, 0, 128, 128,
+		       RGA_FIT_CROP) == 0);
+	assert(rga_exec(ctx) == 0);
+
+	for (y = 0; y < 128; y++)
+		assert(buffer_pixel(&dst, 0, y) == 0x00ff00);
+
+	/* no room for both bars and the copy: nothing may be queued */
+	for (x = 0; x < RGA_MAX_CMD_LIST_NR - 2; x++)
+		assert(rga_solid_fill(ctx, &dst.img, 0, 0, 1, 1) == 0);
+	assert(rga_fit(ctx, &src.img, &dst.img, 0, 0, 128, 64, 0, 0, 128, 128,
+		       RGA_FIT_LETTERBOX) == -EINVAL);
+	assert(ctx->cmdlist_nr == RGA_MAX_CMD_LIST_NR - 2);
+	assert(rga_exec(ctx) == 0);
+
+	buffer_fini(&src);
+	buffer_fini(&dst);
+
+	printf("ok\n");
+}
+
+static void test_slab(struct rockchip_device *dev)
+{
+	struct rockchip_device_stats stats;
+	struct rockchip_slab *slab;
+	struct rockchip_bo *bo[64], *page_bo[257];
+	uint32_t offset[64], page_offset[257];
+	unsigned int i, j;
+
+	printf("testing slab ... ");
+
+	slab = rockchip_slab_create(dev, 0);
+	assert(slab);
+
+	for (i = 0; i < 64; i++) {
+		bo[i] = rockchip_slab_alloc(slab, 1000, &offset[i]);
+		assert(bo[i]);
+		assert(offset[i] % 1024 == 0);
+
+		for (j = 0; j < i; j++)
+			assert(bo[i] != bo[j] || offset[i] != offset[j]);
+	}
+
+	rockchip_device_get_stats(dev, &stats);
+	assert(stats.bo_count == 1);
+	assert(stats.slab_misses == 1);
+	assert(stats.slab_hits == 63);
+
+	for (i = 0; i < 64; i++)
+		rockchip_slab_free(slab, bo[i], offset[i]);
+
+	/*
+	 * A double free is rejected: the page still holds exactly 256 chunks
+	 * and the next allocation comes from a new page.
+	 */
+	rockchip_slab_free(slab, bo[0], offset[0]);
+
+	for (i = 0; i < 257; i++) {
+		page_bo[i] = rockchip_slab_alloc(slab, 1000, &page_offset[i]);
+		assert(page_bo[i]);
+
+		rockchip_device_get_stats(dev, &stats);
+		assert(stats.bo_count == (i < 256 ? 1 : 2));
+	}
+
+	for (i = 0; i < 257; i++)
+		rockchip_slab_free(slab, page_bo[i], page_offset[i]);
+
+	rockchip_slab_destroy(slab);
+
+	rockchip_device_get_stats(dev, &stats);
+	assert(stats.bo_count == 0);
+
+	printf("ok\n");
+}
+
+int main(int argc, char *argv[])
+{
+	struct rockchip_device *dev;
+	struct rga_context *ctx;
+	int fd;
+
+	fd = rockchip_virtual_open();
+	if (fd < 0)
+		return 1;
+
+	dev = rockchip_device_create(fd);
+	if (!dev)
+		return 2;
+
+	ctx = rga_init(fd);
+	if (!ctx)
+		return 3;
+
+	test_bo(dev);
+	test_solid_fill(dev, ctx);
+	test_copy(dev, ctx);
+	test_scale(dev, ctx);
+	test_dither(dev, ctx);
+	test_fit(dev, ctx);
+	test_slab(dev);
+
+	rga_fini(ctx);
+	rockchip_device_destroy(dev);
+	rockchip_virtual_close(fd);
+
+	return 0;
+}
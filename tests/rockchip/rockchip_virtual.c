@@ -0,0 +1,612 @@
+/*
+ * Copyright (C) ROCKCHIP, Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#  include "config.h"
+#endif
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+
+#include <xf86drm.h>
+
+#include "rockchip_drm.h"
+#include "rockchip_rga.h"
+#include "rga_reg.h"
+#include "rockchip_virtual.h"
+
+#define VIRT_PAGE_SIZE		4096
+#define VIRT_MAX_PRIME_FDS	64
+#define VIRT_REG_NR		((MMU_ELS_BASE - MODE_CTRL) / 4 + 1)
+#define VIRT_CMD_NR		(RGA_MAX_CMD_NR + RGA_MAX_GEM_CMD_NR)
+
+#define VIRT_REG(offset)	(((offset) - MODE_CTRL) / 4)
+
+struct virt_bo {
+	uint32_t	handle;
+	uint64_t	offset;
+	uint64_t	size;
+	uint8_t		*vaddr;
+};
+
+struct virt_cmdlist {
+	struct drm_rockchip_rga_cmd	cmd[VIRT_CMD_NR];
+	unsigned int			nr;
+};
+
+struct virt_prime {
+	int		fd;
+	uint32_t	handle;
+};
+
+static struct {
+	int			fd;
+	unsigned int		latency;
+	uint64_t		size;
+	struct virt_bo		*bos;
+	unsigned int		nr_bos;
+	struct virt_prime	prime[VIRT_MAX_PRIME_FDS];
+	struct virt_cmdlist	cmdlist[RGA_MAX_CMD_LIST_NR];
+	unsigned int		nr_cmdlists;
+} virt = { .fd = -1 };
+
+/*
+ * Pixel layout of the RGA RGB formats, channel widths from the most to
+ * the least significant bits of the little endian pixel value, before the
+ * alpha and R/B swaps are applied.
+ */
+struct virt_format {
+	unsigned int	cpp;
+	unsigned int	bits[4];	/* R, G, B, A */
+};
+
+static int virt_get_format(unsigned int format, struct virt_format *fmt)
+{
+	static const struct virt_format formats[] = {
+		[RGA_SRC_COLOR_FMT_ABGR8888] = { 4, { 8, 8, 8, 8 } },
+		[RGA_SRC_COLOR_FMT_XBGR8888] = { 4, { 8, 8, 8, 0 } },
+		[RGA_SRC_COLOR_FMT_RGB888] = { 3, { 8, 8, 8, 0 } },
+		[RGA_SRC_COLOR_FMT_RGB565] = { 2, { 5, 6, 5, 0 } },
+		[RGA_SRC_COLOR_FMT_ARGB1555] = { 2, { 5, 5, 5, 1 } },
+		[RGA_SRC_COLOR_FMT_ARGB4444] = { 2, { 4, 4, 4, 4 } },
+	};
+
+	if (format >= sizeof(formats) / sizeof(formats[0]) ||
+	    !formats[format].cpp)
+		return -EINVAL;
+
+	*fmt = formats[format];
+
+	return 0;
+}
+
+/*
+ * Channel order from the least significant bits, as indices into
+ * struct virt_format bits and the rgba arrays below.
+ */
+static void virt_get_order(unsigned int swap, unsigned int order[4])
+{
+	unsigned int r = 0, b = 2;
+
+	if (swap & RGA_SRC_COLOR_RB_SWAP) {
+		r = 2;
+		b = 0;
+	}
+
+	if (swap & RGA_SRC_COLOR_ALPHA_SWAP) {
+		order[0] = b;
+		order[1] = 1;
+		order[2] = r;
+		order[3] = 3;
+	} else {
+		order[0] = 3;
+		order[1] = b;
+		order[2] = 1;
+		order[3] = r;
+	}
+}
+
+static void virt_read_pixel(const uint8_t *p, const struct virt_format *fmt,
+			    unsigned int swap, uint8_t rgba[4])
+{
+	unsigned int order[4], i, shift = 0;
+	uint32_t v = 0;
+
+	for (i = 0; i < fmt->cpp; i++)
+		v |= (uint32_t)p[i] << (8 * i);
+
+	virt_get_order(swap, order);
+
+	rgba[3] = 0xff;
+	for (i = 0; i < 4; i++) {
+		unsigned int c = order[i], bits = fmt->bits[c];
+		uint32_t mask = (1U << bits) - 1;
+
+		if (!bits)
+			continue;
+
+		rgba[c] = (((v >> shift) & mask) * 255 + mask / 2) / mask;
+		shift += bits;
+	}
+}
+
+static void virt_write_pixel(uint8_t *p, const struct virt_format *fmt,
+			     unsigned int swap, unsigned int dither,
+			     const uint8_t rgba[4])
+{
+	unsigned int order[4], i, shift = 0;
+	uint32_t v = 0;
+
+	virt_get_order(swap, order);
+
+	for (i = 0; i < 4; i++) {
+		unsigned int c = order[i], bits = fmt->bits[c];
+		uint32_t mask = (1U << bits) - 1, val;
+
+		if (!bits)
+			continue;
+
+		/* rounding stands in for the hardware dither-down */
+		if (dither)
+			val = (rgba[c] * mask + 127) / 255;
+		else
+			val = rgba[c] >> (8 - bits);
+
+		v |= val << shift;
+		shift += bits;
+	}
+
+	for (i = 0; i < fmt->cpp; i++)
+		p[i] = v >> (8 * i);
+}
+
+static struct virt_bo *virt_lookup_bo(uint32_t handle)
+{
+	unsigned int i;
+
+	if (!handle)
+		return NULL;
+
+	for (i = 0; i < virt.nr_bos; i++)
+		if (virt.bos[i].handle == handle)
+			return &virt.bos[i];
+
+	return NULL;
+}
+
+static struct virt_prime *virt_lookup_prime(int fd)
+{
+	unsigned int i;
+
+	for (i = 0; i < VIRT_MAX_PRIME_FDS; i++)
+		if (virt.prime[i].fd == fd)
+			return &virt.prime[i];
+
+	return NULL;
+}
+
+static uint8_t *virt_lookup_base(const struct drm_rockchip_rga_cmd *cmd)
+{
+	struct virt_prime *prime;
+	struct virt_bo *bo;
+
+	/* libdrm only submits dma-bufs */
+	if (!(cmd->offset & RGA_BUF_TYPE_GEMFD))
+		return NULL;
+
+	prime = virt_lookup_prime(cmd->data);
+	if (!prime)
+		return NULL;
+
+	bo = virt_lookup_bo(prime->handle);
+	if (!bo)
+		return NULL;
+
+	if (!bo->vaddr) {
+		bo->vaddr = mmap(NULL, bo->size, PROT_READ | PROT_WRITE,
+				 MAP_SHARED, virt.fd, bo->offset);
+		if (bo->vaddr == MAP_FAILED) {
+			bo->vaddr = NULL;
+			return NULL;
+		}
+	}
+
+	return bo->vaddr;
+}
+
+static int virt_rga_fill(const uint32_t *regs, uint8_t *dst)
+{
+	union rga_dst_info dst_info = { .val = regs[VIRT_REG(DST_INFO)] };
+	union rga_dst_vir_info vir = { .val = regs[VIRT_REG(DST_VIR_INFO)] };
+	union rga_dst_act_info act = { .val = regs[VIRT_REG(DST_ACT_INFO)] };
+	uint32_t color = regs[VIRT_REG(SRC_FG_COLOR)];
+	unsigned int x, y, i, stride = vir.data.vir_stride * 4;
+	struct virt_format fmt;
+
+	if (virt_get_format(dst_info.data.format, &fmt))
+		return -EINVAL;
+
+	dst += regs[VIRT_REG(DST_Y_RGB_BASE_ADDR)];
+
+	/* the fill color is written as is, in the destination layout */
+	for (y = 0; y <= act.data.act_height; y++) {
+		uint8_t *p = dst + y * stride;
+
+		for (x = 0; x <= act.data.act_width; x++)
+			for (i = 0; i < fmt.cpp; i++)
+				*p++ = color >> (8 * i);
+	}
+
+	return 0;
+}
+
+static int virt_rga_bitblt(const uint32_t *regs, const uint8_t *src,
+			   uint8_t *dst)
+{
+	union rga_src_info src_info = { .val = regs[VIRT_REG(SRC_INFO)] };
+	union rga_dst_info dst_info = { .val = regs[VIRT_REG(DST_INFO)] };
+	union rga_src_vir_info src_vir = { .val = regs[VIRT_REG(SRC_VIR_INFO)] };
+	union rga_src_act_info src_act = { .val = regs[VIRT_REG(SRC_ACT_INFO)] };
+	union rga_dst_vir_info dst_vir = { .val = regs[VIRT_REG(DST_VIR_INFO)] };
+	union rga_dst_act_info dst_act = { .val = regs[VIRT_REG(DST_ACT_INFO)] };
+	unsigned int src_stride = src_vir.data.vir_width * 4;
+	unsigned int dst_stride = dst_vir.data.vir_stride * 4;
+	unsigned int src_w = src_act.data.act_width + 1;
+	unsigned int src_h = src_act.data.act_height + 1;
+	unsigned int dst_w = dst_act.data.act_width + 1;
+	unsigned int dst_h = dst_act.data.act_height + 1;
+	struct virt_format src_fmt, dst_fmt;
+	unsigned int x, y;
+
+	if (virt_get_format(src_info.data.format, &src_fmt) ||
+	    virt_get_format(dst_info.data.format, &dst_fmt))
+		return -EINVAL;
+
+	if (src_info.data.rot_mode != RGA_SRC_ROT_MODE_0_DEGREE ||
+	    src_info.data.mir_mode != RGA_SRC_MIRR_MODE_NO)
+		return -EINVAL;
+
+	src += regs[VIRT_REG(SRC_Y_RGB_BASE_ADDR)];
+	dst += regs[VIRT_REG(DST_Y_RGB_BASE_ADDR)];
+
+	/* nearest neighbour sampling */
+	for (y = 0; y < dst_h; y++) {
+		const uint8_t *s = src + (uint64_t)y * src_h / dst_h * src_stride;
+		uint8_t *d = dst + y * dst_stride;
+
+		for (x = 0; x < dst_w; x++) {
+			uint8_t rgba[4];
+
+			virt_read_pixel(s + (uint64_t)x * src_w / dst_w *
+					src_fmt.cpp, &src_fmt,
+					src_info.data.swap, rgba);
+			virt_write_pixel(d + x * dst_fmt.cpp, &dst_fmt,
+					 dst_info.data.swap,
+					 dst_info.data.dither_down_en, rgba);
+		}
+	}
+
+	return 0;
+}
+
+static int virt_rga_run(const struct virt_cmdlist *list)
+{
+	uint32_t regs[VIRT_REG_NR] = { 0 };
+	union rga_mode_ctrl mode;
+	uint8_t *src = NULL, *dst = NULL;
+	unsigned int i;
+
+	for (i = 0; i < list->nr; i++) {
+		const struct drm_rockchip_rga_cmd *cmd = &list->cmd[i];
+		uint32_t offset = cmd->offset &
+			~(RGA_BUF_TYPE_USERPTR | RGA_BUF_TYPE_GEMFD);
+
+		if (offset < MODE_CTRL || offset > MMU_ELS_BASE)
+			return -EINVAL;
+
+		if (offset == cmd->offset) {
+			regs[VIRT_REG(offset)] = cmd->data;
+			continue;
+		}
+
+		if (offset == SRC_Y_RGB_BASE_ADDR)
+			src = virt_lookup_base(cmd);
+		else if (offset == DST_Y_RGB_BASE_ADDR)
+			dst = virt_lookup_base(cmd);
+		else
+			return -EINVAL;
+	}
+
+	if (!dst)
+		return -EINVAL;
+
+	mode.val = regs[VIRT_REG(MODE_CTRL)];
+
+	switch (mode.data.render) {
+	case RGA_MODE_RENDER_RECTANGLE_FILL:
+		return virt_rga_fill(regs, dst);
+	case RGA_MODE_RENDER_BITBLT:
+		if (!src)
+			return -EINVAL;
+		return virt_rga_bitblt(regs, src, dst);
+	case RGA_MODE_RENDER_COLOR_PALETTE:
+	case RGA_MODE_RENDER_UPDATE_PALETTE_LUT_RAM:
+	default:
+		return -EINVAL;
+	}
+}
+
+static int virt_gem_create(struct drm_rockchip_gem_create *req)
+{
+	struct virt_bo *bos, *bo;
+	uint64_t size;
+
+	size = (req->size + VIRT_PAGE_SIZE - 1) & ~(uint64_t)(VIRT_PAGE_SIZE - 1);
+	if (!size)
+		return -EINVAL;
+
+	bos = realloc(virt.bos, (virt.nr_bos + 1) * sizeof(*bos));
+	if (!bos)
+		return -ENOMEM;
+	virt.bos = bos;
+
+	if (ftruncate(virt.fd, virt.size + size))
+		return -errno;
+
+	bo = &virt.bos[virt.nr_bos++];
+	bo->handle = virt.nr_bos;
+	bo->offset = virt.size;
+	bo->size = size;
+	bo->vaddr = NULL;
+
+	virt.size += size;
+	req->handle = bo->handle;
+
+	return 0;
+}
+
+static int virt_gem_close(struct drm_gem_close *req)
+{
+	struct virt_bo *bo = virt_lookup_bo(req->handle);
+
+	if (!bo)
+		return -EINVAL;
+
+	if (bo->vaddr)
+		munmap(bo->vaddr, bo->size);
+
+	/* handles are never reused, just release the backing pages */
+	fallocate(virt.fd, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE,
+		  bo->offset, bo->size);
+	bo->handle = 0;
+	bo->vaddr = NULL;
+
+	return 0;
+}
+
+static int virt_prime_handle_to_fd(struct drm_prime_handle *req)
+{
+	struct virt_prime *prime;
+	int fd;
+
+	if (!virt_lookup_bo(req->handle))
+		return -ENOENT;
+
+	fd = dup(virt.fd);
+	if (fd < 0)
+		return -errno;
+
+	/* the fd number may be reused after the application closed it */
+	prime = virt_lookup_prime(fd);
+	if (!prime)
+		prime = virt_lookup_prime(-1);
+	if (!prime) {
+		close(fd);
+		return -EMFILE;
+	}
+
+	req->fd = fd;
+	prime->fd = fd;
+	prime->handle = req->handle;
+
+	return 0;
+}
+
+static int virt_rga_set_cmdlist(struct drm_rockchip_rga_set_cmdlist *req)
+{
+	struct virt_cmdlist *list;
+
+	if (virt.nr_cmdlists >= RGA_MAX_CMD_LIST_NR ||
+	    req->cmd_nr > RGA_MAX_CMD_NR || req->cmd_buf_nr > RGA_MAX_GEM_CMD_NR)
+		return -EINVAL;
+
+	list = &virt.cmdlist[virt.nr_cmdlists++];
+	memcpy(list->cmd, (void *)(uintptr_t)req->cmd,
+	       req->cmd_nr * sizeof(list->cmd[0]));
+	memcpy(list->cmd + req->cmd_nr, (void *)(uintptr_t)req->cmd_buf,
+	       req->cmd_buf_nr * sizeof(list->cmd[0]));
+	list->nr = req->cmd_nr + req->cmd_buf_nr;
+
+	return 0;
+}
+
+static int virt_rga_exec(void)
+{
+	unsigned int i;
+	int ret = 0;
+
+	for (i = 0; i < virt.nr_cmdlists && !ret; i++)
+		ret = virt_rga_run(&virt.cmdlist[i]);
+
+	virt.nr_cmdlists = 0;
+
+	if (virt.latency)
+		usleep(virt.latency);
+
+	return ret;
+}
+
+static int virt_ioctl(unsigned long request, void *arg)
+{
+	switch (request) {
+	case DRM_IOCTL_ROCKCHIP_GEM_CREATE:
+		return virt_gem_create(arg);
+	case DRM_IOCTL_ROCKCHIP_GEM_MAP_OFFSET: {
+		struct drm_rockchip_gem_map_off *req = arg;
+		struct virt_bo *bo = virt_lookup_bo(req->handle);
+
+		if (!bo)
+			return -EINVAL;
+
+		req->offset = bo->offset;
+		return 0;
+	}
+	case DRM_IOCTL_GEM_CLOSE:
+		return virt_gem_close(arg);
+	case DRM_IOCTL_GEM_FLINK: {
+		struct drm_gem_flink *req = arg;
+
+		if (!virt_lookup_bo(req->handle))
+			return -ENOENT;
+
+		req->name = req->handle;
+		return 0;
+	}
+	case DRM_IOCTL_GEM_OPEN: {
+		struct drm_gem_open *req = arg;
+		struct virt_bo *bo = virt_lookup_bo(req->name);
+
+		if (!bo)
+			return -ENOENT;
+
+		req->handle = bo->handle;
+		req->size = bo->size;
+		return 0;
+	}
+	case DRM_IOCTL_PRIME_HANDLE_TO_FD:
+		return virt_prime_handle_to_fd(arg);
+	case DRM_IOCTL_ROCKCHIP_RGA_GET_VER: {
+		struct drm_rockchip_rga_get_ver *req = arg;
+
+		req->major = 3;
+		req->minor = 2;
+		return 0;
+	}
+	case DRM_IOCTL_ROCKCHIP_RGA_SET_CMDLIST:
+		return virt_rga_set_cmdlist(arg);
+	case DRM_IOCTL_ROCKCHIP_RGA_EXEC:
+		return virt_rga_exec();
+	default:
+		return -ENOTTY;
+	}
+}
+
+/*
+ * Interposes the libdrm drmIoctl(), for libdrm_rockchip and libdrm itself.
+ */
+int drmIoctl(int fd, unsigned long request, void *arg)
+{
+	int ret;
+
+	if (fd >= 0 && fd == virt.fd) {
+		ret = virt_ioctl(request, arg);
+	} else if (fd >= 0 && virt_lookup_prime(fd)) {
+		/* dma-buf cpu access synchronization is a no-op */
+		ret = 0;
+	} else {
+		do {
+			ret = ioctl(fd, request, arg);
+		} while (ret == -1 && (errno == EINTR || errno == EAGAIN));
+		return ret;
+	}
+
+	if (ret < 0) {
+		errno = -ret;
+		return -1;
+	}
+
+	return 0;
+}
+
+/*
+ * Open the virtual rockchip drm device, only one can be open at a time.
+ *
+ * if true, return the device fd else negative.
+ */
+int rockchip_virtual_open(void)
+{
+	const char *env;
+	unsigned int i;
+
+	if (virt.fd >= 0)
+		return -EBUSY;
+
+	virt.fd = syscall(SYS_memfd_create, "rockchip-virtual", 0);
+	if (virt.fd < 0)
+		return -errno;
+
+	for (i = 0; i < VIRT_MAX_PRIME_FDS; i++)
+		virt.prime[i].fd = -1;
+
+	env = getenv("ROCKCHIP_VIRTUAL_LATENCY_US");
+	if (env)
+		virt.latency = atoi(env);
+
+	return virt.fd;
+}
+
+void rockchip_virtual_close(int fd)
+{
+	unsigned int i;
+
+	if (fd < 0 || fd != virt.fd)
+		return;
+
+	for (i = 0; i < virt.nr_bos; i++)
+		if (virt.bos[i].vaddr)
+			munmap(virt.bos[i].vaddr, virt.bos[i].size);
+
+	for (i = 0; i < VIRT_MAX_PRIME_FDS; i++)
+		if (virt.prime[i].fd >= 0)
+			close(virt.prime[i].fd);
+
+	free(virt.bos);
+	close(virt.fd);
+
+	memset(&virt, 0, sizeof(virt));
+	virt.fd = -1;
+}
+
+void rockchip_virtual_set_latency(unsigned int usec)
+{
+	virt.latency = usec;
+}
@@ -0,0 +1,45 @@
+/*
+ * Copyright (C) ROCKCHIP, Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+
+#ifndef ROCKCHIP_VIRTUAL_H_
+#define ROCKCHIP_VIRTUAL_H_
+
+/*
+ * Software stand-in for the rockchip drm driver.
+ *
+ * Programs linking rockchip_virtual.c get a drmIoctl() that services the
+ * rockchip GEM and RGA ioctls issued on the fd returned by
+ * rockchip_virtual_open(), and passes everything else to the kernel.
+ * GEM objects live in a memfd, so rockchip_bo_map() works unchanged, and
+ * RGA command lists are executed on the cpu. Only RGB formats without
+ * rotation or mirroring are rendered, other operations fail with EINVAL.
+ *
+ * The ROCKCHIP_VIRTUAL_LATENCY_US environment variable sets the simulated
+ * latency of every RGA execution.
+ */
+int rockchip_virtual_open(void);
+void rockchip_virtual_close(int fd);
+void rockchip_virtual_set_latency(unsigned int usec);
+
+#endif /* ROCKCHIP_VIRTUAL_H_ */
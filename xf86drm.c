@@ -61,6 +61,11 @@
 #include <sys/sysmacros.h>
 #endif
 #include <math.h>
+#include <pthread.h>
+#ifdef __linux__
+#include <sys/inotify.h>
+#include <sys/eventfd.h>
+#endif
 
 /* Not all systems have MAP_FAILED defined */
 #ifndef MAP_FAILED
@@ -179,6 +184,158 @@ void drmFree(void *pt)
     free(pt);
 }
 
+/*
+ * Ioctl statistics.
+ *
+ * Accounting is off unless the LIBDRM_IOCTL_STATS environment variable is
+ * set, in which case the statistics are also printed at exit, or it was
+ * enabled with drmIoctlStatsEnable(). While it is off drmIoctl() only tests
+ * a flag. Requests are accounted by ioctl number: the DRM numbers are
+ * unique, the encoded argument size may differ between versions. The
+ * counters are unsigned long so that they can be updated atomically on
+ * 32-bit targets too, and wrap around there in long running processes.
+ */
+static int drm_ioctl_stats_enabled;
+static int drm_ioctl_stats_at_exit;
+static drmIoctlStats drm_ioctl_stats[DRM_IOCTL_STATS_MAX];
+
+static uint64_t drmIoctlStatsTime(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static int drmIoctlTraced(int fd, unsigned long request, void *arg)
+{
+    drmIoctlStatsPtr stats;
+    uint64_t start, ns;
+    unsigned long max, us;
+    int ret, bucket = 0;
+
+    stats = &drm_ioctl_stats[request & (DRM_IOCTL_STATS_MAX - 1)];
+    start = drmIoctlStatsTime();
+    for (;;) {
+        ret = ioctl(fd, request, arg);
+        if (ret != -1)
+            break;
+        if (errno == EINTR)
+            __sync_fetch_and_add(&stats->eintr, 1);
+        else if (errno == EAGAIN)
+            __sync_fetch_and_add(&stats->eagain, 1);
+        else
+            break;
+    }
+    ns = drmIoctlStatsTime() - start;
+    us = (ns + 999) / 1000;
+
+    for (ns /= 1000; ns && bucket < DRM_IOCTL_STATS_BUCKETS - 1; ns >>= 1)
+        bucket++;
+
+    stats->request = request;
+    __sync_fetch_and_add(&stats->calls, 1);
+    if (ret)
+        __sync_fetch_and_add(&stats->errors, 1);
+    __sync_fetch_and_add(&stats->total_us, us);
+    __sync_fetch_and_add(&stats->histogram[bucket], 1);
+    for (max = stats->max_us; us > max;
+         max = __sync_val_compare_and_swap(&stats->max_us, max, us))
+        ;
+
+    return ret;
+}
+
+/**
+ * Enable or disable ioctl accounting
+ *
+ * \param enable non-zero to account every following drmIoctl() call
+ *
+ * \return the previous state.
+ */
+int drmIoctlStatsEnable(int enable)
+{
+    return __sync_lock_test_and_set(&drm_ioctl_stats_enabled, !!enable);
+}
+
+/**
+ * Get the statistics of an ioctl
+ *
+ * \param nr ioctl number, the low 8 bits of the request code
+ * \param stats where the statistics are copied
+ *
+ * \return zero on success, negative error code otherwise.
+ */
+int drmIoctlStatsGet(unsigned int nr, drmIoctlStatsPtr stats)
+{
+    if (nr >= DRM_IOCTL_STATS_MAX || stats == NULL)
+        return -EINVAL;
+
+    *stats = drm_ioctl_stats[nr];
+    return 0;
+}
+
+/**
+ * Clear the statistics of all ioctls
+ */
+void drmIoctlStatsReset(void)
+{
+    memset(drm_ioctl_stats, 0, sizeof(drm_ioctl_stats));
+}
+
+/**
+ * Print the statistics of all ioctls issued so far to stderr
+ */
+void drmIoctlStatsDump(void)
+{
+    unsigned int nr, i;
+
+    fprintf(stderr, "libdrm ioctl stats (pid %d):\n", (int)getpid());
+
+    for (nr = 0; nr < DRM_IOCTL_STATS_MAX; nr++) {
+        drmIoctlStats stats = drm_ioctl_stats[nr];
+
+        if (!stats.calls)
+            continue;
+
+        fprintf(stderr, "  %s 0x%02x (0x%08lx): %lu calls, %lu errors, "
+                "%lu EINTR, %lu EAGAIN, avg %lu us, max %lu us\n",
+                nr >= DRM_COMMAND_BASE ? "driver" : "core", nr,
+                stats.request, stats.calls, stats.errors, stats.eintr,
+                stats.eagain, stats.total_us / stats.calls, stats.max_us);
+
+        fprintf(stderr, "    us:");
+        for (i = 0; i < DRM_IOCTL_STATS_BUCKETS; i++) {
+            if (!stats.histogram[i])
+                continue;
+            if (i == 0)
+                fprintf(stderr, " <1: %lu", stats.histogram[i]);
+            else if (i == DRM_IOCTL_STATS_BUCKETS - 1)
+                fprintf(stderr, " >=%u: %lu", 1u << (i - 1),
+                        stats.histogram[i]);
+            else
+                fprintf(stderr, " <%u: %lu", 1u << i, stats.histogram[i]);
+        }
+        fprintf(stderr, "\n");
+    }
+}
+
+static void __attribute__((constructor)) drmIoctlStatsInit(void)
+{
+    const char *env = getenv("LIBDRM_IOCTL_STATS");
+
+    if (env && atoi(env)) {
+        drm_ioctl_stats_enabled = 1;
+        drm_ioctl_stats_at_exit = 1;
+    }
+}
+
+static void __attribute__((destructor)) drmIoctlStatsFini(void)
+{
+    if (drm_ioctl_stats_at_exit)
+        drmIoctlStatsDump();
+}
+
 /**
  * Call ioctl, restarting if it is interupted
  */
@@ -187,6 +344,9 @@ drmIoctl(int fd, unsigned long request, void *arg)
 {
     int ret;
 
+    if (drm_ioctl_stats_enabled)
+        return drmIoctlTraced(fd, request, arg);
+
     do {
         ret = ioctl(fd, request, arg);
     } while (ret == -1 && (errno == EINTR || errno == EAGAIN));
@@ -2135,6 +2295,75 @@ out:
     return ret;
 }
 
+/**
+ * Get the current sequence number and the time of the most recent vblank
+ * of a crtc.
+ *
+ * \param fd file descriptor.
+ * \param crtcId crtc to query.
+ * \param sequence returns the most recent vblank sequence, may be NULL.
+ * \param ns returns the CLOCK_MONOTONIC time of that vblank, may be NULL.
+ *
+ * \return zero on success, or a negative value on failure.
+ *
+ * \internal
+ * This function is a wrapper around the DRM_IOCTL_CRTC_GET_SEQUENCE ioctl.
+ */
+int drmCrtcGetSequence(int fd, uint32_t crtcId, uint64_t *sequence,
+                       uint64_t *ns)
+{
+    struct drm_crtc_get_sequence get_seq;
+    int ret;
+
+    memclear(get_seq);
+    get_seq.crtc_id = crtcId;
+    ret = drmIoctl(fd, DRM_IOCTL_CRTC_GET_SEQUENCE, &get_seq);
+    if (ret)
+        return ret;
+
+    if (sequence)
+        *sequence = get_seq.sequence;
+    if (ns)
+        *ns = get_seq.sequence_ns;
+    return 0;
+}
+
+/**
+ * Queue a DRM_EVENT_CRTC_SEQUENCE event for a vblank of a crtc.
+ *
+ * \param fd file descriptor.
+ * \param crtcId crtc to queue the event on.
+ * \param flags DRM_CRTC_SEQUENCE_* flags.
+ * \param sequence target sequence, absolute or relative to the current one.
+ * \param sequence_queued returns the sequence the event was queued for, may
+ * be NULL.
+ * \param user_data passed back with the event.
+ *
+ * \return zero on success, or a negative value on failure.
+ *
+ * \internal
+ * This function is a wrapper around the DRM_IOCTL_CRTC_QUEUE_SEQUENCE ioctl.
+ */
+int drmCrtcQueueSequence(int fd, uint32_t crtcId, uint32_t flags,
+                         uint64_t sequence, uint64_t *sequence_queued,
+                         uint64_t user_data)
+{
+    struct drm_crtc_queue_sequence queue_seq;
+    int ret;
+
+    memclear(queue_seq);
+    queue_seq.crtc_id = crtcId;
+    queue_seq.flags = flags;
+    queue_seq.sequence = sequence;
+    queue_seq.user_data = user_data;
+
+    ret = drmIoctl(fd, DRM_IOCTL_CRTC_QUEUE_SEQUENCE, &queue_seq);
+    if (ret == 0 && sequence_queued)
+        *sequence_queued = queue_seq.sequence;
+
+    return ret;
+}
+
 int drmError(int err, const char *label)
 {
     switch (err) {
@@ -2777,6 +3006,406 @@ int drmPrimeFDToHandle(int fd, int prime_fd, uint32_t *handle)
     return 0;
 }
 
+/*
+ * PRIME handle cache.
+ *
+ * Importing a dma-buf into a device that already has a handle for it
+ * returns that handle, so the cache is keyed by the identity of the
+ * dma-buf, its inode. A hit costs an fstat() and a hash lookup. Handles
+ * obtained by an import are reference counted and closed with the last
+ * drmPrimeCacheRelease(). Handles the caller created and exported are
+ * registered so that importing the exported buffer again finds them, but
+ * they stay owned by the caller, who must drmPrimeCacheForget() them
+ * before closing them.
+ *
+ * Before Linux 5.3 every dma-buf shares the single anonymous inode, so
+ * the inode does not identify the buffer there. Such dma-bufs are always
+ * imported with an ioctl and only their handles are tracked, which keeps
+ * the reference counting right but saves nothing.
+ */
+typedef struct _drmPrimeCacheEntry drmPrimeCacheEntry, *drmPrimeCacheEntryPtr;
+
+struct _drmPrimeCacheEntry {
+    drmPrimeCacheEntryPtr next;     /* inode hash collisions */
+    dev_t dev;
+    ino_t ino;                      /* 0 if not in the inode hash */
+    uint32_t handle;
+    uint32_t refcount;              /* imports not released yet */
+    bool owned;                     /* handle created by an import */
+};
+
+struct _drmPrimeCache {
+    int fd;
+    pthread_mutex_t lock;
+    void *inodes;                   /* inode key -> entry chain */
+    void *handles;                  /* handle -> entry */
+    bool anon_known;                /* anon_dev and anon_ino are valid */
+    dev_t anon_dev;                 /* the shared anonymous inode */
+    ino_t anon_ino;
+};
+
+static unsigned long drmPrimeCacheKey(ino_t ino)
+{
+    return (unsigned long)(ino ^ ((uint64_t)ino >> 32));
+}
+
+static void drmPrimeCacheUnlink(drmPrimeCachePtr cache,
+                                drmPrimeCacheEntryPtr entry)
+{
+    unsigned long key = drmPrimeCacheKey(entry->ino);
+    drmPrimeCacheEntryPtr *link;
+    void *value;
+
+    if (entry->ino == 0 || drmHashLookup(cache->inodes, key, &value))
+        return;
+
+    if (value == entry) {
+        drmHashDelete(cache->inodes, key);
+        if (entry->next)
+            drmHashInsert(cache->inodes, key, entry->next);
+        return;
+    }
+
+    for (link = &((drmPrimeCacheEntryPtr)value)->next; *link;
+         link = &(*link)->next) {
+        if (*link == entry) {
+            *link = entry->next;
+            return;
+        }
+    }
+}
+
+static void drmPrimeCacheLink(drmPrimeCachePtr cache,
+                              drmPrimeCacheEntryPtr entry)
+{
+    unsigned long key = drmPrimeCacheKey(entry->ino);
+    void *value;
+
+    entry->next = NULL;
+    if (drmHashLookup(cache->inodes, key, &value)) {
+        drmHashInsert(cache->inodes, key, entry);
+    } else {
+        entry->next = ((drmPrimeCacheEntryPtr)value)->next;
+        ((drmPrimeCacheEntryPtr)value)->next = entry;
+    }
+}
+
+/* Returns true if the inode behind sbuf identifies a single dma-buf. */
+static bool drmPrimeCacheUnique(drmPrimeCachePtr cache,
+                                const struct stat *sbuf)
+{
+    return cache->anon_known && sbuf->st_ino != 0 &&
+           (sbuf->st_ino != cache->anon_ino || sbuf->st_dev != cache->anon_dev);
+}
+
+static drmPrimeCacheEntryPtr drmPrimeCacheFind(drmPrimeCachePtr cache,
+                                               const struct stat *sbuf)
+{
+    drmPrimeCacheEntryPtr entry;
+    void *value;
+
+    if (drmHashLookup(cache->inodes, drmPrimeCacheKey(sbuf->st_ino), &value))
+        return NULL;
+
+    for (entry = value; entry; entry = entry->next)
+        if (entry->ino == sbuf->st_ino && entry->dev == sbuf->st_dev)
+            return entry;
+
+    return NULL;
+}
+
+/*
+ * Record that handle is backed by the dma-buf behind sbuf, creating the
+ * entry of the handle if needed. Without sbuf only the handle is tracked.
+ */
+static drmPrimeCacheEntryPtr drmPrimeCacheSet(drmPrimeCachePtr cache,
+                                              uint32_t handle,
+                                              const struct stat *sbuf,
+                                              bool owned)
+{
+    drmPrimeCacheEntryPtr entry;
+    void *value;
+
+    if (!drmHashLookup(cache->handles, handle, &value)) {
+        /* the previous dma-buf of the handle was released */
+        entry = value;
+        drmPrimeCacheUnlink(cache, entry);
+    } else {
+        entry = drmMalloc(sizeof(*entry));
+        if (!entry)
+            return NULL;
+        entry->handle = handle;
+        entry->owned = owned;
+        drmHashInsert(cache->handles, handle, entry);
+    }
+
+    entry->dev = sbuf ? sbuf->st_dev : 0;
+    entry->ino = sbuf ? sbuf->st_ino : 0;
+    if (sbuf)
+        drmPrimeCacheLink(cache, entry);
+
+    return entry;
+}
+
+static void drmPrimeCacheRemove(drmPrimeCachePtr cache,
+                                drmPrimeCacheEntryPtr entry)
+{
+    drmPrimeCacheUnlink(cache, entry);
+    drmHashDelete(cache->handles, entry->handle);
+    drmFree(entry);
+}
+
+static void drmPrimeCacheCloseHandle(int fd, uint32_t handle)
+{
+    struct drm_gem_close args;
+
+    memclear(args);
+    args.handle = handle;
+    drmIoctl(fd, DRM_IOCTL_GEM_CLOSE, &args);
+}
+
+/**
+ * Create a PRIME handle cache for a device
+ *
+ * \param fd file descriptor of the drm device
+ *
+ * \return the cache, or NULL on allocation failure.
+ */
+drmPrimeCachePtr drmPrimeCacheCreate(int fd)
+{
+    drmPrimeCachePtr cache;
+
+    cache = drmMalloc(sizeof(*cache));
+    if (cache == NULL)
+        return NULL;
+
+    cache->fd = fd;
+    cache->inodes = drmHashCreate();
+    cache->handles = drmHashCreate();
+    if (cache->inodes == NULL || cache->handles == NULL) {
+        if (cache->inodes)
+            drmHashDestroy(cache->inodes);
+        if (cache->handles)
+            drmHashDestroy(cache->handles);
+        drmFree(cache);
+        return NULL;
+    }
+
+    /*
+     * dma-bufs have their own inodes since Linux 5.3. Before that they
+     * are anonymous inode files like an eventfd, find out which inode
+     * that is. If we cannot tell, treat every inode as shared.
+     */
+    cache->anon_known = false;
+#ifdef __linux__
+    {
+        struct stat sbuf;
+        int efd = eventfd(0, EFD_CLOEXEC);
+
+        if (efd >= 0) {
+            if (!fstat(efd, &sbuf)) {
+                cache->anon_known = true;
+                cache->anon_dev = sbuf.st_dev;
+                cache->anon_ino = sbuf.st_ino;
+            }
+            close(efd);
+        }
+    }
+#else
+    cache->anon_known = true;
+    cache->anon_dev = 0;
+    cache->anon_ino = 0;
+#endif
+
+    pthread_mutex_init(&cache->lock, NULL);
+
+    return cache;
+}
+
+/**
+ * Destroy a PRIME handle cache, closing the handles it imported
+ */
+void drmPrimeCacheDestroy(drmPrimeCachePtr cache)
+{
+    unsigned long key;
+    void *value;
+
+    if (cache == NULL)
+        return;
+
+    while (drmHashFirst(cache->handles, &key, &value) == 1) {
+        drmPrimeCacheEntryPtr entry = value;
+
+        if (entry->owned)
+            drmPrimeCacheCloseHandle(cache->fd, entry->handle);
+        drmPrimeCacheRemove(cache, entry);
+    }
+
+    drmHashDestroy(cache->inodes);
+    drmHashDestroy(cache->handles);
+    pthread_mutex_destroy(&cache->lock);
+    drmFree(cache);
+}
+
+/**
+ * Import a dma-buf, reusing the handle of an earlier import or export
+ *
+ * \param cache PRIME handle cache of the device
+ * \param prime_fd dma-buf file descriptor
+ * \param handle where the GEM handle is stored
+ *
+ * \return zero on success, negative error code otherwise.
+ *
+ * \note Every successful import takes a reference, to be dropped with
+ * drmPrimeCacheRelease().
+ */
+int drmPrimeCacheImport(drmPrimeCachePtr cache, int prime_fd,
+                        uint32_t *handle)
+{
+    drmPrimeCacheEntryPtr entry;
+    struct stat sbuf;
+    uint32_t new_handle;
+    bool unique;
+    int ret = 0;
+
+    if (cache == NULL || handle == NULL)
+        return -EINVAL;
+
+    if (fstat(prime_fd, &sbuf))
+        return -errno;
+
+    pthread_mutex_lock(&cache->lock);
+
+    unique = drmPrimeCacheUnique(cache, &sbuf);
+    entry = unique ? drmPrimeCacheFind(cache, &sbuf) : NULL;
+    if (entry == NULL) {
+        void *value;
+
+        if (drmPrimeFDToHandle(cache->fd, prime_fd, &new_handle)) {
+            ret = -errno;
+            goto out;
+        }
+
+        /* the kernel returns the handle it already has for the buffer */
+        if (!unique && !drmHashLookup(cache->handles, new_handle, &value))
+            entry = value;
+        else
+            entry = drmPrimeCacheSet(cache, new_handle,
+                                     unique ? &sbuf : NULL, true);
+        if (entry == NULL) {
+            drmPrimeCacheCloseHandle(cache->fd, new_handle);
+            ret = -ENOMEM;
+            goto out;
+        }
+    }
+
+    entry->refcount++;
+    *handle = entry->handle;
+
+out:
+    pthread_mutex_unlock(&cache->lock);
+    return ret;
+}
+
+/**
+ * Export a handle, recording the dma-buf so that importing it is a hit
+ *
+ * \param cache PRIME handle cache of the device
+ * \param handle GEM handle to export
+ * \param flags DRM_CLOEXEC and DRM_RDWR, as for drmPrimeHandleToFD()
+ * \param prime_fd where the dma-buf file descriptor is stored
+ *
+ * \return zero on success, negative error code otherwise.
+ *
+ * \note Exporting takes no reference. A handle that was not obtained from
+ * drmPrimeCacheImport() remains owned by the caller.
+ */
+int drmPrimeCacheExport(drmPrimeCachePtr cache, uint32_t handle,
+                        uint32_t flags, int *prime_fd)
+{
+    struct stat sbuf;
+    int ret = 0;
+
+    if (cache == NULL || prime_fd == NULL)
+        return -EINVAL;
+
+    pthread_mutex_lock(&cache->lock);
+
+    if (drmPrimeHandleToFD(cache->fd, handle, flags, prime_fd)) {
+        ret = -errno;
+        goto out;
+    }
+
+    /* failing to record the buffer only costs a later ioctl */
+    if (!fstat(*prime_fd, &sbuf))
+        drmPrimeCacheSet(cache, handle,
+                         drmPrimeCacheUnique(cache, &sbuf) ? &sbuf : NULL,
+                         false);
+
+out:
+    pthread_mutex_unlock(&cache->lock);
+    return ret;
+}
+
+/**
+ * Drop a reference taken by drmPrimeCacheImport()
+ *
+ * \return zero on success, negative error code otherwise.
+ *
+ * \note The handle is closed with its last reference, unless the caller
+ * owns it.
+ */
+int drmPrimeCacheRelease(drmPrimeCachePtr cache, uint32_t handle)
+{
+    drmPrimeCacheEntryPtr entry;
+    void *value;
+    int ret = 0;
+
+    if (cache == NULL)
+        return -EINVAL;
+
+    pthread_mutex_lock(&cache->lock);
+
+    if (drmHashLookup(cache->handles, handle, &value)) {
+        ret = -ENOENT;
+        goto out;
+    }
+
+    entry = value;
+    if (entry->refcount == 0) {
+        ret = -EINVAL;
+        goto out;
+    }
+
+    if (--entry->refcount == 0 && entry->owned) {
+        drmPrimeCacheCloseHandle(cache->fd, entry->handle);
+        drmPrimeCacheRemove(cache, entry);
+    }
+
+out:
+    pthread_mutex_unlock(&cache->lock);
+    return ret;
+}
+
+/**
+ * Remove a handle from the cache without closing it
+ *
+ * Callers must forget the handles they own before closing them, as the
+ * kernel may hand out the same handle value for another buffer later.
+ */
+void drmPrimeCacheForget(drmPrimeCachePtr cache, uint32_t handle)
+{
+    void *value;
+
+    if (cache == NULL)
+        return;
+
+    pthread_mutex_lock(&cache->lock);
+    if (!drmHashLookup(cache->handles, handle, &value))
+        drmPrimeCacheRemove(cache, value);
+    pthread_mutex_unlock(&cache->lock);
+}
+
 static char *drmGetMinorNameForFD(int fd, int type)
 {
 #ifdef __linux__
@@ -4069,6 +4698,264 @@ int drmGetDevices(drmDevicePtr devices[], int max_devices)
     return drmGetDevices2(DRM_DEVICE_GET_PCI_REVISION, devices, max_devices);
 }
 
+/*
+ * Device registry.
+ *
+ * The lists returned by drmGetDeviceList() are built once per set of flags
+ * and shared by all callers until the contents of DRM_DIR_NAME change,
+ * which is noticed with inotify where available and by the directory
+ * modification time otherwise. A list stays valid for its holders after it
+ * was replaced; it is freed when the last reference is dropped.
+ */
+typedef struct _drmDeviceListPriv {
+    drmDeviceList base;
+    int refcount;
+    dev_t *rdevs;       /* count * DRM_NODE_MAX, 0 for missing nodes */
+} drmDeviceListPriv, *drmDeviceListPrivPtr;
+
+static struct {
+    pthread_mutex_t lock;
+    bool initialized;
+    int inotify_fd;
+    struct timespec mtime;
+    drmDeviceListPrivPtr lists[DRM_DEVICE_GET_PCI_REVISION + 1];
+} drm_device_registry = {
+    .lock = PTHREAD_MUTEX_INITIALIZER,
+};
+
+static void drmDeviceListUnref(drmDeviceListPrivPtr list)
+{
+    if (--list->refcount)
+        return;
+
+    drmFreeDevices(list->base.devices, list->base.count);
+    free(list->base.devices);
+    free(list->rdevs);
+    free(list);
+}
+
+/* Returns an inotify fd watching DRM_DIR_NAME, or -1. */
+static int drmDeviceRegistryWatch(void)
+{
+    int fd = -1;
+
+#ifdef __linux__
+    fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (fd >= 0 &&
+        inotify_add_watch(fd, DRM_DIR_NAME,
+                          IN_CREATE | IN_DELETE | IN_MOVED_FROM |
+                          IN_MOVED_TO | IN_ATTRIB | IN_DELETE_SELF) < 0) {
+        close(fd);
+        fd = -1;
+    }
+#endif
+
+    return fd;
+}
+
+/* Returns true if DRM_DIR_NAME may have changed since the last call. */
+static bool drmDeviceRegistryChanged(void)
+{
+    bool changed = false;
+    struct stat sbuf;
+
+    if (!drm_device_registry.initialized) {
+        drm_device_registry.initialized = true;
+        drm_device_registry.inotify_fd = drmDeviceRegistryWatch();
+        changed = true;
+    }
+
+#ifdef __linux__
+    if (drm_device_registry.inotify_fd >= 0) {
+        char buf[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+        const struct inotify_event *event;
+        bool rewatch = false;
+        ssize_t len;
+        char *ptr;
+
+        while ((len = read(drm_device_registry.inotify_fd, buf, sizeof(buf))) > 0) {
+            changed = true;
+            for (ptr = buf; ptr < buf + len;
+                 ptr += sizeof(*event) + event->len) {
+                event = (const struct inotify_event *)ptr;
+                if (event->mask & (IN_IGNORED | IN_DELETE_SELF))
+                    rewatch = true;
+            }
+        }
+
+        if (!rewatch)
+            return changed;
+
+        /*
+         * The directory was removed and the kernel dropped the watch, so it
+         * will never fire again. Watch the new directory if there is one
+         * and fall back to the modification time otherwise.
+         */
+        close(drm_device_registry.inotify_fd);
+        drm_device_registry.inotify_fd = drmDeviceRegistryWatch();
+        if (drm_device_registry.inotify_fd >= 0)
+            return true;
+        changed = true;
+    }
+#endif
+
+    if (stat(DRM_DIR_NAME, &sbuf))
+        return true;
+
+    if (sbuf.st_mtim.tv_sec != drm_device_registry.mtime.tv_sec ||
+        sbuf.st_mtim.tv_nsec != drm_device_registry.mtime.tv_nsec) {
+        drm_device_registry.mtime = sbuf.st_mtim;
+        changed = true;
+    }
+
+    return changed;
+}
+
+static int drmDeviceListCreate(uint32_t flags, drmDeviceListPrivPtr *listp)
+{
+    drmDeviceListPrivPtr list;
+    struct stat sbuf;
+    int count, i, j;
+
+    count = drmGetDevices2(flags, NULL, 0);
+    if (count < 0)
+        return count;
+
+    list = calloc(1, sizeof(*list));
+    if (!list)
+        return -ENOMEM;
+
+    list->refcount = 1;
+    list->base.devices = calloc(count ? count : 1, sizeof(drmDevicePtr));
+    if (!list->base.devices) {
+        free(list);
+        return -ENOMEM;
+    }
+
+    count = drmGetDevices2(flags, list->base.devices, count);
+    if (count < 0) {
+        free(list->base.devices);
+        free(list);
+        return count;
+    }
+
+    /* a device may have shown up between the two scans */
+    for (i = 0; i < count && list->base.devices[i]; i++)
+        ;
+    list->base.count = i;
+
+    list->rdevs = calloc(list->base.count * DRM_NODE_MAX + 1, sizeof(dev_t));
+    if (!list->rdevs) {
+        drmDeviceListUnref(list);
+        return -ENOMEM;
+    }
+
+    for (i = 0; i < list->base.count; i++) {
+        drmDevicePtr device = list->base.devices[i];
+
+        for (j = 0; j < DRM_NODE_MAX; j++) {
+            if (!(device->available_nodes & (1 << j)))
+                continue;
+
+            if (!stat(device->nodes[j], &sbuf) && S_ISCHR(sbuf.st_mode))
+                list->rdevs[i * DRM_NODE_MAX + j] = sbuf.st_rdev;
+        }
+    }
+
+    *listp = list;
+
+    return 0;
+}
+
+/**
+ * Get the shared list of drm devices on the system
+ *
+ * \param flags feature/behaviour bitmask, as for drmGetDevices2()
+ * \param list where a reference to the list is stored
+ *
+ * \return zero on success, negative error code otherwise.
+ *
+ * \note The list and its devices are shared and must not be modified. Drop
+ * the reference with drmFreeDeviceList(), not with drmFreeDevices(). The
+ * system is only rescanned when the device directory changed.
+ */
+int drmGetDeviceList(uint32_t flags, drmDeviceListPtr *list)
+{
+    drmDeviceListPrivPtr priv;
+    unsigned int i;
+    int ret = 0;
+
+    if (drm_device_validate_flags(flags) || list == NULL)
+        return -EINVAL;
+
+    pthread_mutex_lock(&drm_device_registry.lock);
+
+    if (drmDeviceRegistryChanged()) {
+        for (i = 0; i <= DRM_DEVICE_GET_PCI_REVISION; i++) {
+            if (drm_device_registry.lists[i]) {
+                drmDeviceListUnref(drm_device_registry.lists[i]);
+                drm_device_registry.lists[i] = NULL;
+            }
+        }
+    }
+
+    priv = drm_device_registry.lists[flags];
+    if (!priv) {
+        ret = drmDeviceListCreate(flags, &priv);
+        if (!ret)
+            drm_device_registry.lists[flags] = priv;
+    }
+
+    if (!ret) {
+        priv->refcount++;
+        *list = &priv->base;
+    }
+
+    pthread_mutex_unlock(&drm_device_registry.lock);
+
+    return ret;
+}
+
+/**
+ * Drop a reference to a list returned by drmGetDeviceList()
+ */
+void drmFreeDeviceList(drmDeviceListPtr list)
+{
+    if (list == NULL)
+        return;
+
+    pthread_mutex_lock(&drm_device_registry.lock);
+    drmDeviceListUnref((drmDeviceListPrivPtr)list);
+    pthread_mutex_unlock(&drm_device_registry.lock);
+}
+
+/**
+ * Find the device of an opened drm node in a list
+ *
+ * \param list a list returned by drmGetDeviceList()
+ * \param fd file descriptor of the drm device
+ *
+ * \return the shared device record, or NULL if the device is not listed.
+ */
+drmDevicePtr drmDeviceListFind(drmDeviceListPtr list, int fd)
+{
+    drmDeviceListPrivPtr priv = (drmDeviceListPrivPtr)list;
+    struct stat sbuf;
+    int i;
+
+    if (list == NULL || fd == -1)
+        return NULL;
+
+    if (fstat(fd, &sbuf) || !S_ISCHR(sbuf.st_mode))
+        return NULL;
+
+    for (i = 0; i < list->count * DRM_NODE_MAX; i++)
+        if (priv->rdevs[i] == sbuf.st_rdev)
+            return list->devices[i / DRM_NODE_MAX];
+
+    return NULL;
+}
+
 char *drmGetDeviceNameFromFd2(int fd)
 {
 #ifdef __linux__
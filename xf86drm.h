@@ -119,6 +119,31 @@ typedef struct drmHashEntry {
 } drmHashEntry;
 
 extern int drmIoctl(int fd, unsigned long request, void *arg);
+
+/*
+ * Ioctl accounting, see drmIoctlStatsEnable(). Setting the
+ * LIBDRM_IOCTL_STATS environment variable to a non-zero value enables it
+ * at startup and prints the statistics at exit.
+ */
+#define DRM_IOCTL_STATS_MAX     256
+#define DRM_IOCTL_STATS_BUCKETS 16
+
+typedef struct _drmIoctlStats {
+    unsigned long request;  /* request code last seen with this number */
+    unsigned long calls;
+    unsigned long errors;   /* calls that failed */
+    unsigned long eintr;    /* restarts after EINTR */
+    unsigned long eagain;   /* restarts after EAGAIN */
+    unsigned long total_us; /* including restarts, each call rounded up */
+    unsigned long max_us;
+    /* calls under 1 us, under 2^i us, and the rest in the last bucket */
+    unsigned long histogram[DRM_IOCTL_STATS_BUCKETS];
+} drmIoctlStats, *drmIoctlStatsPtr;
+
+extern int drmIoctlStatsEnable(int enable);
+extern int drmIoctlStatsGet(unsigned int nr, drmIoctlStatsPtr stats);
+extern void drmIoctlStatsReset(void);
+extern void drmIoctlStatsDump(void);
 extern void *drmGetHashTable(void);
 extern drmHashEntry *drmGetEntry(int fd);
 
@@ -684,6 +709,12 @@ extern int           drmScatterGatherAlloc(int fd, unsigned long size,
 extern int           drmScatterGatherFree(int fd, drm_handle_t handle);
 
 extern int           drmWaitVBlank(int fd, drmVBlankPtr vbl);
+extern int           drmCrtcGetSequence(int fd, uint32_t crtcId,
+					uint64_t *sequence, uint64_t *ns);
+extern int           drmCrtcQueueSequence(int fd, uint32_t crtcId,
+					  uint32_t flags, uint64_t sequence,
+					  uint64_t *sequence_queued,
+					  uint64_t user_data);
 
 /* Support routines */
 extern void          drmSetServerInfo(drmServerInfoPtr info);
@@ -692,7 +723,9 @@ extern void          *drmMalloc(int size);
 extern void          drmFree(void *pt);
 
 /* Hash table routines */
+#define DRM_HASH_THREAD_SAFE (1 << 0)
 extern void *drmHashCreate(void);
+extern void *drmHashCreate2(unsigned int flags);
 extern int  drmHashDestroy(void *t);
 extern int  drmHashLookup(void *t, unsigned long key, void **value);
 extern int  drmHashInsert(void *t, unsigned long key, void *value);
@@ -720,6 +753,24 @@ extern int  drmSLLookupNeighbors(void *l, unsigned long key,
 				 unsigned long *prev_key, void **prev_value,
 				 unsigned long *next_key, void **next_value);
 
+/* B+ tree routines, an ordered map with the skip list interface */
+
+extern void *drmBTCreate(void);
+extern int  drmBTDestroy(void *t);
+extern int  drmBTLookup(void *t, unsigned long key, void **value);
+extern int  drmBTInsert(void *t, unsigned long key, void *value);
+extern int  drmBTDelete(void *t, unsigned long key);
+extern int  drmBTNext(void *t, unsigned long *key, void **value);
+extern int  drmBTFirst(void *t, unsigned long *key, void **value);
+extern int  drmBTSeek(void *t, unsigned long key,
+		      unsigned long *found, void **value);
+extern int  drmBTBulkLoad(void *t, const unsigned long *keys,
+			  void *const *values, int count);
+extern void drmBTDump(void *t);
+extern int  drmBTLookupNeighbors(void *t, unsigned long key,
+				 unsigned long *prev_key, void **prev_value,
+				 unsigned long *next_key, void **next_value);
+
 extern int drmOpenOnce(void *unused, const char *BusID, int *newlyopened);
 extern int drmOpenOnceWithType(const char *BusID, int *newlyopened, int type);
 extern void drmCloseOnce(int fd);
@@ -728,7 +779,7 @@ extern void drmMsg(const char *format, ...) DRM_PRINTFLIKE(1, 2);
 extern int drmSetMaster(int fd);
 extern int drmDropMaster(int fd);
 
-#define DRM_EVENT_CONTEXT_VERSION 2
+#define DRM_EVENT_CONTEXT_VERSION 4
 
 typedef struct _drmEventContext {
 
@@ -748,10 +799,33 @@ typedef struct _drmEventContext {
 				  unsigned int tv_usec,
 				  void *user_data);
 
+	/* version 3: takes precedence over page_flip_handler */
+	void (*page_flip_handler2)(int fd,
+				   unsigned int sequence,
+				   unsigned int tv_sec,
+				   unsigned int tv_usec,
+				   unsigned int crtc_id,
+				   void *user_data);
+
+	/* version 4 */
+	void (*sequence_handler)(int fd,
+				 uint64_t sequence,
+				 uint64_t ns,
+				 uint64_t user_data);
+
 } drmEventContext, *drmEventContextPtr;
 
 extern int drmHandleEvent(int fd, drmEventContextPtr evctx);
 
+/*
+ * Read and dispatch every pending event. The fd must have O_NONBLOCK set,
+ * the queue is drained until read() reports EAGAIN, which makes it safe to
+ * call from both level and edge triggered epoll loops.
+ * Returns the number of events read, or -1 with errno set when nothing
+ * could be read because of an error.
+ */
+extern int drmHandleEvents(int fd, drmEventContextPtr evctx);
+
 extern char *drmGetDeviceNameFromFd(int fd);
 
 /* Improved version of drmGetDeviceNameFromFd which attributes for any type of
@@ -763,6 +837,18 @@ extern int drmGetNodeTypeFromFd(int fd);
 extern int drmPrimeHandleToFD(int fd, uint32_t handle, uint32_t flags, int *prime_fd);
 extern int drmPrimeFDToHandle(int fd, int prime_fd, uint32_t *handle);
 
+/* PRIME import/export handle cache, see drmPrimeCacheImport() */
+typedef struct _drmPrimeCache drmPrimeCache, *drmPrimeCachePtr;
+
+extern drmPrimeCachePtr drmPrimeCacheCreate(int fd);
+extern void drmPrimeCacheDestroy(drmPrimeCachePtr cache);
+extern int drmPrimeCacheImport(drmPrimeCachePtr cache, int prime_fd,
+                               uint32_t *handle);
+extern int drmPrimeCacheExport(drmPrimeCachePtr cache, uint32_t handle,
+                               uint32_t flags, int *prime_fd);
+extern int drmPrimeCacheRelease(drmPrimeCachePtr cache, uint32_t handle);
+extern void drmPrimeCacheForget(drmPrimeCachePtr cache, uint32_t handle);
+
 extern char *drmGetPrimaryDeviceNameFromFd(int fd);
 extern char *drmGetRenderDeviceNameFromFd(int fd);
 
@@ -844,6 +930,15 @@ extern void drmFreeDevices(drmDevicePtr devices[], int count);
 extern int drmGetDevice2(int fd, uint32_t flags, drmDevicePtr *device);
 extern int drmGetDevices2(uint32_t flags, drmDevicePtr devices[], int max_devices);
 
+typedef struct _drmDeviceList {
+    int count;
+    drmDevicePtr *devices;
+} drmDeviceList, *drmDeviceListPtr;
+
+extern int drmGetDeviceList(uint32_t flags, drmDeviceListPtr *list);
+extern void drmFreeDeviceList(drmDeviceListPtr list);
+extern drmDevicePtr drmDeviceListFind(drmDeviceListPtr list, int fd);
+
 #if defined(__cplusplus)
 }
 #endif
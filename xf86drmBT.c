@@ -0,0 +1,633 @@
+/* xf86drmBT.c -- B+ tree support
+ *
+ * Copyright (C) ROCKCHIP, Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ * DESCRIPTION
+ *
+ * This file contains an ordered map with the interface of the skip list in
+ * xf86drmSL.c, implemented as a B+ tree [Comer79].  Keys are kept in sorted
+ * arrays of BT_MAX_KEYS entries per node, so a search touches one or two
+ * cache lines per level instead of one heap node per key, and the tree is
+ * only a few levels deep.  Values live in the leaves, which are chained for
+ * in-order iteration.
+ *
+ * Insertion splits full nodes on the way down and deletion refills nodes
+ * at the minimum fill on the way down, borrowing from or merging with a
+ * sibling, so neither needs to walk back up.  drmBTBulkLoad() builds a tree
+ * from sorted keys bottom up, and drmBTSeek() starts an iteration at a
+ * given key, which together with drmBTNext() iterates over a range.
+ *
+ * REFERENCES
+ *
+ * [Comer79] Douglas Comer.  The Ubiquitous B-Tree.  ACM Computing Surveys
+ * 11(2), June 1979, pp. 121-137.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "xf86drm.h"
+
+#define BT_TREE_MAGIC  0xb7ee0000LU
+#define BT_FREED_MAGIC 0xdecea5edLU
+#define BT_MAX_KEYS    32
+#define BT_MIN_KEYS    ((BT_MAX_KEYS - 1) / 2)
+#define BT_MAX_DEPTH   16
+
+typedef struct BTNode {
+    int               leaf;
+    int               count;
+    unsigned long     keys[BT_MAX_KEYS];
+} BTNode, *BTNodePtr;
+
+typedef struct BTLeaf {
+    BTNode            node;
+    void              *values[BT_MAX_KEYS];
+    struct BTLeaf     *next;
+} BTLeaf, *BTLeafPtr;
+
+typedef struct BTInner {
+    BTNode            node;
+    BTNodePtr         children[BT_MAX_KEYS + 1];
+} BTInner, *BTInnerPtr;
+
+typedef struct BTree {
+    unsigned long    magic;	/* BT_TREE_MAGIC */
+    int              count;
+    int              depth;	/* 1 for a single leaf */
+    BTNodePtr        root;
+    BTLeafPtr        p0;	/* Position for iteration */
+    int              p1;
+} BTree, *BTreePtr;
+
+#define LEAF(n)  ((BTLeafPtr)(n))
+#define INNER(n) ((BTInnerPtr)(n))
+
+static BTNodePtr BTCreateLeaf(void)
+{
+    BTLeafPtr leaf = drmMalloc(sizeof(*leaf));
+
+    if (!leaf) return NULL;
+    leaf->node.leaf = 1;
+    return &leaf->node;
+}
+
+static BTNodePtr BTCreateInner(void)
+{
+    BTInnerPtr inner = drmMalloc(sizeof(*inner));
+
+    if (!inner) return NULL;
+    return &inner->node;
+}
+
+static void BTDestroyNode(BTNodePtr node)
+{
+    int i;
+
+    if (!node->leaf)
+	for (i = 0; i <= node->count; i++)
+	    BTDestroyNode(INNER(node)->children[i]);
+    drmFree(node);
+}
+
+/* Index of the first key >= key. */
+
+static int BTLowerBound(BTNodePtr node, unsigned long key)
+{
+    int lo = 0, hi = node->count;
+
+    while (lo < hi) {
+	int mid = (lo + hi) / 2;
+
+	if (node->keys[mid] < key) lo = mid + 1;
+	else                       hi = mid;
+    }
+    return lo;
+}
+
+/* Index of the child of an inner node that may hold key. */
+
+static int BTChild(BTNodePtr node, unsigned long key)
+{
+    int lo = 0, hi = node->count;
+
+    while (lo < hi) {
+	int mid = (lo + hi) / 2;
+
+	if (node->keys[mid] <= key) lo = mid + 1;
+	else                        hi = mid;
+    }
+    return lo;
+}
+
+static BTLeafPtr BTFindLeaf(BTreePtr tree, unsigned long key)
+{
+    BTNodePtr node = tree->root;
+
+    while (!node->leaf)
+	node = INNER(node)->children[BTChild(node, key)];
+    return LEAF(node);
+}
+
+void *drmBTCreate(void)
+{
+    BTreePtr tree;
+
+    tree        = drmMalloc(sizeof(*tree));
+    if (!tree) return NULL;
+    tree->root  = BTCreateLeaf();
+    if (!tree->root) {
+	drmFree(tree);
+	return NULL;
+    }
+    tree->magic = BT_TREE_MAGIC;
+    tree->count = 0;
+    tree->depth = 1;
+    return tree;
+}
+
+int drmBTDestroy(void *t)
+{
+    BTreePtr tree = (BTreePtr)t;
+
+    if (tree->magic != BT_TREE_MAGIC) return -1; /* Bad magic */
+
+    BTDestroyNode(tree->root);
+    tree->magic = BT_FREED_MAGIC;
+    drmFree(tree);
+    return 0;
+}
+
+/* Split the full child i of parent, which has room for one more key. */
+
+static int BTSplitChild(BTNodePtr parent, int i)
+{
+    BTNodePtr     child = INNER(parent)->children[i];
+    BTNodePtr     right;
+    unsigned long separator;
+    int           mid = BT_MAX_KEYS / 2;
+
+    if (child->leaf) {
+	right = BTCreateLeaf();
+	if (!right) return -1;
+	right->count = BT_MAX_KEYS - mid;
+	memcpy(right->keys, &child->keys[mid],
+	       right->count * sizeof(child->keys[0]));
+	memcpy(LEAF(right)->values, &LEAF(child)->values[mid],
+	       right->count * sizeof(LEAF(child)->values[0]));
+	LEAF(right)->next = LEAF(child)->next;
+	LEAF(child)->next = LEAF(right);
+	child->count      = mid;
+	separator         = right->keys[0];
+    } else {
+	right = BTCreateInner();
+	if (!right) return -1;
+	right->count = BT_MAX_KEYS - mid - 1;
+	memcpy(right->keys, &child->keys[mid + 1],
+	       right->count * sizeof(child->keys[0]));
+	memcpy(INNER(right)->children, &INNER(child)->children[mid + 1],
+	       (right->count + 1) * sizeof(INNER(child)->children[0]));
+	child->count = mid;
+	separator    = child->keys[mid];
+    }
+
+    memmove(&parent->keys[i + 1], &parent->keys[i],
+	    (parent->count - i) * sizeof(parent->keys[0]));
+    memmove(&INNER(parent)->children[i + 2], &INNER(parent)->children[i + 1],
+	    (parent->count - i) * sizeof(INNER(parent)->children[0]));
+    parent->keys[i]                = separator;
+    INNER(parent)->children[i + 1] = right;
+    ++parent->count;
+    return 0;
+}
+
+int drmBTInsert(void *t, unsigned long key, void *value)
+{
+    BTreePtr  tree = (BTreePtr)t;
+    BTNodePtr node;
+    int       i;
+
+    if (tree->magic != BT_TREE_MAGIC) return -1; /* Bad magic */
+
+    if (tree->root->count == BT_MAX_KEYS) {
+	BTNodePtr root;
+
+	if (tree->depth == BT_MAX_DEPTH) return -1;
+	root = BTCreateInner();
+	if (!root) return -1;
+	INNER(root)->children[0] = tree->root;
+	if (BTSplitChild(root, 0)) {
+	    drmFree(root);
+	    return -1;
+	}
+	tree->root = root;
+	++tree->depth;
+    }
+
+    for (node = tree->root; !node->leaf;) {
+	i = BTChild(node, key);
+	if (INNER(node)->children[i]->count == BT_MAX_KEYS) {
+	    if (BTSplitChild(node, i)) return -1;
+	    if (node->keys[i] <= key) ++i;
+	}
+	node = INNER(node)->children[i];
+    }
+
+    i = BTLowerBound(node, key);
+    if (i < node->count && node->keys[i] == key) return 1; /* Already in tree */
+
+    memmove(&node->keys[i + 1], &node->keys[i],
+	    (node->count - i) * sizeof(node->keys[0]));
+    memmove(&LEAF(node)->values[i + 1], &LEAF(node)->values[i],
+	    (node->count - i) * sizeof(LEAF(node)->values[0]));
+    node->keys[i]         = key;
+    LEAF(node)->values[i] = value;
+    ++node->count;
+    ++tree->count;
+    return 0;			/* Added to tree */
+}
+
+/* Make sure child i of parent has more than BT_MIN_KEYS keys.  Returns the
+   index of the child that now covers its keys. */
+
+static int BTFillChild(BTNodePtr parent, int i)
+{
+    BTNodePtr *children = INNER(parent)->children;
+    BTNodePtr child     = children[i];
+    BTNodePtr left      = i > 0 ? children[i - 1] : NULL;
+    BTNodePtr right     = i < parent->count ? children[i + 1] : NULL;
+    int       n;
+
+    if (left && left->count > BT_MIN_KEYS) {
+				/* Borrow the last key of the left sibling */
+	memmove(&child->keys[1], &child->keys[0],
+		child->count * sizeof(child->keys[0]));
+	if (child->leaf) {
+	    memmove(&LEAF(child)->values[1], &LEAF(child)->values[0],
+		    child->count * sizeof(LEAF(child)->values[0]));
+	    child->keys[0]         = left->keys[left->count - 1];
+	    LEAF(child)->values[0] = LEAF(left)->values[left->count - 1];
+	    parent->keys[i - 1]    = child->keys[0];
+	} else {
+	    memmove(&INNER(child)->children[1], &INNER(child)->children[0],
+		    (child->count + 1) * sizeof(INNER(child)->children[0]));
+	    child->keys[0]           = parent->keys[i - 1];
+	    INNER(child)->children[0] = INNER(left)->children[left->count];
+	    parent->keys[i - 1]      = left->keys[left->count - 1];
+	}
+	--left->count;
+	++child->count;
+	return i;
+    }
+
+    if (right && right->count > BT_MIN_KEYS) {
+				/* Borrow the first key of the right sibling */
+	if (child->leaf) {
+	    child->keys[child->count]         = right->keys[0];
+	    LEAF(child)->values[child->count] = LEAF(right)->values[0];
+	    memmove(&LEAF(right)->values[0], &LEAF(right)->values[1],
+		    (right->count - 1) * sizeof(LEAF(right)->values[0]));
+	    memmove(&right->keys[0], &right->keys[1],
+		    (right->count - 1) * sizeof(right->keys[0]));
+	    parent->keys[i] = right->keys[0];
+	} else {
+	    child->keys[child->count] = parent->keys[i];
+	    INNER(child)->children[child->count + 1] =
+		INNER(right)->children[0];
+	    parent->keys[i] = right->keys[0];
+	    memmove(&right->keys[0], &right->keys[1],
+		    (right->count - 1) * sizeof(right->keys[0]));
+	    memmove(&INNER(right)->children[0], &INNER(right)->children[1],
+		    right->count * sizeof(INNER(right)->children[0]));
+	}
+	--right->count;
+	++child->count;
+	return i;
+    }
+
+				/* Merge with a sibling, into the left node */
+    if (!right) {
+	right = child;
+	child = left;
+	--i;
+    }
+
+    n = child->count;
+    if (child->leaf) {
+	memcpy(&child->keys[n], right->keys,
+	       right->count * sizeof(right->keys[0]));
+	memcpy(&LEAF(child)->values[n], LEAF(right)->values,
+	       right->count * sizeof(LEAF(right)->values[0]));
+	child->count     += right->count;
+	LEAF(child)->next = LEAF(right)->next;
+    } else {
+	child->keys[n] = parent->keys[i];
+	memcpy(&child->keys[n + 1], right->keys,
+	       right->count * sizeof(right->keys[0]));
+	memcpy(&INNER(child)->children[n + 1], INNER(right)->children,
+	       (right->count + 1) * sizeof(INNER(right)->children[0]));
+	child->count += right->count + 1;
+    }
+    drmFree(right);
+
+    memmove(&parent->keys[i], &parent->keys[i + 1],
+	    (parent->count - i - 1) * sizeof(parent->keys[0]));
+    memmove(&children[i + 1], &children[i + 2],
+	    (parent->count - i - 1) * sizeof(children[0]));
+    --parent->count;
+    return i;
+}
+
+int drmBTDelete(void *t, unsigned long key)
+{
+    BTreePtr  tree = (BTreePtr)t;
+    BTNodePtr node;
+    int       i;
+
+    if (tree->magic != BT_TREE_MAGIC) return -1; /* Bad magic */
+
+    for (node = tree->root; !node->leaf;) {
+	i = BTChild(node, key);
+	if (INNER(node)->children[i]->count <= BT_MIN_KEYS)
+	    i = BTFillChild(node, i);
+	if (node == tree->root && node->count == 0) {
+				/* The root lost its last key in a merge */
+	    tree->root = INNER(node)->children[0];
+	    --tree->depth;
+	    drmFree(node);
+	    node = tree->root;
+	    continue;
+	}
+	node = INNER(node)->children[i];
+    }
+
+    i = BTLowerBound(node, key);
+    if (i == node->count || node->keys[i] != key) return 1; /* Not found */
+
+    memmove(&node->keys[i], &node->keys[i + 1],
+	    (node->count - i - 1) * sizeof(node->keys[0]));
+    memmove(&LEAF(node)->values[i], &LEAF(node)->values[i + 1],
+	    (node->count - i - 1) * sizeof(LEAF(node)->values[0]));
+    --node->count;
+    --tree->count;
+    return 0;
+}
+
+int drmBTLookup(void *t, unsigned long key, void **value)
+{
+    BTreePtr  tree = (BTreePtr)t;
+    BTLeafPtr leaf;
+    int       i;
+
+    if (tree->magic != BT_TREE_MAGIC) return -1; /* Bad magic */
+
+    leaf = BTFindLeaf(tree, key);
+    i    = BTLowerBound(&leaf->node, key);
+    if (i < leaf->node.count && leaf->node.keys[i] == key) {
+	*value = leaf->values[i];
+	return 0;
+    }
+    *value = NULL;
+    return -1;
+}
+
+/* Like drmSLLookupNeighbors(), the previous entry is the last one below
+   key, and the next entry the first one at or above key.  When there is
+   no entry below key, key 0 with a NULL value is returned in its place,
+   as the skip list returns its head. */
+
+int drmBTLookupNeighbors(void *t, unsigned long key,
+			 unsigned long *prev_key, void **prev_value,
+			 unsigned long *next_key, void **next_value)
+{
+    BTreePtr      tree = (BTreePtr)t;
+    BTNodePtr     node;
+    BTLeafPtr     prev = NULL;
+    int           prev_index = 0;
+    int           i, retcode = 1;
+
+    *prev_key   = *next_key   = key;
+    *prev_value = *next_value = NULL;
+
+    if (tree->magic != BT_TREE_MAGIC) return 0;
+
+    for (node = tree->root; !node->leaf;) {
+	i = BTLowerBound(node, key);
+				/* Remember the closest subtree to the left */
+	if (i > 0) {
+	    BTNodePtr left = INNER(node)->children[i - 1];
+
+	    while (!left->leaf)
+		left = INNER(left)->children[left->count];
+	    prev       = LEAF(left);
+	    prev_index = left->count - 1;
+	}
+	node = INNER(node)->children[i];
+    }
+
+    i = BTLowerBound(node, key);
+    if (i > 0) {
+	prev       = LEAF(node);
+	prev_index = i - 1;
+    }
+
+    if (prev && prev_index >= 0) {
+	*prev_key   = prev->node.keys[prev_index];
+	*prev_value = prev->values[prev_index];
+    } else {
+	*prev_key   = 0;
+    }
+
+    if (i == node->count) {
+	node = LEAF(node)->next ? &LEAF(node)->next->node : NULL;
+	i    = 0;
+    }
+    if (node && i < node->count) {
+	*next_key   = node->keys[i];
+	*next_value = LEAF(node)->values[i];
+	++retcode;
+    }
+    return retcode;
+}
+
+int drmBTNext(void *t, unsigned long *key, void **value)
+{
+    BTreePtr  tree = (BTreePtr)t;
+    BTLeafPtr leaf;
+
+    if (tree->magic != BT_TREE_MAGIC) return -1; /* Bad magic */
+
+    for (leaf = tree->p0; leaf; leaf = tree->p0 = leaf->next, tree->p1 = 0) {
+	if (tree->p1 < leaf->node.count) {
+	    *key   = leaf->node.keys[tree->p1];
+	    *value = leaf->values[tree->p1];
+	    ++tree->p1;
+	    return 1;
+	}
+    }
+    return 0;
+}
+
+int drmBTFirst(void *t, unsigned long *key, void **value)
+{
+    BTreePtr  tree = (BTreePtr)t;
+    BTNodePtr node;
+
+    if (tree->magic != BT_TREE_MAGIC) return -1; /* Bad magic */
+
+    for (node = tree->root; !node->leaf;)
+	node = INNER(node)->children[0];
+    tree->p0 = LEAF(node);
+    tree->p1 = 0;
+    return drmBTNext(tree, key, value);
+}
+
+/* Start an iteration at the first key >= key.  Continue it with
+   drmBTNext(), stopping past the end of the range of interest. */
+
+int drmBTSeek(void *t, unsigned long key, unsigned long *found, void **value)
+{
+    BTreePtr  tree = (BTreePtr)t;
+
+    if (tree->magic != BT_TREE_MAGIC) return -1; /* Bad magic */
+
+    tree->p0 = BTFindLeaf(tree, key);
+    tree->p1 = BTLowerBound(&tree->p0->node, key);
+    return drmBTNext(tree, found, value);
+}
+
+/* Replace the contents of an empty tree by count entries with strictly
+   ascending keys.  values may be NULL.  Nodes are filled evenly, as full
+   as possible, which is much faster than inserting one key at a time. */
+
+int drmBTBulkLoad(void *t, const unsigned long *keys, void *const *values,
+		  int count)
+{
+    BTreePtr      tree = (BTreePtr)t;
+    BTNodePtr     *level, *next_level;
+    unsigned long *mins;
+    BTLeafPtr     prev = NULL;
+    int           nodes, n, i, j, pos, depth;
+
+    if (tree->magic != BT_TREE_MAGIC) return -1; /* Bad magic */
+    if (tree->count || count < 0) return -1;
+    for (i = 1; i < count; i++)
+	if (keys[i - 1] >= keys[i]) return -1;
+    if (!count) return 0;
+
+    nodes = (count + BT_MAX_KEYS - 1) / BT_MAX_KEYS;
+    level = drmMalloc(nodes * sizeof(*level));
+    mins  = drmMalloc(nodes * sizeof(*mins));
+    if (!level || !mins) goto fail;
+
+    for (i = 0, pos = 0; i < nodes; i++) {
+	n = count / nodes + (i < count % nodes);
+	level[i] = BTCreateLeaf();
+	if (!level[i]) goto fail;
+	level[i]->count = n;
+	memcpy(level[i]->keys, &keys[pos], n * sizeof(keys[0]));
+	if (values)
+	    memcpy(LEAF(level[i])->values, &values[pos], n * sizeof(values[0]));
+	if (prev) prev->next = LEAF(level[i]);
+	prev    = LEAF(level[i]);
+	mins[i] = keys[pos];
+	pos    += n;
+    }
+
+    for (depth = 1; nodes > 1; depth++) {
+	int parents = (nodes + BT_MAX_KEYS) / (BT_MAX_KEYS + 1);
+
+	if (depth == BT_MAX_DEPTH) goto fail;
+	next_level = drmMalloc(parents * sizeof(*next_level));
+	if (!next_level) goto fail;
+
+	for (i = 0, pos = 0; i < parents; i++) {
+	    n = nodes / parents + (i < nodes % parents);
+	    next_level[i] = BTCreateInner();
+	    if (!next_level[i]) {
+		while (i--) drmFree(next_level[i]);
+		drmFree(next_level);
+		goto fail;
+	    }
+	    next_level[i]->count = n - 1;
+	    for (j = 0; j < n; j++) {
+		INNER(next_level[i])->children[j] = level[pos + j];
+		if (j) next_level[i]->keys[j - 1] = mins[pos + j];
+	    }
+	    mins[i] = mins[pos];
+	    pos    += n;
+	}
+
+	drmFree(level);
+	level = next_level;
+	nodes = parents;
+    }
+
+    BTDestroyNode(tree->root);
+    tree->root  = level[0];
+    tree->depth = depth;
+    tree->count = count;
+    drmFree(level);
+    drmFree(mins);
+    return 0;
+
+fail:
+    if (level) {
+	for (i = 0; i < nodes; i++)
+	    if (level[i]) BTDestroyNode(level[i]);
+    }
+    drmFree(level);
+    drmFree(mins);
+    return -1;
+}
+
+/* Dump internal data structures for debugging. */
+
+static void BTDumpNode(BTNodePtr node, int depth)
+{
+    int i;
+
+    printf("%*s%s %p, %d keys:", depth * 2, "",
+	   node->leaf ? "Leaf" : "Node", (void *)node, node->count);
+    for (i = 0; i < node->count; i++)
+	printf(" 0x%08lx", node->keys[i]);
+    printf("\n");
+    if (!node->leaf)
+	for (i = 0; i <= node->count; i++)
+	    BTDumpNode(INNER(node)->children[i], depth + 1);
+}
+
+void drmBTDump(void *t)
+{
+    BTreePtr tree = (BTreePtr)t;
+
+    if (tree->magic != BT_TREE_MAGIC) {
+	printf("Bad magic: 0x%08lx (expected 0x%08lx)\n",
+	       tree->magic, BT_TREE_MAGIC);
+	return;
+    }
+
+    printf("Depth = %d, count = %d\n", tree->depth, tree->count);
+    BTDumpNode(tree->root, 0);
+}
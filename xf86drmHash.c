@@ -27,32 +27,26 @@
  *
  * DESCRIPTION
  *
- * This file contains a straightforward implementation of a fixed-sized
- * hash table using self-organizing linked lists [Knuth73, pp. 398-399] for
- * collision resolution.  There are two potentially interesting things
- * about this implementation:
+ * This file contains an implementation of a dynamic hash table using
+ * self-organizing linked lists [Knuth73, pp. 398-399] for collision
+ * resolution.  There are three potentially interesting things about this
+ * implementation:
  *
- * 1) The table is power-of-two sized.  Prime sized tables are more
- * traditional, but do not have a significant advantage over power-of-two
- * sized table, especially when double hashing is not used for collision
- * resolution.
+ * 1) The table grows by linear hashing [Larson88].  Whenever the average
+ * chain length exceeds HASH_LOAD, the single bucket pointed to by p is
+ * split into itself and bucket p + maxp, so the cost of growing is spread
+ * evenly over the insertions instead of rehashing the whole table at once.
+ * Buckets live in fixed-size segments, so growing never moves them.  The
+ * table does not shrink.
  *
- * 2) The hash computation uses a table of random integers [Hanson97,
- * pp. 39-41].
+ * 2) The hash computation is multiplicative [Knuth73, pp. 508-512].  The
+ * table is addressed by the low bits of the hash, so the high half of the
+ * product is folded into them, twice to avoid patterns in strided keys.
  *
- * FUTURE ENHANCEMENTS
- *
- * With a table size of 512, the current implementation is sufficient for a
- * few hundred keys.  Since this is well above the expected size of the
- * tables for which this implementation was designed, the implementation of
- * dynamic hash tables was postponed until the need arises.  A common (and
- * naive) approach to dynamic hash table implementation simply creates a
- * new hash table when necessary, rehashes all the data into the new table,
- * and destroys the old table.  The approach in [Larson88] is superior in
- * two ways: 1) only a portion of the table is expanded when needed,
- * distributing the expansion cost over several insertions, and 2) portions
- * of the table can be locked, enabling a scalable thread-safe
- * implementation.
+ * 3) Tables created with DRM_HASH_THREAD_SAFE protect their chains with a
+ * fixed set of striped locks, and take a table-wide lock only to split a
+ * bucket.  Iteration is not protected and must not race with updates.
+ * Search statistics are only kept for tables without locks.
  *
  * REFERENCES
  *
@@ -78,37 +72,118 @@
 
 static unsigned long HashHash(unsigned long key)
 {
-    unsigned long        hash = 0;
-    unsigned long        tmp  = key;
-    static int           init = 0;
-    static unsigned long scatter[256];
-    int                  i;
-
-    if (!init) {
-	void *state;
-	state = drmRandomCreate(37);
-	for (i = 0; i < 256; i++) scatter[i] = drmRandom(state);
-	drmRandomDestroy(state);
-	++init;
+    uint64_t hash = (uint64_t)key * 0x9e3779b97f4a7c15ULL;
+
+    hash ^= hash >> 32;
+    hash *= 0xd6e8feb86659fd93ULL;
+    return (unsigned long)(hash ^ (hash >> 32));
+}
+
+static unsigned long HashIndex(HashTablePtr table, unsigned long hash)
+{
+    unsigned long index = hash & (table->maxp - 1);
+
+    if (index < table->p)
+	index = hash & (2 * table->maxp - 1);
+    return index;
+}
+
+static HashBucketPtr *HashSlot(HashTablePtr table, unsigned long index)
+{
+    return &table->segments[index >> HASH_SEGMENT_SHIFT]
+			   [index & (HASH_SEGMENT_SIZE - 1)];
+}
+
+/* Lock the chain for a key, the resize lock is held until HashUnlock(). */
+
+static unsigned long HashLock(HashTablePtr table, unsigned long key)
+{
+    unsigned long index;
+
+    if (table->resize)
+	pthread_rwlock_rdlock(table->resize);
+    index = HashIndex(table, HashHash(key));
+    if (table->stripes)
+	pthread_mutex_lock(&table->stripes[index % HASH_STRIPES]);
+    return index;
+}
+
+static void HashUnlock(HashTablePtr table, unsigned long index)
+{
+    if (table->stripes)
+	pthread_mutex_unlock(&table->stripes[index % HASH_STRIPES]);
+    if (table->resize)
+	pthread_rwlock_unlock(table->resize);
+}
+
+/* Split bucket p into p and p + maxp.  Called with the table locked for
+   writing. */
+
+static int HashSplit(HashTablePtr table)
+{
+    unsigned long  old   = table->p;
+    unsigned long  new   = table->p + table->maxp;
+    unsigned long  seg   = new >> HASH_SEGMENT_SHIFT;
+    HashBucketPtr  *from, *to, bucket, next;
+
+    if (seg >= table->nsegments) {
+	unsigned long nsegments = table->nsegments * 2;
+	HashBucketPtr **segments;
+
+	segments = realloc(table->segments, nsegments * sizeof(*segments));
+	if (!segments) return -1;
+	for (; table->nsegments < nsegments; table->nsegments++)
+	    segments[table->nsegments] = NULL;
+	table->segments = segments;
+    }
+    if (!table->segments[seg]) {
+	table->segments[seg] = drmMalloc(HASH_SEGMENT_SIZE *
+					 sizeof(HashBucketPtr));
+	if (!table->segments[seg]) return -1;
     }
 
-    while (tmp) {
-	hash = (hash << 1) + scatter[tmp & 0xff];
-	tmp >>= 8;
+    from   = HashSlot(table, old);
+    to     = HashSlot(table, new);
+    bucket = *from;
+    *from  = NULL;
+    *to    = NULL;
+
+    for (; bucket; bucket = next) {
+	next = bucket->next;
+	if (HashHash(bucket->key) & table->maxp) {
+	    bucket->next = *to;
+	    *to          = bucket;
+	} else {
+	    bucket->next = *from;
+	    *from        = bucket;
+	}
     }
 
-    hash %= HASH_SIZE;
-#if DEBUG
-    printf( "Hash(%lu) = %lu\n", key, hash);
-#endif
-    return hash;
+    if (++table->p == table->maxp) {
+	table->maxp *= 2;
+	table->p     = 0;
+    }
+    return 0;
 }
 
-void *drmHashCreate(void)
+static void HashGrow(HashTablePtr table)
+{
+    if (table->resize)
+	pthread_rwlock_wrlock(table->resize);
+    while (table->entries > HASH_LOAD * (table->maxp + table->p))
+	if (HashSplit(table))
+	    break;		/* Keep the longer chains */
+    if (table->resize)
+	pthread_rwlock_unlock(table->resize);
+}
+
+void *drmHashCreate2(unsigned int flags)
 {
     HashTablePtr table;
     int          i;
 
+    if (flags & ~DRM_HASH_THREAD_SAFE) return NULL;
+
     table           = drmMalloc(sizeof(*table));
     if (!table) return NULL;
     table->magic    = HASH_MAGIC;
@@ -116,9 +191,37 @@ void *drmHashCreate(void)
     table->hits     = 0;
     table->partials = 0;
     table->misses   = 0;
-
-    for (i = 0; i < HASH_SIZE; i++) table->buckets[i] = NULL;
+    table->maxp     = HASH_SIZE;
+    table->p        = 0;
+
+    table->nsegments = 4;
+    table->segments  = drmMalloc(table->nsegments * sizeof(*table->segments));
+    if (!table->segments) goto fail;
+    table->segments[0] = drmMalloc(HASH_SEGMENT_SIZE * sizeof(HashBucketPtr));
+    if (!table->segments[0]) goto fail;
+
+    if (flags & DRM_HASH_THREAD_SAFE) {
+	table->resize  = drmMalloc(sizeof(*table->resize));
+	table->stripes = drmMalloc(HASH_STRIPES * sizeof(*table->stripes));
+	if (!table->resize || !table->stripes) goto fail;
+	pthread_rwlock_init(table->resize, NULL);
+	for (i = 0; i < HASH_STRIPES; i++)
+	    pthread_mutex_init(&table->stripes[i], NULL);
+    }
     return table;
+
+fail:
+    if (table->segments) drmFree(table->segments[0]);
+    drmFree(table->segments);
+    drmFree(table->resize);
+    drmFree(table->stripes);
+    drmFree(table);
+    return NULL;
+}
+
+void *drmHashCreate(void)
+{
+    return drmHashCreate2(0);
 }
 
 int drmHashDestroy(void *t)
@@ -126,49 +229,58 @@ int drmHashDestroy(void *t)
     HashTablePtr  table = (HashTablePtr)t;
     HashBucketPtr bucket;
     HashBucketPtr next;
-    int           i;
+    unsigned long i;
 
     if (table->magic != HASH_MAGIC) return -1; /* Bad magic */
 
-    for (i = 0; i < HASH_SIZE; i++) {
-	for (bucket = table->buckets[i]; bucket;) {
+    for (i = 0; i < table->maxp + table->p; i++) {
+	for (bucket = *HashSlot(table, i); bucket;) {
 	    next = bucket->next;
 	    drmFree(bucket);
 	    bucket = next;
 	}
     }
+    for (i = 0; i < table->nsegments; i++)
+	drmFree(table->segments[i]);
+    drmFree(table->segments);
+
+    if (table->stripes) {
+	for (i = 0; i < HASH_STRIPES; i++)
+	    pthread_mutex_destroy(&table->stripes[i]);
+	pthread_rwlock_destroy(table->resize);
+	drmFree(table->stripes);
+	drmFree(table->resize);
+    }
     drmFree(table);
     return 0;
 }
 
 /* Find the bucket and organize the list so that this bucket is at the
-   top. */
+   top.  Called with the chain locked. */
 
 static HashBucketPtr HashFind(HashTablePtr table,
-			      unsigned long key, unsigned long *h)
+			      unsigned long key, unsigned long index)
 {
-    unsigned long hash = HashHash(key);
+    HashBucketPtr *slot = HashSlot(table, index);
     HashBucketPtr prev = NULL;
     HashBucketPtr bucket;
 
-    if (h) *h = hash;
-
-    for (bucket = table->buckets[hash]; bucket; bucket = bucket->next) {
+    for (bucket = *slot; bucket; bucket = bucket->next) {
 	if (bucket->key == key) {
 	    if (prev) {
 				/* Organize */
 		prev->next           = bucket->next;
-		bucket->next         = table->buckets[hash];
-		table->buckets[hash] = bucket;
-		++table->partials;
+		bucket->next         = *slot;
+		*slot                = bucket;
+		if (!table->stripes) ++table->partials;
 	    } else {
-		++table->hits;
+		if (!table->stripes) ++table->hits;
 	    }
 	    return bucket;
 	}
 	prev = bucket;
     }
-    ++table->misses;
+    if (!table->stripes) ++table->misses;
     return NULL;
 }
 
@@ -176,12 +288,16 @@ int drmHashLookup(void *t, unsigned long key, void **value)
 {
     HashTablePtr  table = (HashTablePtr)t;
     HashBucketPtr bucket;
+    unsigned long index;
 
     if (!table || table->magic != HASH_MAGIC) return -1; /* Bad magic */
 
-    bucket = HashFind(table, key, NULL);
+    index  = HashLock(table, key);
+    bucket = HashFind(table, key, index);
+    if (bucket) *value = bucket->value;
+    HashUnlock(table, index);
+
     if (!bucket) return 1;	/* Not found */
-    *value = bucket->value;
     return 0;			/* Found */
 }
 
@@ -189,37 +305,65 @@ int drmHashInsert(void *t, unsigned long key, void *value)
 {
     HashTablePtr  table = (HashTablePtr)t;
     HashBucketPtr bucket;
-    unsigned long hash;
+    HashBucketPtr *slot;
+    unsigned long index, entries;
+    int           grow;
 
     if (table->magic != HASH_MAGIC) return -1; /* Bad magic */
 
-    if (HashFind(table, key, &hash)) return 1; /* Already in table */
+    index = HashLock(table, key);
+
+    if (HashFind(table, key, index)) {
+	HashUnlock(table, index);
+	return 1;		/* Already in table */
+    }
 
     bucket               = drmMalloc(sizeof(*bucket));
-    if (!bucket) return -1;	/* Error */
+    if (!bucket) {
+	HashUnlock(table, index);
+	return -1;		/* Error */
+    }
+    slot                 = HashSlot(table, index);
     bucket->key          = key;
     bucket->value        = value;
-    bucket->next         = table->buckets[hash];
-    table->buckets[hash] = bucket;
+    bucket->next         = *slot;
+    *slot                = bucket;
+
+    if (table->stripes)
+	entries = __sync_add_and_fetch(&table->entries, 1);
+    else
+	entries = ++table->entries;
+    grow = entries > HASH_LOAD * (table->maxp + table->p);
+
+    HashUnlock(table, index);
 #if DEBUG
-    printf("Inserted %lu at %lu/%p\n", key, hash, bucket);
+    printf("Inserted %lu at %lu/%p\n", key, index, bucket);
 #endif
+    if (grow) HashGrow(table);
     return 0;			/* Added to table */
 }
 
 int drmHashDelete(void *t, unsigned long key)
 {
     HashTablePtr  table = (HashTablePtr)t;
-    unsigned long hash;
+    unsigned long index;
     HashBucketPtr bucket;
 
     if (table->magic != HASH_MAGIC) return -1; /* Bad magic */
 
-    bucket = HashFind(table, key, &hash);
+    index  = HashLock(table, key);
+    bucket = HashFind(table, key, index);
+    if (bucket) {
+	*HashSlot(table, index) = bucket->next;
+	if (table->stripes)
+	    __sync_sub_and_fetch(&table->entries, 1);
+	else
+	    --table->entries;
+    }
+    HashUnlock(table, index);
 
     if (!bucket) return 1;	/* Not found */
 
-    table->buckets[hash] = bucket->next;
     drmFree(bucket);
     return 0;
 }
@@ -228,16 +372,22 @@ int drmHashNext(void *t, unsigned long *key, void **value)
 {
     HashTablePtr  table = (HashTablePtr)t;
 
-    while (table->p0 < HASH_SIZE) {
+    while (table->p0 < table->maxp + table->p) {
 	if (table->p1) {
 	    *key       = table->p1->key;
 	    *value     = table->p1->value;
 	    table->p1  = table->p1->next;
 	    return 1;
 	}
-	table->p1 = table->buckets[table->p0];
+	table->p1 = *HashSlot(table, table->p0);
 	++table->p0;
     }
+    if (table->p1) {
+	*key       = table->p1->key;
+	*value     = table->p1->value;
+	table->p1  = table->p1->next;
+	return 1;
+    }
     return 0;
 }
 
@@ -247,7 +397,7 @@ int drmHashFirst(void *t, unsigned long *key, void **value)
 
     if (table->magic != HASH_MAGIC) return -1; /* Bad magic */
 
-    table->p0 = 0;
-    table->p1 = table->buckets[0];
+    table->p0 = 1;
+    table->p1 = *HashSlot(table, 0);
     return drmHashNext(table, key, value);
 }
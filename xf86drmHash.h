@@ -24,10 +24,14 @@
  * Authors: Rickard E. (Rik) Faith <faith@valinux.com>
  */
 
-#define HASH_SIZE  512		/* Good for about 100 entries */
-				/* If you change this value, you probably
-                                   have to change the HashHash hashing
-                                   function! */
+#include <pthread.h>
+
+#define HASH_SEGMENT_SHIFT 8
+#define HASH_SEGMENT_SIZE  (1 << HASH_SEGMENT_SHIFT)
+#define HASH_SIZE          HASH_SEGMENT_SIZE /* Initial number of buckets */
+#define HASH_LOAD          2	/* Split a bucket above this many entries
+				   per bucket on average */
+#define HASH_STRIPES       64	/* Bucket locks of a thread-safe table */
 
 typedef struct HashBucket {
     unsigned long     key;
@@ -41,7 +45,12 @@ typedef struct HashTable {
     unsigned long    hits;	/* At top of linked list */
     unsigned long    partials;	/* Not at top of linked list */
     unsigned long    misses;	/* Not in table */
-    HashBucketPtr    buckets[HASH_SIZE];
-    int              p0;
+    HashBucketPtr    **segments; /* HASH_SEGMENT_SIZE buckets each */
+    unsigned long    nsegments;	/* Size of the segment directory */
+    unsigned long    maxp;	/* Buckets at the start of this round */
+    unsigned long    p;		/* Next bucket to split */
+    unsigned long    p0;
     HashBucketPtr    p1;
+    pthread_rwlock_t *resize;	/* Thread-safe tables only */
+    pthread_mutex_t  *stripes;	/* Thread-safe tables only */
 } HashTable, *HashTablePtr;
@@ -54,11 +54,13 @@
 
 #include "xf86drmMode.h"
 #include "xf86drm.h"
+#include "libdrm_lists.h"
 #include <drm.h>
 #include <string.h>
 #include <dirent.h>
 #include <unistd.h>
 #include <errno.h>
+#include <time.h>
 
 #define memclear(s) memset(&s, 0, sizeof(s))
 
@@ -908,25 +910,22 @@ int drmModeCrtcSetGamma(int fd, uint32_t crtc_id, uint32_t size,
 	return DRM_IOCTL(fd, DRM_IOCTL_MODE_SETGAMMA, &l);
 }
 
-int drmHandleEvent(int fd, drmEventContextPtr evctx)
+/* large enough for a few hundred events per read */
+#define DRM_EVENT_BUFFER_SIZE	8192
+
+static int drmDispatchEvents(int fd, drmEventContextPtr evctx,
+			     const char *buffer, int len)
 {
-	char buffer[1024];
-	int len, i;
 	struct drm_event *e;
 	struct drm_event_vblank *vblank;
+	struct drm_event_crtc_sequence *seq;
+	int i = 0, count = 0;
 
-	/* The DRM read semantics guarantees that we always get only
-	 * complete events. */
-
-	len = read(fd, buffer, sizeof buffer);
-	if (len == 0)
-		return 0;
-	if (len < (int)sizeof *e)
-		return -1;
-
-	i = 0;
-	while (i < len) {
+	while (i + (int)sizeof *e <= len) {
 		e = (struct drm_event *)(buffer + i);
+		if (e->length < sizeof *e || e->length > (unsigned)(len - i))
+			break;
+
 		switch (e->type) {
 		case DRM_EVENT_VBLANK:
 			if (evctx->version < 1 ||
@@ -940,25 +939,85 @@ int drmHandleEvent(int fd, drmEventContextPtr evctx)
 					      U642VOID (vblank->user_data));
 			break;
 		case DRM_EVENT_FLIP_COMPLETE:
-			if (evctx->version < 2 ||
-			    evctx->page_flip_handler == NULL)
-				break;
 			vblank = (struct drm_event_vblank *) e;
-			evctx->page_flip_handler(fd,
-						 vblank->sequence,
-						 vblank->tv_sec,
-						 vblank->tv_usec,
-						 U642VOID (vblank->user_data));
+			if (evctx->version >= 3 && evctx->page_flip_handler2)
+				evctx->page_flip_handler2(fd,
+							 vblank->sequence,
+							 vblank->tv_sec,
+							 vblank->tv_usec,
+							 vblank->crtc_id,
+							 U642VOID (vblank->user_data));
+			else if (evctx->version >= 2 && evctx->page_flip_handler)
+				evctx->page_flip_handler(fd,
+							 vblank->sequence,
+							 vblank->tv_sec,
+							 vblank->tv_usec,
+							 U642VOID (vblank->user_data));
+			break;
+		case DRM_EVENT_CRTC_SEQUENCE:
+			if (evctx->version < 4 ||
+			    evctx->sequence_handler == NULL)
+				break;
+			seq = (struct drm_event_crtc_sequence *) e;
+			evctx->sequence_handler(fd,
+						seq->sequence,
+						seq->time_ns,
+						seq->user_data);
 			break;
 		default:
 			break;
 		}
 		i += e->length;
+		count++;
 	}
 
+	return count;
+}
+
+int drmHandleEvent(int fd, drmEventContextPtr evctx)
+{
+	/* uint64_t keeps the 64 bit event fields aligned */
+	uint64_t buffer[DRM_EVENT_BUFFER_SIZE / sizeof(uint64_t)];
+	int len;
+
+	/* The DRM read semantics guarantees that we always get only
+	 * complete events. */
+
+	len = read(fd, buffer, sizeof buffer);
+	if (len == 0)
+		return 0;
+	if (len < (int)sizeof(struct drm_event))
+		return -1;
+
+	drmDispatchEvents(fd, evctx, (const char *)buffer, len);
+
 	return 0;
 }
 
+int drmHandleEvents(int fd, drmEventContextPtr evctx)
+{
+	uint64_t buffer[DRM_EVENT_BUFFER_SIZE / sizeof(uint64_t)];
+	int len, count = 0;
+
+	for (;;) {
+		len = read(fd, buffer, sizeof buffer);
+		if (len < 0) {
+			if (errno == EINTR)
+				continue;
+			if (errno == EAGAIN || errno == EWOULDBLOCK)
+				break;
+			/* report events already dispatched, the error sticks */
+			return count ? count : -1;
+		}
+		if (len < (int)sizeof(struct drm_event))
+			break;
+
+		count += drmDispatchEvents(fd, evctx, (const char *)buffer, len);
+	}
+
+	return count;
+}
+
 int drmModePageFlip(int fd, uint32_t crtc_id, uint32_t fb_id,
 		    uint32_t flags, void *user_data)
 {
@@ -1219,16 +1278,21 @@ struct _drmModePropertySetItem {
 	uint32_t object_id;
 	uint32_t property_id;
 	bool is_blob;
-	uint64_t value;
-	void *blob;
-	drmModePropertySetItemPtr next;
+	uint64_t value;		/* the length of blobs */
+	void *blob;		/* copy of the blob data */
+	uint32_t blob_id;	/* kernel blob of the data, 0 until committed */
 };
 
 struct _drmModePropertySet {
+	int fd;			/* device the blob ids belong to */
 	unsigned int count_objs;
 	unsigned int count_props;
-	unsigned int count_blobs;
-	drmModePropertySetItem list;
+	unsigned int size_items;
+	/* sorted by object_id and property_id */
+	drmModePropertySetItemPtr items;
+	/* scratch space for the ioctl arrays, reused by every commit */
+	size_t size_arena;
+	void *arena;
 };
 
 drmModePropertySetPtr drmModePropertySetAlloc(void)
@@ -1239,247 +1303,247 @@ drmModePropertySetPtr drmModePropertySetAlloc(void)
 	if (!set)
 		return NULL;
 
-	set->list.next = NULL;
+	set->items = NULL;
+	set->arena = NULL;
+	set->size_items = 0;
+	set->size_arena = 0;
 	set->count_props = 0;
 	set->count_objs = 0;
+	set->fd = -1;
 
 	return set;
 }
 
-int drmModePropertySetAdd(drmModePropertySetPtr set,
-			  uint32_t object_id,
-			  uint32_t property_id,
-			  uint64_t value)
+static void drmModePropertySetDropBlob(drmModePropertySetPtr set,
+				       drmModePropertySetItemPtr item)
 {
-	drmModePropertySetItemPtr prev = &set->list;
-	bool new_obj = false;
+	if (item->blob_id)
+		drmModeDestroyPropertyBlob(set->fd, item->blob_id);
+	item->blob_id = 0;
+}
 
-	/* keep it sorted by object_id and property_id */
-	while (prev->next) {
-		if (prev->next->object_id > object_id)
-			break;
+static int drmModePropertySetInsert(drmModePropertySetPtr set,
+				    uint32_t object_id, uint32_t property_id,
+				    bool is_blob, uint64_t value, void *blob)
+{
+	drmModePropertySetItemPtr item;
+	unsigned int lo = 0, hi, mid;
+	void *copy = NULL;
+	bool new_obj;
 
-		if (prev->next->object_id == object_id &&
-		    prev->next->property_id >= property_id)
-			break;
+	if (!set)
+		return -EINVAL;
 
-		prev = prev->next;
+	/* binary search for the first item not below (object_id, property_id) */
+	hi = set->count_props;
+	while (lo < hi) {
+		mid = lo + (hi - lo) / 2;
+		item = &set->items[mid];
+
+		if (item->object_id < object_id ||
+		    (item->object_id == object_id &&
+		     item->property_id < property_id))
+			lo = mid + 1;
+		else
+			hi = mid;
 	}
 
-	if ((prev == &set->list || prev->object_id != object_id) &&
-	    (!prev->next || prev->next->object_id != object_id))
-		new_obj = true;
-
 	/* replace or add? */
-	if (prev->next &&
-	    prev->next->object_id == object_id &&
-	    prev->next->property_id == property_id) {
-		drmModePropertySetItemPtr item = prev->next;
+	if (lo < set->count_props &&
+	    set->items[lo].object_id == object_id &&
+	    set->items[lo].property_id == property_id) {
+		item = &set->items[lo];
 
-		if (item->is_blob)
+		if (item->is_blob != is_blob)
 			return -EINVAL;
 
-		item->value = value;
-	} else {
-		drmModePropertySetItemPtr item;
+		/* unchanged blobs keep their kernel blob */
+		if (is_blob && item->value == value &&
+		    (!value || !memcmp(item->blob, blob, value)))
+			return 0;
+	}
 
-		item = drmMalloc(sizeof *item);
-		if (!item)
-			return -1;
+	if (is_blob && value) {
+		if (value > SIZE_MAX)
+			return -EINVAL;
+
+		copy = malloc(value);
+		if (!copy)
+			return -ENOMEM;
+		memcpy(copy, blob, value);
+	}
 
-		item->object_id = object_id;
-		item->property_id = property_id;
+	if (lo < set->count_props &&
+	    set->items[lo].object_id == object_id &&
+	    set->items[lo].property_id == property_id) {
+		item = &set->items[lo];
+
+		drmModePropertySetDropBlob(set, item);
+		free(item->blob);
 		item->value = value;
-		item->is_blob = false;
-		item->blob = NULL;
+		item->blob = copy;
+
+		return 0;
+	}
 
-		item->next = prev->next;
-		prev->next = item;
+	if (set->count_props >= set->size_items) {
+		unsigned int size = set->size_items ? set->size_items * 2 : 32;
+
+		item = realloc(set->items, size * sizeof(*set->items));
+		if (!item) {
+			free(copy);
+			return -ENOMEM;
+		}
 
-		set->count_props++;
+		set->items = item;
+		set->size_items = size;
 	}
 
+	new_obj = (lo == 0 || set->items[lo - 1].object_id != object_id) &&
+		  (lo == set->count_props ||
+		   set->items[lo].object_id != object_id);
+
+	memmove(&set->items[lo + 1], &set->items[lo],
+		(set->count_props - lo) * sizeof(*set->items));
+
+	item = &set->items[lo];
+	item->object_id = object_id;
+	item->property_id = property_id;
+	item->is_blob = is_blob;
+	item->value = value;
+	item->blob = copy;
+	item->blob_id = 0;
+
+	set->count_props++;
 	if (new_obj)
 		set->count_objs++;
 
 	return 0;
 }
 
+int drmModePropertySetAdd(drmModePropertySetPtr set,
+			  uint32_t object_id,
+			  uint32_t property_id,
+			  uint64_t value)
+{
+	return drmModePropertySetInsert(set, object_id, property_id, false,
+					value, NULL);
+}
+
 int drmModePropertySetAddBlob(drmModePropertySetPtr set,
 			      uint32_t object_id,
 			      uint32_t property_id,
 			      uint64_t length,
 			      void *data)
 {
-	drmModePropertySetItemPtr prev = &set->list;
-	bool new_obj = false;
-
-	/* keep it sorted by object_id and property_id */
-	while (prev->next) {
-		if (prev->next->object_id > object_id)
-			break;
-
-		if (prev->next->object_id == object_id &&
-		    prev->next->property_id >= property_id)
-			break;
-
-		prev = prev->next;
-	}
-
-	if ((prev == &set->list || prev->object_id != object_id) &&
-	    (!prev->next || prev->next->object_id != object_id))
-		new_obj = true;
-
-	/* replace or add? */
-	if (prev->next &&
-	    prev->next->object_id == object_id &&
-	    prev->next->property_id == property_id) {
-		drmModePropertySetItemPtr item = prev->next;
-
-		if (!item->is_blob)
-			return -EINVAL;
-
-		item->value = length;
-		item->blob = data;
-	} else {
-		drmModePropertySetItemPtr item;
-
-		item = drmMalloc(sizeof *item);
-		if (!item)
-			return -1;
-
-		item->object_id = object_id;
-		item->property_id = property_id;
-		item->is_blob = true;
-		item->value = length;
-		item->blob = data;
-
-		item->next = prev->next;
-		prev->next = item;
-
-		set->count_props++;
-		set->count_blobs++;
-	}
-
-	if (new_obj)
-		set->count_objs++;
-
-	return 0;
+	return drmModePropertySetInsert(set, object_id, property_id, true,
+					length, data);
 }
 
 void drmModePropertySetFree(drmModePropertySetPtr set)
 {
-	drmModePropertySetItemPtr item;
+	unsigned int i;
 
 	if (!set)
 		return;
 
-	item = set->list.next;
-
-	while (item) {
-		drmModePropertySetItemPtr next = item->next;
-
-		drmFree(item);
-
-		item = next;
+	for (i = 0; i < set->count_props; i++) {
+		drmModePropertySetDropBlob(set, &set->items[i]);
+		free(set->items[i].blob);
 	}
 
+	free(set->items);
+	drmFree(set->arena);
 	drmFree(set);
 }
 
+/*
+ * The atomic ioctl takes blob properties as blob ids, so blob items are
+ * turned into property blobs on their first commit. The ids are kept for
+ * later commits until the item's data changes or the set is freed.
+ */
 int drmModePropertySetCommit(int fd, uint32_t flags, void *user_data,
 			     drmModePropertySetPtr set)
 {
 	drmModePropertySetItemPtr item;
-	uint32_t *objs_ptr = NULL;
-	uint32_t *count_props_ptr = NULL;
-	uint32_t *props_ptr = NULL;
-	uint64_t *prop_values_ptr = NULL;
-	uint64_t *blob_values_ptr = NULL;
-	struct drm_mode_atomic atomic = { 0 };
+	uint32_t *objs_ptr;
+	uint32_t *count_props_ptr;
+	uint32_t *props_ptr;
+	uint64_t *prop_values_ptr;
+	struct drm_mode_atomic atomic;
 	unsigned int obj_idx = 0;
-	unsigned int prop_idx = 0;
-	unsigned int blob_idx = 0;
-	int ret = -1;
+	unsigned int i;
+	size_t size;
+	int ret;
 
 	if (!set)
 		return -1;
 
-	objs_ptr = drmMalloc(set->count_objs * sizeof objs_ptr[0]);
-	if (!objs_ptr) {
-		errno = ENOMEM;
-		goto out;
+	/* blob ids are only valid on the device they were created on */
+	if (fd != set->fd) {
+		for (i = 0; i < set->count_props; i++)
+			drmModePropertySetDropBlob(set, &set->items[i]);
+		set->fd = fd;
 	}
 
-	count_props_ptr = drmMalloc(set->count_objs * sizeof count_props_ptr[0]);
-	if (!count_props_ptr) {
-		errno = ENOMEM;
-		goto out;
-	}
+	size = set->count_props * sizeof(*prop_values_ptr) +
+	       (2 * set->count_objs + set->count_props) * sizeof(*objs_ptr);
 
-	props_ptr = drmMalloc(set->count_props * sizeof props_ptr[0]);
-	if (!props_ptr) {
-		errno = ENOMEM;
-		goto out;
-	}
+	if (size > set->size_arena) {
+		void *arena = drmMalloc(size);
 
-	prop_values_ptr = drmMalloc(set->count_props * sizeof prop_values_ptr[0]);
-	if (!prop_values_ptr) {
-		errno = ENOMEM;
-		goto out;
-	}
+		if (!arena) {
+			errno = ENOMEM;
+			return -1;
+		}
 
-	blob_values_ptr = drmMalloc(set->count_blobs * sizeof blob_values_ptr[0]);
-	if (!blob_values_ptr) {
-		errno = ENOMEM;
-		goto out;
+		drmFree(set->arena);
+		set->arena = arena;
+		set->size_arena = size;
 	}
 
-	item = set->list.next;
-
-	while (item) {
-		int count_props = 0;
-		drmModePropertySetItemPtr next = item;
+	/* 64 bit values first to keep them aligned */
+	prop_values_ptr = set->arena;
+	objs_ptr = (uint32_t *)(prop_values_ptr + set->count_props);
+	count_props_ptr = objs_ptr + set->count_objs;
+	props_ptr = count_props_ptr + set->count_objs;
 
-		objs_ptr[obj_idx] = item->object_id;
+	for (i = 0; i < set->count_props; i++) {
+		item = &set->items[i];
 
-		while (next && next->object_id == item->object_id) {
-			props_ptr[prop_idx] = next->property_id;
-			prop_values_ptr[prop_idx] = next->value;
-			prop_idx++;
+		if (i == 0 || item->object_id != item[-1].object_id) {
+			objs_ptr[obj_idx] = item->object_id;
+			count_props_ptr[obj_idx++] = 0;
+		}
 
-			if (next->is_blob)
-				blob_values_ptr[blob_idx++] = VOID2U64(next->blob);
+		count_props_ptr[obj_idx - 1]++;
+		props_ptr[i] = item->property_id;
 
-			count_props++;
+		if (item->is_blob) {
+			if (!item->blob_id) {
+				ret = drmModeCreatePropertyBlob(fd, item->blob,
+								item->value,
+								&item->blob_id);
+				if (ret)
+					return ret;
+			}
 
-			next = next->next;
+			prop_values_ptr[i] = item->blob_id;
+		} else {
+			prop_values_ptr[i] = item->value;
 		}
-
-		count_props_ptr[obj_idx++] = count_props;
-
-		item = next;
 	}
 
+	memclear(atomic);
 	atomic.count_objs = set->count_objs;
 	atomic.flags = flags;
 	atomic.objs_ptr = VOID2U64(objs_ptr);
 	atomic.count_props_ptr = VOID2U64(count_props_ptr);
 	atomic.props_ptr = VOID2U64(props_ptr);
 	atomic.prop_values_ptr = VOID2U64(prop_values_ptr);
-// TODO:
-//	atomic.blob_values_ptr = VOID2U64(blob_values_ptr);
 	atomic.user_data = VOID2U64(user_data);
 
-	ret = DRM_IOCTL(fd, DRM_IOCTL_MODE_ATOMIC, &atomic);
-
-out:
-	drmFree(objs_ptr);
-	drmFree(count_props_ptr);
-	drmFree(props_ptr);
-	drmFree(prop_values_ptr);
-
-	return ret;
+	return DRM_IOCTL(fd, DRM_IOCTL_MODE_ATOMIC, &atomic);
 }
 
 typedef struct _drmModeAtomicReqItem drmModeAtomicReqItem, *drmModeAtomicReqItemPtr;
@@ -1644,7 +1708,7 @@ int drmModeAtomicCommit(int fd, drmModeAtomicReqPtr req, uint32_t flags,
 	uint32_t *props_ptr = NULL;
 	uint64_t *prop_values_ptr = NULL;
 	uint32_t last_obj_id = 0;
-	uint32_t i;
+	uint32_t i, j;
 	int obj_idx = -1;
 	int ret = -1;
 
@@ -1664,24 +1728,26 @@ int drmModeAtomicCommit(int fd, drmModeAtomicReqPtr req, uint32_t flags,
 	qsort(sorted->items, sorted->cursor, sizeof(*sorted->items),
 	      sort_req_list);
 
-	/* Now the list is sorted, eliminate duplicate property sets. */
-	for (i = 0; i < sorted->cursor; i++) {
+	/*
+	 * Now the list is sorted, eliminate duplicate property sets in a single
+	 * pass, the last entry of a run of duplicates wins.
+	 */
+	for (i = 0, j = 0; i < sorted->cursor; i++) {
+		if (j > 0 &&
+		    sorted->items[j - 1].object_id == sorted->items[i].object_id &&
+		    sorted->items[j - 1].property_id == sorted->items[i].property_id) {
+			sorted->items[j - 1] = sorted->items[i];
+			continue;
+		}
+
 		if (sorted->items[i].object_id != last_obj_id) {
 			atomic.count_objs++;
 			last_obj_id = sorted->items[i].object_id;
 		}
 
-		if (i == sorted->cursor - 1)
-			continue;
-
-		if (sorted->items[i].object_id != sorted->items[i + 1].object_id ||
-		    sorted->items[i].property_id != sorted->items[i + 1].property_id)
-			continue;
-
-		memmove(&sorted->items[i], &sorted->items[i + 1],
-			(sorted->cursor - i - 1) * sizeof(*sorted->items));
-		sorted->cursor--;
+		sorted->items[j++] = sorted->items[i];
 	}
+	sorted->cursor = j;
 
 	objs_ptr = drmMalloc(atomic.count_objs * sizeof objs_ptr[0]);
 	if (!objs_ptr) {
@@ -1739,6 +1805,202 @@ out:
 	return ret;
 }
 
+/*
+ * A sorted atomic request keeps its properties in the layout expected by
+ * DRM_IOCTL_MODE_ATOMIC: object ids in ascending order, and the property ids
+ * and values of every object in ascending property id order. Adding a
+ * property that is already part of the request replaces its value, so a
+ * request built once can be committed over and over with updated values
+ * without sorting, copying or allocating anything.
+ */
+struct _drmModeAtomicSortedReq {
+	uint32_t count_objs;
+	uint32_t size_objs;
+	uint32_t count_props;
+	uint32_t size_props;
+	uint32_t *objs;
+	uint32_t *obj_props;	/* number of properties per object */
+	uint32_t *props;
+	uint64_t *prop_values;
+};
+
+drmModeAtomicSortedReqPtr drmModeAtomicSortedAlloc(void)
+{
+	return drmMalloc(sizeof(struct _drmModeAtomicSortedReq));
+}
+
+void drmModeAtomicSortedFree(drmModeAtomicSortedReqPtr req)
+{
+	if (!req)
+		return;
+
+	drmFree(req->objs);
+	drmFree(req->prop_values);
+	drmFree(req);
+}
+
+void drmModeAtomicSortedReset(drmModeAtomicSortedReqPtr req)
+{
+	if (!req)
+		return;
+
+	req->count_objs = 0;
+	req->count_props = 0;
+}
+
+int drmModeAtomicSortedGetCount(drmModeAtomicSortedReqPtr req)
+{
+	if (!req)
+		return -EINVAL;
+	return req->count_props;
+}
+
+/* objs and obj_props share one allocation */
+static int atomic_sorted_grow_objs(drmModeAtomicSortedReqPtr req)
+{
+	uint32_t size = req->size_objs ? req->size_objs * 2 : 16;
+	uint32_t *objs;
+
+	objs = drmMalloc(2 * size * sizeof(*objs));
+	if (!objs)
+		return -ENOMEM;
+
+	if (req->count_objs) {
+		memcpy(objs, req->objs, req->count_objs * sizeof(*objs));
+		memcpy(objs + size, req->obj_props,
+		       req->count_objs * sizeof(*objs));
+	}
+
+	drmFree(req->objs);
+	req->objs = objs;
+	req->obj_props = objs + size;
+	req->size_objs = size;
+
+	return 0;
+}
+
+/* prop_values and props share one allocation */
+static int atomic_sorted_grow_props(drmModeAtomicSortedReqPtr req)
+{
+	uint32_t size = req->size_props ? req->size_props * 2 : 64;
+	uint64_t *values;
+
+	values = drmMalloc(size * (sizeof(*req->prop_values) +
+				   sizeof(*req->props)));
+	if (!values)
+		return -ENOMEM;
+
+	if (req->count_props) {
+		memcpy(values, req->prop_values,
+		       req->count_props * sizeof(*values));
+		memcpy(values + size, req->props,
+		       req->count_props * sizeof(*req->props));
+	}
+
+	drmFree(req->prop_values);
+	req->prop_values = values;
+	req->props = (uint32_t *)(values + size);
+	req->size_props = size;
+
+	return 0;
+}
+
+int drmModeAtomicSortedAddProperty(drmModeAtomicSortedReqPtr req,
+				   uint32_t object_id,
+				   uint32_t property_id,
+				   uint64_t value)
+{
+	uint32_t lo, hi, mid, obj, start, end, i;
+	bool new_obj;
+
+	if (!req)
+		return -EINVAL;
+
+	lo = 0;
+	hi = req->count_objs;
+	while (lo < hi) {
+		mid = lo + (hi - lo) / 2;
+		if (req->objs[mid] < object_id)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	obj = lo;
+	new_obj = obj == req->count_objs || req->objs[obj] != object_id;
+
+	for (i = 0, start = 0; i < obj; i++)
+		start += req->obj_props[i];
+	end = new_obj ? start : start + req->obj_props[obj];
+
+	lo = start;
+	hi = end;
+	while (lo < hi) {
+		mid = lo + (hi - lo) / 2;
+		if (req->props[mid] < property_id)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	/* replace? */
+	if (lo < end && req->props[lo] == property_id) {
+		req->prop_values[lo] = value;
+		return 0;
+	}
+
+	if (req->count_props == req->size_props &&
+	    atomic_sorted_grow_props(req))
+		return -ENOMEM;
+
+	if (new_obj) {
+		if (req->count_objs == req->size_objs &&
+		    atomic_sorted_grow_objs(req))
+			return -ENOMEM;
+
+		memmove(&req->objs[obj + 1], &req->objs[obj],
+			(req->count_objs - obj) * sizeof(*req->objs));
+		memmove(&req->obj_props[obj + 1], &req->obj_props[obj],
+			(req->count_objs - obj) * sizeof(*req->obj_props));
+		req->objs[obj] = object_id;
+		req->obj_props[obj] = 0;
+		req->count_objs++;
+	}
+
+	memmove(&req->props[lo + 1], &req->props[lo],
+		(req->count_props - lo) * sizeof(*req->props));
+	memmove(&req->prop_values[lo + 1], &req->prop_values[lo],
+		(req->count_props - lo) * sizeof(*req->prop_values));
+	req->props[lo] = property_id;
+	req->prop_values[lo] = value;
+	req->obj_props[obj]++;
+	req->count_props++;
+
+	return 0;
+}
+
+int drmModeAtomicSortedCommit(int fd, drmModeAtomicSortedReqPtr req,
+			      uint32_t flags, void *user_data)
+{
+	struct drm_mode_atomic atomic;
+
+	if (!req)
+		return -EINVAL;
+
+	if (req->count_props == 0)
+		return 0;
+
+	memclear(atomic);
+	atomic.flags = flags;
+	atomic.count_objs = req->count_objs;
+	atomic.objs_ptr = VOID2U64(req->objs);
+	atomic.count_props_ptr = VOID2U64(req->obj_props);
+	atomic.props_ptr = VOID2U64(req->props);
+	atomic.prop_values_ptr = VOID2U64(req->prop_values);
+	atomic.user_data = VOID2U64(user_data);
+
+	return DRM_IOCTL(fd, DRM_IOCTL_MODE_ATOMIC, &atomic);
+}
+
 int
 drmModeCreatePropertyBlob(int fd, const void *data, size_t length, uint32_t *id)
 {
@@ -1772,3 +2034,2342 @@ drmModeDestroyPropertyBlob(int fd, uint32_t id)
 	destroy.blob_id = id;
 	return DRM_IOCTL(fd, DRM_IOCTL_MODE_DESTROYPROPBLOB, &destroy);
 }
+
+/*
+ * Property cache: remembers the properties attached to every KMS object it
+ * has been asked about, so that looking up a property id by name costs a
+ * hash lookup instead of a drmModeObjectGetProperties() and a
+ * drmModeGetProperty() per property of the object.
+ *
+ * Entries are keyed by object type, object id and name rather than by type
+ * and name alone, because drivers are free to create per-object properties
+ * with a shared name (zpos on planes being the usual example). Property
+ * metadata is shared between all objects the property is attached to.
+ */
+typedef struct _drmModePropertyCacheEntry drmModePropertyCacheEntry,
+	*drmModePropertyCacheEntryPtr;
+
+struct _drmModePropertyCacheEntry {
+	drmModePropertyCacheEntryPtr next;	/* hash collisions */
+	uint32_t object_type;
+	uint32_t object_id;
+	drmModePropertyPtr prop;
+};
+
+struct _drmModePropertyCache {
+	int fd;
+	void *props;	/* prop id -> drmModePropertyPtr */
+	void *names;	/* name key -> drmModePropertyCacheEntryPtr chain */
+	void *objects;	/* object id -> object type, for filled objects */
+};
+
+static unsigned long property_cache_key(uint32_t object_id, const char *name)
+{
+	uint32_t hash = 2166136261U;	/* FNV-1a */
+
+	while (*name) {
+		hash ^= (unsigned char)*name++;
+		hash *= 16777619U;
+	}
+
+	return hash ^ (object_id * 2654435761U);
+}
+
+static int property_cache_init(drmModePropertyCachePtr cache)
+{
+	cache->props = drmHashCreate();
+	cache->names = drmHashCreate();
+	cache->objects = drmHashCreate();
+
+	if (!cache->props || !cache->names || !cache->objects)
+		return -ENOMEM;
+
+	return 0;
+}
+
+static void property_cache_fini(drmModePropertyCachePtr cache)
+{
+	unsigned long key;
+	void *value;
+
+	if (cache->names) {
+		if (drmHashFirst(cache->names, &key, &value)) {
+			do {
+				drmModePropertyCacheEntryPtr entry = value;
+
+				while (entry) {
+					drmModePropertyCacheEntryPtr next = entry->next;
+
+					drmFree(entry);
+					entry = next;
+				}
+			} while (drmHashNext(cache->names, &key, &value));
+		}
+		drmHashDestroy(cache->names);
+	}
+
+	if (cache->props) {
+		if (drmHashFirst(cache->props, &key, &value)) {
+			do {
+				drmModeFreeProperty(value);
+			} while (drmHashNext(cache->props, &key, &value));
+		}
+		drmHashDestroy(cache->props);
+	}
+
+	if (cache->objects)
+		drmHashDestroy(cache->objects);
+
+	cache->props = NULL;
+	cache->names = NULL;
+	cache->objects = NULL;
+}
+
+drmModePropertyCachePtr drmModePropertyCacheCreate(int fd)
+{
+	drmModePropertyCachePtr cache;
+
+	cache = drmMalloc(sizeof *cache);
+	if (!cache)
+		return NULL;
+
+	cache->fd = fd;
+
+	if (property_cache_init(cache)) {
+		property_cache_fini(cache);
+		drmFree(cache);
+		return NULL;
+	}
+
+	return cache;
+}
+
+void drmModePropertyCacheDestroy(drmModePropertyCachePtr cache)
+{
+	if (!cache)
+		return;
+
+	property_cache_fini(cache);
+	drmFree(cache);
+}
+
+int drmModePropertyCacheInvalidate(drmModePropertyCachePtr cache)
+{
+	if (!cache)
+		return -EINVAL;
+
+	property_cache_fini(cache);
+
+	return property_cache_init(cache);
+}
+
+drmModePropertyPtr drmModePropertyCacheGetProperty(drmModePropertyCachePtr cache,
+						   uint32_t property_id)
+{
+	drmModePropertyPtr prop;
+	void *value;
+
+	if (!cache || !cache->props)
+		return NULL;
+
+	if (!drmHashLookup(cache->props, property_id, &value))
+		return value;
+
+	prop = drmModeGetProperty(cache->fd, property_id);
+	if (!prop)
+		return NULL;
+
+	if (drmHashInsert(cache->props, property_id, prop)) {
+		drmModeFreeProperty(prop);
+		errno = ENOMEM;
+		return NULL;
+	}
+
+	return prop;
+}
+
+/*
+ * Remove the entry of an object from the chain of key, used to undo a
+ * partial fill.
+ */
+static void property_cache_unlink(drmModePropertyCachePtr cache,
+				  unsigned long key, uint32_t object_id,
+				  uint32_t object_type)
+{
+	drmModePropertyCacheEntryPtr entry, head, *link;
+	void *value;
+
+	if (drmHashLookup(cache->names, key, &value))
+		return;
+
+	head = value;
+	for (link = &head; (entry = *link); link = &entry->next) {
+		if (entry->object_id == object_id &&
+		    entry->object_type == object_type) {
+			*link = entry->next;
+			drmFree(entry);
+			break;
+		}
+	}
+
+	if (head == value)
+		return;
+
+	drmHashDelete(cache->names, key);
+	if (head)
+		drmHashInsert(cache->names, key, head);
+}
+
+static int property_cache_fill(drmModePropertyCachePtr cache,
+			       uint32_t object_id, uint32_t object_type)
+{
+	drmModeObjectPropertiesPtr props;
+	uint32_t i, count_props;
+
+	props = drmModeObjectGetProperties(cache->fd, object_id, object_type);
+	if (!props)
+		return -errno;
+
+	count_props = props->count_props;
+
+	for (i = 0; i < count_props; i++) {
+		drmModePropertyCacheEntryPtr entry, head;
+		unsigned long key;
+		void *value;
+
+		entry = drmMalloc(sizeof *entry);
+		if (!entry)
+			goto fail;
+
+		entry->prop = drmModePropertyCacheGetProperty(cache,
+							      props->props[i]);
+		if (!entry->prop) {
+			drmFree(entry);
+			if (errno == ENOMEM)
+				goto fail;
+			continue;
+		}
+
+		entry->object_type = object_type;
+		entry->object_id = object_id;
+
+		key = property_cache_key(object_id, entry->prop->name);
+		if (drmHashLookup(cache->names, key, &value)) {
+			entry->next = NULL;
+			if (drmHashInsert(cache->names, key, entry)) {
+				drmFree(entry);
+				goto fail;
+			}
+		} else {
+			head = value;
+			entry->next = head->next;
+			head->next = entry;
+		}
+	}
+
+	if (drmHashInsert(cache->objects, object_id, U642VOID(object_type + 1)))
+		goto fail;
+
+	drmModeFreeObjectProperties(props);
+
+	return 0;
+
+fail:
+	/*
+	 * The object is not marked as filled, so drop the entries linked so
+	 * far or the next lookup would link them a second time.
+	 */
+	count_props = i;
+	for (i = 0; i < count_props; i++) {
+		void *value;
+
+		if (drmHashLookup(cache->props, props->props[i], &value))
+			continue;
+
+		property_cache_unlink(cache,
+			property_cache_key(object_id,
+					   ((drmModePropertyPtr)value)->name),
+			object_id, object_type);
+	}
+	drmModeFreeObjectProperties(props);
+
+	return -ENOMEM;
+}
+
+drmModePropertyPtr drmModePropertyCacheFind(drmModePropertyCachePtr cache,
+					    uint32_t object_id,
+					    uint32_t object_type,
+					    const char *name)
+{
+	drmModePropertyCacheEntryPtr entry;
+	void *value;
+
+	if (!cache || !cache->objects || !name)
+		return NULL;
+
+	if (drmHashLookup(cache->objects, object_id, &value) &&
+	    property_cache_fill(cache, object_id, object_type))
+		return NULL;
+
+	if (drmHashLookup(cache->names,
+			  property_cache_key(object_id, name), &value))
+		return NULL;
+
+	for (entry = value; entry; entry = entry->next) {
+		if (entry->object_id == object_id &&
+		    entry->object_type == object_type &&
+		    !strcmp(entry->prop->name, name))
+			return entry->prop;
+	}
+
+	return NULL;
+}
+
+uint32_t drmModePropertyCacheGetId(drmModePropertyCachePtr cache,
+				   uint32_t object_id, uint32_t object_type,
+				   const char *name)
+{
+	drmModePropertyPtr prop;
+
+	prop = drmModePropertyCacheFind(cache, object_id, object_type, name);
+
+	return prop ? prop->prop_id : 0;
+}
+
+/*
+ * KMS state snapshots.
+ *
+ * drmModeGetSnapshot() reads the resources, connectors, encoders, crtcs,
+ * planes and the crtc and plane properties into a single allocation. The
+ * ioctls are handed buffers large enough for typical hardware, so every
+ * object normally costs exactly one ioctl, and the buffers are only grown
+ * and the ioctl repeated when the kernel reports more entries.
+ *
+ * While the snapshot is being built the allocation may move, so all
+ * pointers inside it hold offsets from its start until snapshot_fixup()
+ * turns them into real pointers at the very end.
+ */
+struct snapshot_arena {
+	char *base;
+	size_t size;
+	size_t used;
+};
+
+#define SNAPSHOT(arena)			((drmModeSnapshotPtr)(arena)->base)
+#define SNAPSHOT_PTR(arena, offset)	((void *)((arena)->base + (uintptr_t)(offset)))
+#define SNAPSHOT_OFF(offset)		((void *)(uintptr_t)(offset))
+
+static uint32_t snapshot_max(uint32_t a, uint32_t b)
+{
+	return a > b ? a : b;
+}
+
+static int snapshot_reserve(struct snapshot_arena *arena, size_t size,
+			    size_t *offset)
+{
+	size_t start = (arena->used + 7) & ~(size_t)7;
+
+	if (start + size > arena->size) {
+		size_t new_size = arena->size ? arena->size : 16384;
+		char *base;
+
+		while (start + size > new_size)
+			new_size *= 2;
+
+		base = realloc(arena->base, new_size);
+		if (!base)
+			return -ENOMEM;
+
+		memset(base + arena->size, 0, new_size - arena->size);
+		arena->base = base;
+		arena->size = new_size;
+	}
+
+	*offset = start;
+	arena->used = start + size;
+
+	return 0;
+}
+
+static int snapshot_get_resources(int fd, struct snapshot_arena *arena)
+{
+	uint32_t count_fbs = 32, count_crtcs = 8;
+	uint32_t count_connectors = 16, count_encoders = 16;
+	size_t mark = arena->used, fbs, crtcs, connectors, encoders;
+	struct drm_mode_card_res res;
+	drmModeResPtr r;
+
+	for (;;) {
+		arena->used = mark;
+		if (snapshot_reserve(arena, count_fbs * sizeof(uint32_t), &fbs) ||
+		    snapshot_reserve(arena, count_crtcs * sizeof(uint32_t), &crtcs) ||
+		    snapshot_reserve(arena, count_connectors * sizeof(uint32_t),
+				     &connectors) ||
+		    snapshot_reserve(arena, count_encoders * sizeof(uint32_t),
+				     &encoders))
+			return -ENOMEM;
+
+		memclear(res);
+		res.count_fbs = count_fbs;
+		res.count_crtcs = count_crtcs;
+		res.count_connectors = count_connectors;
+		res.count_encoders = count_encoders;
+		res.fb_id_ptr = VOID2U64(SNAPSHOT_PTR(arena, fbs));
+		res.crtc_id_ptr = VOID2U64(SNAPSHOT_PTR(arena, crtcs));
+		res.connector_id_ptr = VOID2U64(SNAPSHOT_PTR(arena, connectors));
+		res.encoder_id_ptr = VOID2U64(SNAPSHOT_PTR(arena, encoders));
+
+		if (drmIoctl(fd, DRM_IOCTL_MODE_GETRESOURCES, &res))
+			return -errno;
+
+		if (res.count_fbs <= count_fbs &&
+		    res.count_crtcs <= count_crtcs &&
+		    res.count_connectors <= count_connectors &&
+		    res.count_encoders <= count_encoders)
+			break;
+
+		count_fbs = snapshot_max(count_fbs, res.count_fbs);
+		count_crtcs = snapshot_max(count_crtcs, res.count_crtcs);
+		count_connectors = snapshot_max(count_connectors,
+						res.count_connectors);
+		count_encoders = snapshot_max(count_encoders, res.count_encoders);
+	}
+
+	r = &SNAPSHOT(arena)->resources;
+	r->count_fbs = res.count_fbs;
+	r->fbs = SNAPSHOT_OFF(fbs);
+	r->count_crtcs = res.count_crtcs;
+	r->crtcs = SNAPSHOT_OFF(crtcs);
+	r->count_connectors = res.count_connectors;
+	r->connectors = SNAPSHOT_OFF(connectors);
+	r->count_encoders = res.count_encoders;
+	r->encoders = SNAPSHOT_OFF(encoders);
+	r->min_width = res.min_width;
+	r->max_width = res.max_width;
+	r->min_height = res.min_height;
+	r->max_height = res.max_height;
+
+	return 0;
+}
+
+static int snapshot_get_plane_ids(int fd, struct snapshot_arena *arena,
+				  size_t *planes, uint32_t *count)
+{
+	uint32_t count_planes = 32;
+	size_t mark = arena->used;
+	struct drm_mode_get_plane_res res;
+
+	for (;;) {
+		arena->used = mark;
+		if (snapshot_reserve(arena, count_planes * sizeof(uint32_t),
+				     planes))
+			return -ENOMEM;
+
+		memclear(res);
+		res.count_planes = count_planes;
+		res.plane_id_ptr = VOID2U64(SNAPSHOT_PTR(arena, *planes));
+
+		if (drmIoctl(fd, DRM_IOCTL_MODE_GETPLANERESOURCES, &res))
+			return -errno;
+
+		if (res.count_planes <= count_planes)
+			break;
+
+		count_planes = res.count_planes;
+	}
+
+	*count = res.count_planes;
+
+	return 0;
+}
+
+/*
+ * The hint holds the largest mode, property and encoder counts seen so far,
+ * objects of one kind tend to look alike and start out with buffers large
+ * enough for their predecessors.
+ */
+struct snapshot_hint {
+	uint32_t count_modes;
+	uint32_t count_props;
+	uint32_t count_encoders;
+	uint32_t count_formats;
+};
+
+static int snapshot_get_connector(int fd, struct snapshot_arena *arena,
+				  size_t offset, uint32_t connector_id,
+				  int probe, struct snapshot_hint *hint)
+{
+	uint32_t count_modes = hint->count_modes;
+	uint32_t count_props = hint->count_props;
+	uint32_t count_encoders = hint->count_encoders;
+	struct drm_mode_get_connector conn;
+	size_t mark, values, props, encoders, modes;
+	drmModeConnectorPtr r;
+
+	/* a zero mode count is what makes the kernel probe the connector */
+	if (probe) {
+		memclear(conn);
+		conn.connector_id = connector_id;
+
+		if (drmIoctl(fd, DRM_IOCTL_MODE_GETCONNECTOR, &conn))
+			return -errno;
+
+		count_modes = snapshot_max(conn.count_modes, 1);
+		count_props = conn.count_props;
+		count_encoders = conn.count_encoders;
+	}
+
+	mark = arena->used;
+	for (;;) {
+		arena->used = mark;
+		if (snapshot_reserve(arena, count_props * sizeof(uint64_t),
+				     &values) ||
+		    snapshot_reserve(arena, count_props * sizeof(uint32_t),
+				     &props) ||
+		    snapshot_reserve(arena, count_encoders * sizeof(uint32_t),
+				     &encoders) ||
+		    snapshot_reserve(arena, count_modes *
+				     sizeof(struct drm_mode_modeinfo), &modes))
+			return -ENOMEM;
+
+		memclear(conn);
+		conn.connector_id = connector_id;
+		conn.count_modes = count_modes;
+		conn.count_props = count_props;
+		conn.count_encoders = count_encoders;
+		conn.modes_ptr = VOID2U64(SNAPSHOT_PTR(arena, modes));
+		conn.props_ptr = VOID2U64(SNAPSHOT_PTR(arena, props));
+		conn.prop_values_ptr = VOID2U64(SNAPSHOT_PTR(arena, values));
+		conn.encoders_ptr = VOID2U64(SNAPSHOT_PTR(arena, encoders));
+
+		if (drmIoctl(fd, DRM_IOCTL_MODE_GETCONNECTOR, &conn))
+			return -errno;
+
+		if (conn.count_modes <= count_modes &&
+		    conn.count_props <= count_props &&
+		    conn.count_encoders <= count_encoders)
+			break;
+
+		count_modes = snapshot_max(count_modes, conn.count_modes);
+		count_props = snapshot_max(count_props, conn.count_props);
+		count_encoders = snapshot_max(count_encoders,
+					      conn.count_encoders);
+	}
+
+	hint->count_modes = count_modes;
+	hint->count_props = count_props;
+	hint->count_encoders = count_encoders;
+
+	/* pack the arrays, dropping the unused part of every buffer */
+	memmove(SNAPSHOT_PTR(arena, values + conn.count_props * sizeof(uint64_t)),
+		SNAPSHOT_PTR(arena, props), conn.count_props * sizeof(uint32_t));
+	props = values + conn.count_props * sizeof(uint64_t);
+
+	memmove(SNAPSHOT_PTR(arena, props + conn.count_props * sizeof(uint32_t)),
+		SNAPSHOT_PTR(arena, encoders),
+		conn.count_encoders * sizeof(uint32_t));
+	encoders = props + conn.count_props * sizeof(uint32_t);
+
+	memmove(SNAPSHOT_PTR(arena, encoders +
+			     conn.count_encoders * sizeof(uint32_t)),
+		SNAPSHOT_PTR(arena, modes),
+		conn.count_modes * sizeof(struct drm_mode_modeinfo));
+	modes = encoders + conn.count_encoders * sizeof(uint32_t);
+
+	arena->used = modes + conn.count_modes * sizeof(struct drm_mode_modeinfo);
+
+	r = SNAPSHOT_PTR(arena, offset);
+	r->connector_id = conn.connector_id;
+	r->encoder_id = conn.encoder_id;
+	r->connection = conn.connection;
+	r->mmWidth = conn.mm_width;
+	r->mmHeight = conn.mm_height;
+	/* convert subpixel from kernel to userspace */
+	r->subpixel = conn.subpixel + 1;
+	r->count_modes = conn.count_modes;
+	r->modes = SNAPSHOT_OFF(modes);
+	r->count_props = conn.count_props;
+	r->props = SNAPSHOT_OFF(props);
+	r->prop_values = SNAPSHOT_OFF(values);
+	r->count_encoders = conn.count_encoders;
+	r->encoders = SNAPSHOT_OFF(encoders);
+	r->connector_type = conn.connector_type;
+	r->connector_type_id = conn.connector_type_id;
+
+	return 0;
+}
+
+static int snapshot_get_encoder(int fd, struct snapshot_arena *arena,
+				size_t offset, uint32_t encoder_id)
+{
+	struct drm_mode_get_encoder enc;
+	drmModeEncoderPtr r;
+
+	memclear(enc);
+	enc.encoder_id = encoder_id;
+
+	if (drmIoctl(fd, DRM_IOCTL_MODE_GETENCODER, &enc))
+		return -errno;
+
+	r = SNAPSHOT_PTR(arena, offset);
+	r->encoder_id = enc.encoder_id;
+	r->crtc_id = enc.crtc_id;
+	r->encoder_type = enc.encoder_type;
+	r->possible_crtcs = enc.possible_crtcs;
+	r->possible_clones = enc.possible_clones;
+
+	return 0;
+}
+
+static int snapshot_get_crtc(int fd, struct snapshot_arena *arena,
+			     size_t offset, uint32_t crtc_id)
+{
+	struct drm_mode_crtc crtc;
+	drmModeCrtcPtr r;
+
+	memclear(crtc);
+	crtc.crtc_id = crtc_id;
+
+	if (drmIoctl(fd, DRM_IOCTL_MODE_GETCRTC, &crtc))
+		return -errno;
+
+	r = SNAPSHOT_PTR(arena, offset);
+	r->crtc_id = crtc.crtc_id;
+	r->x = crtc.x;
+	r->y = crtc.y;
+	r->mode_valid = crtc.mode_valid;
+	if (r->mode_valid) {
+		memcpy(&r->mode, &crtc.mode, sizeof(struct drm_mode_modeinfo));
+		r->width = crtc.mode.hdisplay;
+		r->height = crtc.mode.vdisplay;
+	}
+	r->buffer_id = crtc.fb_id;
+	r->gamma_size = crtc.gamma_size;
+
+	return 0;
+}
+
+static int snapshot_get_plane(int fd, struct snapshot_arena *arena,
+			      size_t offset, uint32_t plane_id,
+			      struct snapshot_hint *hint)
+{
+	uint32_t count_formats = hint->count_formats;
+	struct drm_mode_get_plane ovr;
+	size_t mark = arena->used, formats;
+	drmModePlanePtr r;
+
+	for (;;) {
+		arena->used = mark;
+		if (snapshot_reserve(arena, count_formats * sizeof(uint32_t),
+				     &formats))
+			return -ENOMEM;
+
+		memclear(ovr);
+		ovr.plane_id = plane_id;
+		ovr.count_format_types = count_formats;
+		ovr.format_type_ptr = VOID2U64(SNAPSHOT_PTR(arena, formats));
+
+		if (drmIoctl(fd, DRM_IOCTL_MODE_GETPLANE, &ovr))
+			return -errno;
+
+		if (ovr.count_format_types <= count_formats)
+			break;
+
+		count_formats = ovr.count_format_types;
+	}
+
+	hint->count_formats = count_formats;
+
+	arena->used = formats + ovr.count_format_types * sizeof(uint32_t);
+
+	r = SNAPSHOT_PTR(arena, offset);
+	r->plane_id = ovr.plane_id;
+	r->crtc_id = ovr.crtc_id;
+	r->fb_id = ovr.fb_id;
+	r->possible_crtcs = ovr.possible_crtcs;
+	r->gamma_size = ovr.gamma_size;
+	r->count_formats = ovr.count_format_types;
+	r->formats = SNAPSHOT_OFF(formats);
+
+	return 0;
+}
+
+static int snapshot_get_properties(int fd, struct snapshot_arena *arena,
+				   size_t offset, uint32_t object_id,
+				   uint32_t object_type,
+				   struct snapshot_hint *hint)
+{
+	uint32_t count_props = hint->count_props;
+	struct drm_mode_obj_get_properties properties;
+	size_t mark = arena->used, values, props;
+	drmModeObjectPropertiesPtr r;
+
+	for (;;) {
+		arena->used = mark;
+		if (snapshot_reserve(arena, count_props * sizeof(uint64_t),
+				     &values) ||
+		    snapshot_reserve(arena, count_props * sizeof(uint32_t),
+				     &props))
+			return -ENOMEM;
+
+		memclear(properties);
+		properties.obj_id = object_id;
+		properties.obj_type = object_type;
+		properties.count_props = count_props;
+		properties.props_ptr = VOID2U64(SNAPSHOT_PTR(arena, props));
+		properties.prop_values_ptr = VOID2U64(SNAPSHOT_PTR(arena, values));
+
+		if (drmIoctl(fd, DRM_IOCTL_MODE_OBJ_GETPROPERTIES, &properties))
+			return -errno;
+
+		if (properties.count_props <= count_props)
+			break;
+
+		count_props = properties.count_props;
+	}
+
+	hint->count_props = count_props;
+
+	memmove(SNAPSHOT_PTR(arena, values +
+			     properties.count_props * sizeof(uint64_t)),
+		SNAPSHOT_PTR(arena, props),
+		properties.count_props * sizeof(uint32_t));
+	props = values + properties.count_props * sizeof(uint64_t);
+	arena->used = props + properties.count_props * sizeof(uint32_t);
+
+	r = SNAPSHOT_PTR(arena, offset);
+	r->count_props = properties.count_props;
+	r->props = SNAPSHOT_OFF(props);
+	r->prop_values = SNAPSHOT_OFF(values);
+
+	return 0;
+}
+
+#define SNAPSHOT_FIXUP(base, ptr)	((ptr) = (void *)((base) + (uintptr_t)(ptr)))
+
+static void snapshot_fixup(drmModeSnapshotPtr s)
+{
+	char *base = (char *)s;
+	uint32_t i;
+
+	SNAPSHOT_FIXUP(base, s->resources.fbs);
+	SNAPSHOT_FIXUP(base, s->resources.crtcs);
+	SNAPSHOT_FIXUP(base, s->resources.connectors);
+	SNAPSHOT_FIXUP(base, s->resources.encoders);
+	SNAPSHOT_FIXUP(base, s->connectors);
+	SNAPSHOT_FIXUP(base, s->encoders);
+	SNAPSHOT_FIXUP(base, s->crtcs);
+	SNAPSHOT_FIXUP(base, s->crtc_props);
+	SNAPSHOT_FIXUP(base, s->planes);
+	SNAPSHOT_FIXUP(base, s->plane_props);
+
+	for (i = 0; i < (uint32_t)s->resources.count_connectors; i++) {
+		SNAPSHOT_FIXUP(base, s->connectors[i].modes);
+		SNAPSHOT_FIXUP(base, s->connectors[i].props);
+		SNAPSHOT_FIXUP(base, s->connectors[i].prop_values);
+		SNAPSHOT_FIXUP(base, s->connectors[i].encoders);
+	}
+
+	for (i = 0; i < (uint32_t)s->resources.count_crtcs; i++) {
+		SNAPSHOT_FIXUP(base, s->crtc_props[i].props);
+		SNAPSHOT_FIXUP(base, s->crtc_props[i].prop_values);
+	}
+
+	for (i = 0; i < s->count_planes; i++) {
+		SNAPSHOT_FIXUP(base, s->planes[i].formats);
+		SNAPSHOT_FIXUP(base, s->plane_props[i].props);
+		SNAPSHOT_FIXUP(base, s->plane_props[i].prop_values);
+	}
+}
+
+drmModeSnapshotPtr drmModeGetSnapshot(int fd, uint32_t flags)
+{
+	struct snapshot_arena arena = { NULL, 0, 0 };
+	struct snapshot_hint connector_hint = { 16, 32, 4, 0 };
+	struct snapshot_hint crtc_hint = { 0, 16, 0, 0 };
+	struct snapshot_hint plane_hint = { 0, 32, 0, 32 };
+	size_t header, plane_ids, connectors, encoders, crtcs, crtc_props;
+	size_t planes, plane_props;
+	uint32_t *ids;
+	uint32_t count_connectors, count_encoders, count_crtcs, count_planes = 0;
+	uint32_t i;
+	int ret;
+
+	if (flags & ~DRM_MODE_SNAPSHOT_PROBE) {
+		errno = EINVAL;
+		return NULL;
+	}
+
+	ret = snapshot_reserve(&arena, sizeof(drmModeSnapshot), &header);
+	if (ret)
+		goto err;
+
+	ret = snapshot_get_resources(fd, &arena);
+	if (ret)
+		goto err;
+
+	ret = snapshot_get_plane_ids(fd, &arena, &plane_ids, &count_planes);
+	if (ret)
+		goto err;
+
+	count_connectors = SNAPSHOT(&arena)->resources.count_connectors;
+	count_encoders = SNAPSHOT(&arena)->resources.count_encoders;
+	count_crtcs = SNAPSHOT(&arena)->resources.count_crtcs;
+
+	if (snapshot_reserve(&arena, count_connectors * sizeof(drmModeConnector),
+			     &connectors) ||
+	    snapshot_reserve(&arena, count_encoders * sizeof(drmModeEncoder),
+			     &encoders) ||
+	    snapshot_reserve(&arena, count_crtcs * sizeof(drmModeCrtc),
+			     &crtcs) ||
+	    snapshot_reserve(&arena, count_crtcs *
+			     sizeof(drmModeObjectProperties), &crtc_props) ||
+	    snapshot_reserve(&arena, count_planes * sizeof(drmModePlane),
+			     &planes) ||
+	    snapshot_reserve(&arena, count_planes *
+			     sizeof(drmModeObjectProperties), &plane_props)) {
+		ret = -ENOMEM;
+		goto err;
+	}
+
+	SNAPSHOT(&arena)->connectors = SNAPSHOT_OFF(connectors);
+	SNAPSHOT(&arena)->encoders = SNAPSHOT_OFF(encoders);
+	SNAPSHOT(&arena)->crtcs = SNAPSHOT_OFF(crtcs);
+	SNAPSHOT(&arena)->crtc_props = SNAPSHOT_OFF(crtc_props);
+	SNAPSHOT(&arena)->count_planes = count_planes;
+	SNAPSHOT(&arena)->planes = SNAPSHOT_OFF(planes);
+	SNAPSHOT(&arena)->plane_props = SNAPSHOT_OFF(plane_props);
+
+	/* every object may grow the arena, so the id arrays are looked up again */
+	for (i = 0; i < count_connectors; i++) {
+		ids = SNAPSHOT_PTR(&arena, SNAPSHOT(&arena)->resources.connectors);
+		ret = snapshot_get_connector(fd, &arena, connectors +
+					     i * sizeof(drmModeConnector), ids[i],
+					     flags & DRM_MODE_SNAPSHOT_PROBE,
+					     &connector_hint);
+		if (ret)
+			goto err;
+	}
+
+	for (i = 0; i < count_encoders; i++) {
+		ids = SNAPSHOT_PTR(&arena, SNAPSHOT(&arena)->resources.encoders);
+		ret = snapshot_get_encoder(fd, &arena, encoders +
+					   i * sizeof(drmModeEncoder), ids[i]);
+		if (ret)
+			goto err;
+	}
+
+	for (i = 0; i < count_crtcs; i++) {
+		ids = SNAPSHOT_PTR(&arena, SNAPSHOT(&arena)->resources.crtcs);
+		ret = snapshot_get_crtc(fd, &arena, crtcs +
+					i * sizeof(drmModeCrtc), ids[i]);
+		if (ret)
+			goto err;
+
+		ids = SNAPSHOT_PTR(&arena, SNAPSHOT(&arena)->resources.crtcs);
+		ret = snapshot_get_properties(fd, &arena, crtc_props +
+					      i * sizeof(drmModeObjectProperties),
+					      ids[i], DRM_MODE_OBJECT_CRTC,
+					      &crtc_hint);
+		if (ret)
+			goto err;
+	}
+
+	for (i = 0; i < count_planes; i++) {
+		ids = SNAPSHOT_PTR(&arena, plane_ids);
+		ret = snapshot_get_plane(fd, &arena, planes +
+					 i * sizeof(drmModePlane), ids[i],
+					 &plane_hint);
+		if (ret)
+			goto err;
+
+		ids = SNAPSHOT_PTR(&arena, plane_ids);
+		ret = snapshot_get_properties(fd, &arena, plane_props +
+					      i * sizeof(drmModeObjectProperties),
+					      ids[i], DRM_MODE_OBJECT_PLANE,
+					      &plane_hint);
+		if (ret)
+			goto err;
+	}
+
+	snapshot_fixup(SNAPSHOT(&arena));
+
+	return SNAPSHOT(&arena);
+
+err:
+	free(arena.base);
+	errno = -ret;
+	return NULL;
+}
+
+void drmModeFreeSnapshot(drmModeSnapshotPtr snapshot)
+{
+	free(snapshot);
+}
+
+/*
+ * Hotplug state tracking.
+ *
+ * drmModeGetConnector() probes the connector, which may mean reading the
+ * EDID over DDC, so re-reading every connector on each hotplug uevent is
+ * expensive. The kernel already runs detection before it sends the uevent,
+ * and the current connection status, EDID blob and link-status property
+ * are available without probing. The tracker compares those against the
+ * previous refresh and only probes the connectors where one of them moved.
+ */
+typedef struct _drmModeTrackedConnector {
+	uint32_t connector_id;
+	drmModeConnectorPtr connector;
+	uint64_t edid;
+	uint64_t link_status;
+} drmModeTrackedConnector, *drmModeTrackedConnectorPtr;
+
+struct _drmModeStateTracker {
+	int fd;
+	drmModePropertyCachePtr props;
+	uint32_t count_connectors;
+	drmModeTrackedConnectorPtr connectors;
+};
+
+drmModeStateTrackerPtr drmModeStateTrackerCreate(int fd)
+{
+	drmModeStateTrackerPtr tracker;
+
+	tracker = drmMalloc(sizeof *tracker);
+	if (!tracker)
+		return NULL;
+
+	tracker->props = drmModePropertyCacheCreate(fd);
+	if (!tracker->props) {
+		drmFree(tracker);
+		return NULL;
+	}
+
+	tracker->fd = fd;
+
+	return tracker;
+}
+
+void drmModeStateTrackerDestroy(drmModeStateTrackerPtr tracker)
+{
+	uint32_t i;
+
+	if (!tracker)
+		return;
+
+	for (i = 0; i < tracker->count_connectors; i++)
+		drmModeFreeConnector(tracker->connectors[i].connector);
+
+	drmFree(tracker->connectors);
+	drmModePropertyCacheDestroy(tracker->props);
+	drmFree(tracker);
+}
+
+static drmModeTrackedConnectorPtr
+state_tracker_find(drmModeTrackedConnectorPtr connectors, uint32_t count,
+		   uint32_t connector_id)
+{
+	uint32_t i;
+
+	for (i = 0; i < count; i++)
+		if (connectors[i].connector_id == connector_id)
+			return &connectors[i];
+
+	return NULL;
+}
+
+drmModeConnectorPtr
+drmModeStateTrackerGetConnector(drmModeStateTrackerPtr tracker,
+				uint32_t connector_id)
+{
+	drmModeTrackedConnectorPtr tracked;
+
+	if (!tracker)
+		return NULL;
+
+	tracked = state_tracker_find(tracker->connectors,
+				     tracker->count_connectors, connector_id);
+
+	return tracked ? tracked->connector : NULL;
+}
+
+static void state_tracker_read_props(drmModeStateTrackerPtr tracker,
+				     drmModeTrackedConnectorPtr tracked)
+{
+	drmModeConnectorPtr connector = tracked->connector;
+	drmModePropertyPtr prop;
+	int i;
+
+	tracked->edid = 0;
+	tracked->link_status = 0;
+
+	for (i = 0; i < connector->count_props; i++) {
+		prop = drmModePropertyCacheGetProperty(tracker->props,
+						       connector->props[i]);
+		if (!prop)
+			continue;
+
+		if (!strcmp(prop->name, "EDID"))
+			tracked->edid = connector->prop_values[i];
+		else if (!strcmp(prop->name, "link-status"))
+			tracked->link_status = connector->prop_values[i];
+	}
+}
+
+/*
+ * Property ids are only stable while the objects carrying them exist.
+ * Connectors coming and going (MST, driver rebind) may destroy property
+ * objects and let the kernel reuse their ids, so the cached properties are
+ * dropped whenever the connector list differs from the previous refresh.
+ */
+static int state_tracker_check_props(drmModeStateTrackerPtr tracker,
+				     drmModeResPtr res)
+{
+	uint32_t i;
+
+	if ((uint32_t)res->count_connectors == tracker->count_connectors) {
+		for (i = 0; i < tracker->count_connectors; i++)
+			if (!state_tracker_find(tracker->connectors,
+						tracker->count_connectors,
+						res->connectors[i]))
+				break;
+		if (i == tracker->count_connectors)
+			return 0;
+	}
+
+	return drmModePropertyCacheInvalidate(tracker->props);
+}
+
+static bool state_tracker_modes_equal(drmModeConnectorPtr a,
+				      drmModeConnectorPtr b)
+{
+	return a->count_modes == b->count_modes &&
+	       !memcmp(a->modes, b->modes, a->count_modes * sizeof(*a->modes));
+}
+
+drmModeStateDiffPtr drmModeStateTrackerRefresh(drmModeStateTrackerPtr tracker)
+{
+	drmModeTrackedConnectorPtr connectors, old;
+	drmModeConnectorPtr probed;
+	drmModeStateDiffPtr diff;
+	drmModeConnectorChangePtr change;
+	drmModeResPtr res;
+	uint32_t i, count = 0;
+	uint32_t changes;
+
+	if (!tracker) {
+		errno = EINVAL;
+		return NULL;
+	}
+
+	res = drmModeGetResources(tracker->fd);
+	if (!res)
+		return NULL;
+
+	if (state_tracker_check_props(tracker, res)) {
+		drmModeFreeResources(res);
+		errno = ENOMEM;
+		return NULL;
+	}
+
+	/* room for every current connector plus every removed one */
+	diff = drmMalloc(sizeof(*diff) +
+			 (res->count_connectors + tracker->count_connectors) *
+			 sizeof(*diff->connectors));
+	connectors = drmMalloc(res->count_connectors * sizeof(*connectors));
+	if (!diff || (!connectors && res->count_connectors)) {
+		drmFree(diff);
+		drmFree(connectors);
+		drmModeFreeResources(res);
+		errno = ENOMEM;
+		return NULL;
+	}
+	diff->connectors = (drmModeConnectorChangePtr)(diff + 1);
+
+	for (i = 0; i < (uint32_t)res->count_connectors; i++) {
+		drmModeTrackedConnectorPtr tracked = &connectors[count];
+
+		/* a connector that vanished in between is reported as removed */
+		tracked->connector = drmModeGetConnectorCurrent(tracker->fd,
+								res->connectors[i]);
+		if (!tracked->connector)
+			continue;
+
+		tracked->connector_id = res->connectors[i];
+		state_tracker_read_props(tracker, tracked);
+
+		old = state_tracker_find(tracker->connectors,
+					 tracker->count_connectors,
+					 tracked->connector_id);
+		changes = 0;
+
+		if (!old) {
+			changes |= DRM_MODE_CHANGE_ADDED;
+		} else {
+			if (tracked->connector->connection !=
+			    old->connector->connection)
+				changes |= DRM_MODE_CHANGE_CONNECTION;
+			if (tracked->edid != old->edid)
+				changes |= DRM_MODE_CHANGE_EDID;
+			if (tracked->link_status != old->link_status)
+				changes |= DRM_MODE_CHANGE_LINK_STATUS;
+			if (tracked->connector->encoder_id !=
+			    old->connector->encoder_id)
+				changes |= DRM_MODE_CHANGE_ENCODER;
+		}
+
+		/* only connectors whose sink may have changed get probed */
+		if (changes & ~DRM_MODE_CHANGE_ENCODER) {
+			probed = drmModeGetConnector(tracker->fd,
+						     tracked->connector_id);
+			if (probed) {
+				drmModeFreeConnector(tracked->connector);
+				tracked->connector = probed;
+				state_tracker_read_props(tracker, tracked);
+			}
+		}
+
+		if (old && !state_tracker_modes_equal(tracked->connector,
+						      old->connector))
+			changes |= DRM_MODE_CHANGE_MODES;
+
+		if (changes) {
+			change = &diff->connectors[diff->count_connectors++];
+			change->connector_id = tracked->connector_id;
+			change->changes = changes;
+			change->connection = tracked->connector->connection;
+		}
+
+		count++;
+	}
+
+	for (i = 0; i < tracker->count_connectors; i++) {
+		old = &tracker->connectors[i];
+
+		if (!state_tracker_find(connectors, count, old->connector_id)) {
+			change = &diff->connectors[diff->count_connectors++];
+			change->connector_id = old->connector_id;
+			change->changes = DRM_MODE_CHANGE_REMOVED;
+			change->connection = DRM_MODE_DISCONNECTED;
+		}
+
+		drmModeFreeConnector(old->connector);
+	}
+
+	drmFree(tracker->connectors);
+	tracker->connectors = connectors;
+	tracker->count_connectors = count;
+
+	drmModeFreeResources(res);
+
+	return diff;
+}
+
+void drmModeFreeStateDiff(drmModeStateDiffPtr diff)
+{
+	drmFree(diff);
+}
+
+/*
+ * Frame pacing.
+ *
+ * The scheduler models the vblanks of every crtc as last_ns + n * period,
+ * anchored at the most recent vblank or flip event it was fed. The period
+ * is seeded from the crtc's mode and refined with a moving average of the
+ * intervals between events, so clock drift and fractional refresh rates
+ * are tracked. Outliers are ignored unless they persist, which means the
+ * mode changed. Targets passed to drmModeFrameSchedulerSubmit() are matched
+ * against flip completions, in order, to count missed deadlines.
+ */
+#define FRAME_PENDING_MAX	4
+#define FRAME_DEFAULT_PERIOD	16666667ULL
+#define FRAME_OUTLIER_LIMIT	3
+
+typedef struct _drmModeFrameCrtc {
+	uint32_t crtc_id;
+	bool valid;
+	uint32_t last_seq;
+	uint64_t last_ns;
+	uint64_t period_ns;
+	unsigned int outliers;
+	uint32_t pending[FRAME_PENDING_MAX];
+	unsigned int pending_head;
+	unsigned int pending_count;
+	drmModeFrameStats stats;
+} drmModeFrameCrtc, *drmModeFrameCrtcPtr;
+
+struct _drmModeFrameScheduler {
+	int fd;
+	void *crtcs;	/* crtc id -> drmModeFrameCrtcPtr */
+};
+
+static uint64_t frame_now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+drmModeFrameSchedulerPtr drmModeFrameSchedulerCreate(int fd)
+{
+	drmModeFrameSchedulerPtr sched;
+
+	sched = drmMalloc(sizeof *sched);
+	if (!sched)
+		return NULL;
+
+	sched->crtcs = drmHashCreate();
+	if (!sched->crtcs) {
+		drmFree(sched);
+		return NULL;
+	}
+
+	sched->fd = fd;
+
+	return sched;
+}
+
+void drmModeFrameSchedulerDestroy(drmModeFrameSchedulerPtr sched)
+{
+	unsigned long key;
+	void *value;
+
+	if (!sched)
+		return;
+
+	if (drmHashFirst(sched->crtcs, &key, &value)) {
+		do {
+			drmFree(value);
+		} while (drmHashNext(sched->crtcs, &key, &value));
+	}
+
+	drmHashDestroy(sched->crtcs);
+	drmFree(sched);
+}
+
+static drmModeFrameCrtcPtr frame_get_crtc(drmModeFrameSchedulerPtr sched,
+					  uint32_t crtc_id)
+{
+	drmModeFrameCrtcPtr crtc;
+	drmModeCrtcPtr mode;
+	void *value;
+
+	if (!drmHashLookup(sched->crtcs, crtc_id, &value))
+		return value;
+
+	crtc = drmMalloc(sizeof *crtc);
+	if (!crtc)
+		return NULL;
+
+	crtc->crtc_id = crtc_id;
+	crtc->period_ns = FRAME_DEFAULT_PERIOD;
+
+	/* seed the period from the mode, the events refine it */
+	mode = drmModeGetCrtc(sched->fd, crtc_id);
+	if (mode && mode->mode_valid && mode->mode.clock &&
+	    mode->mode.htotal && mode->mode.vtotal) {
+		crtc->period_ns = (uint64_t)mode->mode.htotal *
+				  mode->mode.vtotal * 1000000ULL /
+				  mode->mode.clock;
+		if (mode->mode.flags & DRM_MODE_FLAG_INTERLACE)
+			crtc->period_ns /= 2;
+		if (mode->mode.flags & DRM_MODE_FLAG_DBLSCAN)
+			crtc->period_ns *= 2;
+	}
+	drmModeFreeCrtc(mode);
+
+	crtc->stats.period_ns = crtc->period_ns;
+	if (drmHashInsert(sched->crtcs, crtc_id, crtc)) {
+		drmFree(crtc);
+		return NULL;
+	}
+
+	return crtc;
+}
+
+static void frame_record(drmModeFrameCrtcPtr crtc, uint32_t sequence,
+			 uint64_t ns)
+{
+	int32_t delta = (int32_t)(sequence - crtc->last_seq);
+
+	if (crtc->valid) {
+		int64_t sample, error;
+
+		/* stale or duplicate event */
+		if (delta <= 0 || ns <= crtc->last_ns)
+			return;
+
+		sample = (ns - crtc->last_ns) / delta;
+		error = sample - (int64_t)crtc->period_ns;
+
+		if (error < (int64_t)crtc->period_ns / 4 &&
+		    -error < (int64_t)crtc->period_ns / 4) {
+			crtc->period_ns += error / 8;
+			crtc->outliers = 0;
+		} else if (++crtc->outliers >= FRAME_OUTLIER_LIMIT) {
+			crtc->period_ns = sample;
+			crtc->outliers = 0;
+		}
+	}
+
+	crtc->valid = true;
+	crtc->last_seq = sequence;
+	crtc->last_ns = ns;
+	crtc->stats.period_ns = crtc->period_ns;
+}
+
+int drmModeFrameSchedulerVBlank(drmModeFrameSchedulerPtr sched,
+				uint32_t crtc_id, unsigned int sequence,
+				unsigned int tv_sec, unsigned int tv_usec)
+{
+	drmModeFrameCrtcPtr crtc;
+
+	if (!sched)
+		return -EINVAL;
+
+	crtc = frame_get_crtc(sched, crtc_id);
+	if (!crtc)
+		return -ENOMEM;
+
+	frame_record(crtc, sequence,
+		     (uint64_t)tv_sec * 1000000000ULL + tv_usec * 1000ULL);
+
+	return 0;
+}
+
+int drmModeFrameSchedulerFlipDone(drmModeFrameSchedulerPtr sched,
+				  uint32_t crtc_id, unsigned int sequence,
+				  unsigned int tv_sec, unsigned int tv_usec)
+{
+	drmModeFrameCrtcPtr crtc;
+	uint32_t target;
+	int32_t late;
+	int ret;
+
+	ret = drmModeFrameSchedulerVBlank(sched, crtc_id, sequence,
+					  tv_sec, tv_usec);
+	if (ret)
+		return ret;
+
+	crtc = frame_get_crtc(sched, crtc_id);
+	crtc->stats.frames++;
+
+	if (!crtc->pending_count)
+		return 0;
+
+	target = crtc->pending[crtc->pending_head];
+	crtc->pending_head = (crtc->pending_head + 1) % FRAME_PENDING_MAX;
+	crtc->pending_count--;
+
+	late = (int32_t)(sequence - target);
+	if (late > 0) {
+		crtc->stats.missed++;
+		crtc->stats.missed_vblanks += late;
+	}
+
+	return 0;
+}
+
+int drmModeFrameSchedulerSubmit(drmModeFrameSchedulerPtr sched,
+				uint32_t crtc_id, uint32_t target_sequence)
+{
+	drmModeFrameCrtcPtr crtc;
+
+	if (!sched)
+		return -EINVAL;
+
+	crtc = frame_get_crtc(sched, crtc_id);
+	if (!crtc)
+		return -ENOMEM;
+
+	/* a full queue means completions are not being reported, drop one */
+	if (crtc->pending_count == FRAME_PENDING_MAX) {
+		crtc->pending_head = (crtc->pending_head + 1) % FRAME_PENDING_MAX;
+		crtc->pending_count--;
+	}
+
+	crtc->pending[(crtc->pending_head + crtc->pending_count) %
+		      FRAME_PENDING_MAX] = target_sequence;
+	crtc->pending_count++;
+
+	return 0;
+}
+
+int drmModeFrameSchedulerPredict(drmModeFrameSchedulerPtr sched,
+				 uint32_t crtc_id, uint64_t ns,
+				 uint32_t *sequence, uint64_t *vblank_ns)
+{
+	drmModeFrameCrtcPtr crtc;
+	uint64_t n = 0;
+
+	if (!sched)
+		return -EINVAL;
+
+	crtc = frame_get_crtc(sched, crtc_id);
+	if (!crtc)
+		return -ENOMEM;
+
+	if (!crtc->valid)
+		return -EAGAIN;
+
+	if (ns >= crtc->last_ns)
+		n = (ns - crtc->last_ns) / crtc->period_ns + 1;
+
+	if (sequence)
+		*sequence = crtc->last_seq + (uint32_t)n;
+	if (vblank_ns)
+		*vblank_ns = crtc->last_ns + n * crtc->period_ns;
+
+	return 0;
+}
+
+int drmModeFrameSchedulerGetDeadline(drmModeFrameSchedulerPtr sched,
+				     uint32_t crtc_id, uint64_t render_ns,
+				     uint32_t *sequence, uint64_t *start_ns)
+{
+	uint64_t vblank_ns;
+	int ret;
+
+	ret = drmModeFrameSchedulerPredict(sched, crtc_id,
+					   frame_now_ns() + render_ns,
+					   sequence, &vblank_ns);
+	if (ret)
+		return ret;
+
+	if (start_ns)
+		*start_ns = vblank_ns - render_ns;
+
+	return 0;
+}
+
+int drmModeFrameSchedulerGetStats(drmModeFrameSchedulerPtr sched,
+				  uint32_t crtc_id, drmModeFrameStatsPtr stats)
+{
+	drmModeFrameCrtcPtr crtc;
+
+	if (!sched || !stats)
+		return -EINVAL;
+
+	crtc = frame_get_crtc(sched, crtc_id);
+	if (!crtc)
+		return -ENOMEM;
+
+	*stats = crtc->stats;
+
+	return 0;
+}
+
+/*
+ * Plane assignment.
+ *
+ * The solver searches for a plane per layer, bottom layer first, among the
+ * planes that can drive the crtc and scan out the layer's format, keeping
+ * the stacking order: every plane has a zpos range, its zpos property when
+ * it has one, otherwise primary below overlays below cursors. A candidate
+ * assignment is then checked with a TEST_ONLY commit. The outcome of every
+ * test is remembered under the exact contents of the request, framebuffer
+ * ids aside, so a configuration seen before is settled without an ioctl.
+ */
+#define SOLVER_MAX_TESTS	16
+#define SOLVER_MAX_RESULTS	4096
+
+enum {
+	SOLVER_PROP_FB_ID,
+	SOLVER_PROP_CRTC_ID,
+	SOLVER_PROP_SRC_X,
+	SOLVER_PROP_SRC_Y,
+	SOLVER_PROP_SRC_W,
+	SOLVER_PROP_SRC_H,
+	SOLVER_PROP_CRTC_X,
+	SOLVER_PROP_CRTC_Y,
+	SOLVER_PROP_CRTC_W,
+	SOLVER_PROP_CRTC_H,
+	SOLVER_PROP_ZPOS,
+	SOLVER_PROP_COUNT
+};
+
+static const char *const solver_prop_names[SOLVER_PROP_COUNT] = {
+	"FB_ID", "CRTC_ID", "SRC_X", "SRC_Y", "SRC_W", "SRC_H",
+	"CRTC_X", "CRTC_Y", "CRTC_W", "CRTC_H", "zpos",
+};
+
+typedef struct _drmModeSolverPlane {
+	uint32_t plane_id;
+	uint32_t possible_crtcs;
+	uint32_t crtc_id;	/* crtc of the last accepted assignment */
+	uint32_t count_formats;
+	uint32_t *formats;
+	bool zpos_mutable;
+	uint64_t zpos_min;
+	uint64_t zpos_max;
+	uint32_t props[SOLVER_PROP_COUNT];
+} drmModeSolverPlane, *drmModeSolverPlanePtr;
+
+typedef struct _drmModeSolverResult drmModeSolverResult, *drmModeSolverResultPtr;
+
+struct _drmModeSolverResult {
+	drmModeSolverResultPtr next;	/* hash collisions */
+	bool valid;
+	uint32_t count;
+	uint32_t signature[];
+};
+
+struct _drmModePlaneSolver {
+	int fd;
+	drmModePropertyCachePtr props;
+	uint32_t count_crtcs;
+	uint32_t *crtcs;
+	uint32_t count_planes;
+	drmModeSolverPlanePtr planes;	/* sorted by zpos_min */
+	drmModeAtomicSortedReqPtr req;
+	void *results;			/* signature hash -> result chain */
+	uint32_t count_results;
+	drmModePlaneSolverStats stats;
+	/* scratch space of the search */
+	uint32_t size_layers;
+	uint32_t *assignment;
+	uint64_t *zpos;
+	uint32_t size_signature;
+	uint32_t *signature;
+	unsigned int tests;
+	uint32_t flags;			/* of the TEST_ONLY commits */
+};
+
+static void solver_clear_results(drmModePlaneSolverPtr solver)
+{
+	unsigned long key;
+	void *value;
+
+	if (drmHashFirst(solver->results, &key, &value)) {
+		do {
+			drmModeSolverResultPtr result = value;
+
+			while (result) {
+				drmModeSolverResultPtr next = result->next;
+
+				drmFree(result);
+				result = next;
+			}
+		} while (drmHashNext(solver->results, &key, &value));
+	}
+
+	drmHashDestroy(solver->results);
+	solver->results = drmHashCreate();
+	solver->count_results = 0;
+}
+
+static void solver_free_planes(drmModePlaneSolverPtr solver)
+{
+	uint32_t i;
+
+	for (i = 0; i < solver->count_planes; i++)
+		drmFree(solver->planes[i].formats);
+
+	drmFree(solver->planes);
+	drmFree(solver->crtcs);
+	solver->planes = NULL;
+	solver->crtcs = NULL;
+	solver->count_planes = 0;
+	solver->count_crtcs = 0;
+}
+
+static int solver_plane_cmp(const void *a, const void *b)
+{
+	const drmModeSolverPlane *pa = a, *pb = b;
+
+	if (pa->zpos_min != pb->zpos_min)
+		return pa->zpos_min < pb->zpos_min ? -1 : 1;
+
+	return pa->plane_id < pb->plane_id ? -1 : pa->plane_id > pb->plane_id;
+}
+
+static int solver_load_plane(drmModePlaneSolverPtr solver,
+			     drmModeSolverPlanePtr plane, uint32_t plane_id,
+			     uint32_t index)
+{
+	drmModeObjectPropertiesPtr props;
+	drmModePlanePtr info;
+	drmModePropertyPtr prop;
+	uint64_t type = DRM_PLANE_TYPE_OVERLAY;
+	bool has_zpos = false;
+	uint32_t i, j;
+
+	info = drmModeGetPlane(solver->fd, plane_id);
+	if (!info)
+		return -errno;
+
+	plane->plane_id = plane_id;
+	plane->possible_crtcs = info->possible_crtcs;
+	plane->crtc_id = info->crtc_id;
+	plane->count_formats = info->count_formats;
+	plane->formats = drmAllocCpy((char *)info->formats, info->count_formats,
+				     sizeof(*info->formats));
+	drmModeFreePlane(info);
+	if (!plane->formats && plane->count_formats)
+		return -ENOMEM;
+
+	props = drmModeObjectGetProperties(solver->fd, plane_id,
+					   DRM_MODE_OBJECT_PLANE);
+	if (!props)
+		return -errno;
+
+	for (i = 0; i < props->count_props; i++) {
+		prop = drmModePropertyCacheGetProperty(solver->props,
+						       props->props[i]);
+		if (!prop)
+			continue;
+
+		if (!strcmp(prop->name, "type"))
+			type = props->prop_values[i];
+
+		for (j = 0; j < SOLVER_PROP_COUNT; j++)
+			if (!strcmp(prop->name, solver_prop_names[j]))
+				plane->props[j] = prop->prop_id;
+
+		if (!strcmp(prop->name, "zpos")) {
+			has_zpos = true;
+			if (prop->flags & DRM_MODE_PROP_IMMUTABLE ||
+			    prop->count_values < 2) {
+				plane->zpos_min = props->prop_values[i];
+				plane->zpos_max = props->prop_values[i];
+			} else {
+				plane->zpos_mutable = true;
+				plane->zpos_min = prop->values[0];
+				plane->zpos_max = prop->values[1];
+			}
+		}
+	}
+
+	drmModeFreeObjectProperties(props);
+
+	for (j = 0; j < SOLVER_PROP_ZPOS; j++)
+		if (!plane->props[j])
+			return -ENOTSUP;
+
+	/* without zpos, planes stack by type and then by index */
+	if (!has_zpos) {
+		if (type == DRM_PLANE_TYPE_PRIMARY)
+			plane->zpos_min = 0;
+		else if (type == DRM_PLANE_TYPE_CURSOR)
+			plane->zpos_min = 0x10000 + index;
+		else
+			plane->zpos_min = 1 + index;
+		plane->zpos_max = plane->zpos_min;
+	}
+
+	return 0;
+}
+
+static int solver_load(drmModePlaneSolverPtr solver)
+{
+	drmModePlaneResPtr plane_res;
+	drmModeResPtr res;
+	uint32_t i;
+	int ret = 0;
+
+	res = drmModeGetResources(solver->fd);
+	if (!res)
+		return -errno;
+
+	solver->crtcs = drmAllocCpy((char *)res->crtcs, res->count_crtcs,
+				    sizeof(*res->crtcs));
+	solver->count_crtcs = res->count_crtcs;
+	drmModeFreeResources(res);
+
+	plane_res = drmModeGetPlaneResources(solver->fd);
+	if (!plane_res)
+		return -errno;
+
+	solver->planes = drmMalloc(plane_res->count_planes *
+				   sizeof(*solver->planes));
+	if (!solver->planes && plane_res->count_planes) {
+		drmModeFreePlaneResources(plane_res);
+		return -ENOMEM;
+	}
+
+	for (i = 0; i < plane_res->count_planes; i++) {
+		ret = solver_load_plane(solver,
+					&solver->planes[solver->count_planes],
+					plane_res->planes[i], i);
+		/* planes the solver cannot program are left out */
+		if (ret == -ENOTSUP) {
+			drmFree(solver->planes[solver->count_planes].formats);
+			memset(&solver->planes[solver->count_planes], 0,
+			       sizeof(*solver->planes));
+			ret = 0;
+			continue;
+		}
+		solver->count_planes++;
+		if (ret)
+			break;
+	}
+
+	drmModeFreePlaneResources(plane_res);
+
+	if (solver->count_planes)
+		qsort(solver->planes, solver->count_planes,
+		      sizeof(*solver->planes), solver_plane_cmp);
+
+	return ret;
+}
+
+drmModePlaneSolverPtr drmModePlaneSolverCreate(int fd)
+{
+	drmModePlaneSolverPtr solver;
+
+	solver = drmMalloc(sizeof *solver);
+	if (!solver)
+		return NULL;
+
+	solver->fd = fd;
+	solver->props = drmModePropertyCacheCreate(fd);
+	solver->req = drmModeAtomicSortedAlloc();
+	solver->results = drmHashCreate();
+
+	if (!solver->props || !solver->req || !solver->results ||
+	    solver_load(solver)) {
+		drmModePlaneSolverDestroy(solver);
+		return NULL;
+	}
+
+	return solver;
+}
+
+void drmModePlaneSolverDestroy(drmModePlaneSolverPtr solver)
+{
+	if (!solver)
+		return;
+
+	if (solver->results) {
+		solver_clear_results(solver);
+		drmHashDestroy(solver->results);
+	}
+
+	solver_free_planes(solver);
+	drmModeAtomicSortedFree(solver->req);
+	drmModePropertyCacheDestroy(solver->props);
+	drmFree(solver->assignment);
+	drmFree(solver->zpos);
+	drmFree(solver->signature);
+	drmFree(solver);
+}
+
+int drmModePlaneSolverInvalidate(drmModePlaneSolverPtr solver)
+{
+	int ret;
+
+	if (!solver)
+		return -EINVAL;
+
+	solver_clear_results(solver);
+	solver_free_planes(solver);
+
+	ret = drmModePropertyCacheInvalidate(solver->props);
+	if (ret)
+		return ret;
+
+	return solver_load(solver);
+}
+
+void drmModePlaneSolverGetStats(drmModePlaneSolverPtr solver,
+				drmModePlaneSolverStatsPtr stats)
+{
+	if (solver && stats)
+		*stats = solver->stats;
+}
+
+static bool solver_plane_supports(drmModeSolverPlanePtr plane,
+				  uint32_t crtc_mask, uint32_t format)
+{
+	uint32_t i;
+
+	if (!(plane->possible_crtcs & crtc_mask))
+		return false;
+
+	for (i = 0; i < plane->count_formats; i++)
+		if (plane->formats[i] == format)
+			return true;
+
+	return false;
+}
+
+static int solver_build(drmModePlaneSolverPtr solver, uint32_t crtc_id,
+			drmModePlaneLayerPtr layers, uint32_t count_layers)
+{
+	drmModeAtomicSortedReqPtr req = solver->req;
+	drmModeSolverPlanePtr plane;
+	uint32_t i, j;
+	int ret = 0;
+
+	drmModeAtomicSortedReset(req);
+
+	for (i = 0; i < count_layers; i++) {
+		drmModePlaneLayerPtr layer = &layers[i];
+
+		plane = &solver->planes[solver->assignment[i]];
+
+		ret |= drmModeAtomicSortedAddProperty(req, plane->plane_id,
+				plane->props[SOLVER_PROP_FB_ID], layer->fb_id);
+		ret |= drmModeAtomicSortedAddProperty(req, plane->plane_id,
+				plane->props[SOLVER_PROP_CRTC_ID], crtc_id);
+		ret |= drmModeAtomicSortedAddProperty(req, plane->plane_id,
+				plane->props[SOLVER_PROP_SRC_X], layer->src_x);
+		ret |= drmModeAtomicSortedAddProperty(req, plane->plane_id,
+				plane->props[SOLVER_PROP_SRC_Y], layer->src_y);
+		ret |= drmModeAtomicSortedAddProperty(req, plane->plane_id,
+				plane->props[SOLVER_PROP_SRC_W], layer->src_w);
+		ret |= drmModeAtomicSortedAddProperty(req, plane->plane_id,
+				plane->props[SOLVER_PROP_SRC_H], layer->src_h);
+		ret |= drmModeAtomicSortedAddProperty(req, plane->plane_id,
+				plane->props[SOLVER_PROP_CRTC_X],
+				(uint64_t)(int64_t)layer->crtc_x);
+		ret |= drmModeAtomicSortedAddProperty(req, plane->plane_id,
+				plane->props[SOLVER_PROP_CRTC_Y],
+				(uint64_t)(int64_t)layer->crtc_y);
+		ret |= drmModeAtomicSortedAddProperty(req, plane->plane_id,
+				plane->props[SOLVER_PROP_CRTC_W], layer->crtc_w);
+		ret |= drmModeAtomicSortedAddProperty(req, plane->plane_id,
+				plane->props[SOLVER_PROP_CRTC_H], layer->crtc_h);
+		if (plane->zpos_mutable)
+			ret |= drmModeAtomicSortedAddProperty(req,
+					plane->plane_id,
+					plane->props[SOLVER_PROP_ZPOS],
+					solver->zpos[i]);
+	}
+
+	/* switch off the planes this crtc no longer uses */
+	for (j = 0; j < solver->count_planes; j++) {
+		plane = &solver->planes[j];
+
+		if (plane->crtc_id != crtc_id)
+			continue;
+
+		for (i = 0; i < count_layers; i++)
+			if (solver->assignment[i] == j)
+				break;
+		if (i < count_layers)
+			continue;
+
+		ret |= drmModeAtomicSortedAddProperty(req, plane->plane_id,
+				plane->props[SOLVER_PROP_FB_ID], 0);
+		ret |= drmModeAtomicSortedAddProperty(req, plane->plane_id,
+				plane->props[SOLVER_PROP_CRTC_ID], 0);
+	}
+
+	return ret ? -ENOMEM : 0;
+}
+
+/*
+ * The signature is the request itself, with every non-zero framebuffer id
+ * replaced by 1, followed by the format and modifier of every layer and
+ * the commit flags: buffers are swapped every frame, but only their layout
+ * matters to the test, and that is given by the layer format, modifier and
+ * size.
+ */
+static int solver_signature(drmModePlaneSolverPtr solver,
+			    drmModePlaneLayerPtr layers, uint32_t count_layers,
+			    uint32_t *count, unsigned long *hash)
+{
+	drmModeAtomicSortedReqPtr req = solver->req;
+	uint32_t i, j, k, obj, size;
+	uint64_t h = 14695981039346656037ULL;	/* FNV-1a */
+	uint32_t *sig;
+
+	size = req->count_props * 4 + count_layers * 3 + 1;
+	if (size > solver->size_signature) {
+		sig = drmMalloc(size * sizeof(*sig));
+		if (!sig)
+			return -ENOMEM;
+		drmFree(solver->signature);
+		solver->signature = sig;
+		solver->size_signature = size;
+	}
+
+	sig = solver->signature;
+
+	for (obj = 0, i = 0, j = 0; obj < req->count_objs; obj++) {
+		uint32_t end = i + req->obj_props[obj], fb_prop = 0;
+
+		/* only the planes of the layers have a framebuffer */
+		for (k = 0; k < count_layers; k++) {
+			drmModeSolverPlanePtr plane =
+				&solver->planes[solver->assignment[k]];
+
+			if (plane->plane_id == req->objs[obj]) {
+				fb_prop = plane->props[SOLVER_PROP_FB_ID];
+				break;
+			}
+		}
+
+		for (; i < end; i++) {
+			uint64_t value = req->prop_values[i];
+
+			if (req->props[i] == fb_prop)
+				value = !!value;
+
+			sig[j++] = req->objs[obj];
+			sig[j++] = req->props[i];
+			sig[j++] = (uint32_t)value;
+			sig[j++] = (uint32_t)(value >> 32);
+		}
+	}
+
+	for (i = 0; i < count_layers; i++) {
+		sig[j++] = layers[i].format;
+		sig[j++] = (uint32_t)layers[i].modifier;
+		sig[j++] = (uint32_t)(layers[i].modifier >> 32);
+	}
+	sig[j++] = solver->flags;
+
+	for (i = 0; i < size; i++) {
+		h ^= sig[i];
+		h *= 1099511628211ULL;
+	}
+
+	*count = size;
+	*hash = (unsigned long)h;
+
+	return 0;
+}
+
+static int solver_test(drmModePlaneSolverPtr solver, uint32_t crtc_id,
+		       drmModePlaneLayerPtr layers, uint32_t count_layers)
+{
+	drmModeSolverResultPtr result, head;
+	unsigned long hash;
+	uint32_t count;
+	void *value;
+	bool valid;
+	int ret;
+
+	ret = solver_build(solver, crtc_id, layers, count_layers);
+	if (!ret)
+		ret = solver_signature(solver, layers, count_layers,
+				       &count, &hash);
+	if (ret)
+		return ret;
+
+	head = NULL;
+	if (!drmHashLookup(solver->results, hash, &value))
+		head = value;
+
+	for (result = head; result; result = result->next) {
+		if (result->count == count &&
+		    !memcmp(result->signature, solver->signature,
+			    count * sizeof(*solver->signature))) {
+			solver->stats.cache_hits++;
+			return result->valid ? 0 : -EINVAL;
+		}
+	}
+
+	if (solver->tests >= SOLVER_MAX_TESTS)
+		return -EAGAIN;
+	solver->tests++;
+	solver->stats.tests++;
+
+	valid = !drmModeAtomicSortedCommit(solver->fd, solver->req,
+					   solver->flags, NULL);
+
+	if (solver->count_results >= SOLVER_MAX_RESULTS) {
+		solver_clear_results(solver);
+		head = NULL;
+	}
+
+	result = drmMalloc(sizeof(*result) + count * sizeof(*solver->signature));
+	if (result) {
+		result->valid = valid;
+		result->count = count;
+		memcpy(result->signature, solver->signature,
+		       count * sizeof(*solver->signature));
+		if (head) {
+			result->next = head->next;
+			head->next = result;
+			solver->count_results++;
+		} else if (drmHashInsert(solver->results, hash, result)) {
+			drmFree(result);
+		} else {
+			solver->count_results++;
+		}
+	}
+
+	return valid ? 0 : -EINVAL;
+}
+
+static int solver_search(drmModePlaneSolverPtr solver, uint32_t crtc_id,
+			 uint32_t crtc_mask, drmModePlaneLayerPtr layers,
+			 uint32_t count_layers, uint32_t layer, uint64_t zpos)
+{
+	drmModeSolverPlanePtr plane;
+	uint32_t i, k;
+	uint64_t z;
+	int ret;
+
+	if (layer == count_layers)
+		return solver_test(solver, crtc_id, layers, count_layers);
+
+	for (i = 0; i < solver->count_planes; i++) {
+		plane = &solver->planes[i];
+
+		/* stack strictly above the previous layer */
+		z = plane->zpos_min;
+		if (layer && z <= zpos)
+			z = zpos + 1;
+		if (z > plane->zpos_max)
+			continue;
+
+		if (!solver_plane_supports(plane, crtc_mask,
+					   layers[layer].format))
+			continue;
+
+		for (k = 0; k < layer; k++)
+			if (solver->assignment[k] == i)
+				break;
+		if (k < layer)
+			continue;
+
+		solver->assignment[layer] = i;
+		solver->zpos[layer] = z;
+
+		ret = solver_search(solver, crtc_id, crtc_mask, layers,
+				    count_layers, layer + 1, z);
+		if (ret != -EINVAL)
+			return ret;
+	}
+
+	return -EINVAL;
+}
+
+int drmModePlaneSolverAssign(drmModePlaneSolverPtr solver, uint32_t crtc_id,
+			     drmModePlaneLayerPtr layers,
+			     uint32_t count_layers, uint32_t flags,
+			     drmModeAtomicSortedReqPtr req)
+{
+	uint32_t i, j, crtc_mask = 0;
+	int ret;
+
+	if (!solver || (!layers && count_layers))
+		return -EINVAL;
+
+	for (i = 0; i < solver->count_crtcs; i++)
+		if (solver->crtcs[i] == crtc_id)
+			crtc_mask = 1 << i;
+	if (!crtc_mask)
+		return -EINVAL;
+
+	if (count_layers > solver->size_layers) {
+		uint32_t *assignment;
+		uint64_t *zpos;
+
+		assignment = drmMalloc(count_layers * sizeof(*assignment));
+		zpos = drmMalloc(count_layers * sizeof(*zpos));
+		if (!assignment || !zpos) {
+			drmFree(assignment);
+			drmFree(zpos);
+			return -ENOMEM;
+		}
+
+		drmFree(solver->assignment);
+		drmFree(solver->zpos);
+		solver->assignment = assignment;
+		solver->zpos = zpos;
+		solver->size_layers = count_layers;
+	}
+
+	/* test what the caller will commit, a modeset only if allowed */
+	solver->flags = DRM_MODE_ATOMIC_TEST_ONLY |
+			(flags & DRM_MODE_ATOMIC_ALLOW_MODESET);
+	solver->tests = 0;
+	ret = solver_search(solver, crtc_id, crtc_mask, layers, count_layers,
+			    0, 0);
+	if (ret) {
+		solver->stats.failures++;
+		return ret == -EINVAL ? -ENOSPC : ret;
+	}
+
+	/* solver->req holds the accepted configuration */
+	if (req) {
+		drmModeAtomicSortedReqPtr ok = solver->req;
+		uint32_t obj, start = 0;
+
+		for (obj = 0; obj < ok->count_objs; obj++) {
+			for (j = start; j < start + ok->obj_props[obj]; j++) {
+				ret = drmModeAtomicSortedAddProperty(req,
+						ok->objs[obj], ok->props[j],
+						ok->prop_values[j]);
+				if (ret)
+					return ret;
+			}
+			start += ok->obj_props[obj];
+		}
+	}
+
+	for (j = 0; j < solver->count_planes; j++)
+		if (solver->planes[j].crtc_id == crtc_id)
+			solver->planes[j].crtc_id = 0;
+
+	for (i = 0; i < count_layers; i++) {
+		drmModeSolverPlanePtr plane;
+
+		plane = &solver->planes[solver->assignment[i]];
+		plane->crtc_id = crtc_id;
+		layers[i].plane_id = plane->plane_id;
+	}
+
+	return 0;
+}
+
+/*
+ * Property blob cache.
+ *
+ * Blobs are looked up by content: acquiring bytes the cache already holds
+ * returns the existing blob id and takes a reference instead of creating a
+ * new blob. Blobs whose last reference is released are not destroyed right
+ * away but kept on an idle list, oldest first, so a mode or LUT that comes
+ * back a few commits later is still found. The idle list is bounded, the
+ * oldest idle blob is destroyed when it overflows.
+ */
+#define BLOB_CACHE_MAX_IDLE	32
+
+typedef struct _drmModeBlobCacheEntry drmModeBlobCacheEntry,
+	*drmModeBlobCacheEntryPtr;
+
+struct _drmModeBlobCacheEntry {
+	drmModeBlobCacheEntryPtr next;	/* hash collisions */
+	drmMMListHead idle;		/* link in the idle list */
+	unsigned long hash;
+	uint32_t blob_id;
+	uint32_t refcount;
+	size_t size;
+	unsigned char data[];
+};
+
+struct _drmModeBlobCache {
+	int fd;
+	void *blobs;		/* content hash -> entry chain */
+	void *ids;		/* blob id -> entry */
+	drmMMListHead idle;	/* unreferenced entries, oldest first */
+	uint32_t count_idle;
+	drmModeBlobCacheStats stats;
+};
+
+static unsigned long blob_cache_hash(const void *data, size_t size)
+{
+	const unsigned char *p = data;
+	uint64_t hash = 14695981039346656037ULL;	/* FNV-1a */
+
+	while (size--) {
+		hash ^= *p++;
+		hash *= 1099511628211ULL;
+	}
+
+	return (unsigned long)(hash ^ (hash >> 32));
+}
+
+static void blob_cache_destroy_entry(drmModeBlobCachePtr cache,
+				     drmModeBlobCacheEntryPtr entry)
+{
+	drmModeBlobCacheEntryPtr head, *link;
+	void *value;
+
+	if (!drmHashLookup(cache->blobs, entry->hash, &value)) {
+		head = value;
+		if (head == entry) {
+			drmHashDelete(cache->blobs, entry->hash);
+			if (entry->next)
+				drmHashInsert(cache->blobs, entry->hash,
+					      entry->next);
+		} else {
+			for (link = &head->next; *link; link = &(*link)->next) {
+				if (*link == entry) {
+					*link = entry->next;
+					break;
+				}
+			}
+		}
+	}
+
+	drmHashDelete(cache->ids, entry->blob_id);
+	drmModeDestroyPropertyBlob(cache->fd, entry->blob_id);
+	cache->stats.destroyed++;
+	drmFree(entry);
+}
+
+drmModeBlobCachePtr drmModeBlobCacheCreate(int fd)
+{
+	drmModeBlobCachePtr cache;
+
+	cache = drmMalloc(sizeof *cache);
+	if (!cache)
+		return NULL;
+
+	cache->fd = fd;
+	cache->blobs = drmHashCreate();
+	cache->ids = drmHashCreate();
+	DRMINITLISTHEAD(&cache->idle);
+
+	if (!cache->blobs || !cache->ids) {
+		drmModeBlobCacheDestroy(cache);
+		return NULL;
+	}
+
+	return cache;
+}
+
+void drmModeBlobCacheDestroy(drmModeBlobCachePtr cache)
+{
+	unsigned long key;
+	void *value;
+
+	if (!cache)
+		return;
+
+	/* every entry, referenced or not, is in the id table */
+	if (cache->ids) {
+		while (drmHashFirst(cache->ids, &key, &value))
+			blob_cache_destroy_entry(cache, value);
+		drmHashDestroy(cache->ids);
+	}
+
+	if (cache->blobs)
+		drmHashDestroy(cache->blobs);
+
+	drmFree(cache);
+}
+
+int drmModeBlobCacheAcquire(drmModeBlobCachePtr cache, const void *data,
+			    size_t size, uint32_t *blob_id)
+{
+	drmModeBlobCacheEntryPtr entry, head = NULL;
+	unsigned long hash;
+	void *value;
+	int ret;
+
+	if (!cache || !data || !size || !blob_id)
+		return -EINVAL;
+
+	hash = blob_cache_hash(data, size);
+
+	if (!drmHashLookup(cache->blobs, hash, &value))
+		head = value;
+
+	for (entry = head; entry; entry = entry->next) {
+		if (entry->size != size || memcmp(entry->data, data, size))
+			continue;
+
+		if (entry->refcount++ == 0) {
+			DRMLISTDEL(&entry->idle);
+			cache->count_idle--;
+		}
+
+		cache->stats.hits++;
+		*blob_id = entry->blob_id;
+		return 0;
+	}
+
+	entry = drmMalloc(sizeof(*entry) + size);
+	if (!entry)
+		return -ENOMEM;
+
+	ret = drmModeCreatePropertyBlob(cache->fd, data, size,
+					&entry->blob_id);
+	if (ret) {
+		drmFree(entry);
+		return ret;
+	}
+
+	entry->hash = hash;
+	entry->refcount = 1;
+	entry->size = size;
+	memcpy(entry->data, data, size);
+
+	if (drmHashInsert(cache->ids, entry->blob_id, entry))
+		goto fail;
+
+	if (head) {
+		entry->next = head->next;
+		head->next = entry;
+	} else if (drmHashInsert(cache->blobs, hash, entry)) {
+		drmHashDelete(cache->ids, entry->blob_id);
+		goto fail;
+	}
+
+	cache->stats.created++;
+	*blob_id = entry->blob_id;
+
+	return 0;
+
+fail:
+	drmModeDestroyPropertyBlob(cache->fd, entry->blob_id);
+	drmFree(entry);
+	return -ENOMEM;
+}
+
+int drmModeBlobCacheRef(drmModeBlobCachePtr cache, uint32_t blob_id)
+{
+	drmModeBlobCacheEntryPtr entry;
+	void *value;
+
+	if (!cache || drmHashLookup(cache->ids, blob_id, &value))
+		return -EINVAL;
+
+	entry = value;
+	if (entry->refcount++ == 0) {
+		DRMLISTDEL(&entry->idle);
+		cache->count_idle--;
+	}
+
+	return 0;
+}
+
+int drmModeBlobCacheRelease(drmModeBlobCachePtr cache, uint32_t blob_id)
+{
+	drmModeBlobCacheEntryPtr entry;
+	void *value;
+
+	if (!cache || drmHashLookup(cache->ids, blob_id, &value))
+		return -EINVAL;
+
+	entry = value;
+	if (!entry->refcount)
+		return -EINVAL;
+
+	if (--entry->refcount)
+		return 0;
+
+	DRMLISTADDTAIL(&entry->idle, &cache->idle);
+	cache->count_idle++;
+
+	if (cache->count_idle > BLOB_CACHE_MAX_IDLE) {
+		entry = DRMLISTENTRY(drmModeBlobCacheEntry, cache->idle.next,
+				     idle);
+		DRMLISTDEL(&entry->idle);
+		cache->count_idle--;
+		blob_cache_destroy_entry(cache, entry);
+	}
+
+	return 0;
+}
+
+void drmModeBlobCacheTrim(drmModeBlobCachePtr cache)
+{
+	drmModeBlobCacheEntryPtr entry, tmp;
+
+	if (!cache)
+		return;
+
+	DRMLISTFOREACHENTRYSAFE(entry, tmp, &cache->idle, idle) {
+		DRMLISTDEL(&entry->idle);
+		blob_cache_destroy_entry(cache, entry);
+	}
+
+	cache->count_idle = 0;
+}
+
+void drmModeBlobCacheGetStats(drmModeBlobCachePtr cache,
+			      drmModeBlobCacheStatsPtr stats)
+{
+	if (cache && stats)
+		*stats = cache->stats;
+}
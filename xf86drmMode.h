@@ -540,10 +540,248 @@ extern int drmModeAtomicCommit(int fd,
 			       uint32_t flags,
 			       void *user_data);
 
+/*
+ * Atomic request kept sorted and deduplicated on insertion. The request owns
+ * the arrays handed to the kernel, so once built it can be committed again
+ * after updating values without any allocation.
+ */
+typedef struct _drmModeAtomicSortedReq drmModeAtomicSortedReq,
+	*drmModeAtomicSortedReqPtr;
+
+extern drmModeAtomicSortedReqPtr drmModeAtomicSortedAlloc(void);
+extern void drmModeAtomicSortedFree(drmModeAtomicSortedReqPtr req);
+extern void drmModeAtomicSortedReset(drmModeAtomicSortedReqPtr req);
+extern int drmModeAtomicSortedGetCount(drmModeAtomicSortedReqPtr req);
+extern int drmModeAtomicSortedAddProperty(drmModeAtomicSortedReqPtr req,
+					  uint32_t object_id,
+					  uint32_t property_id,
+					  uint64_t value);
+extern int drmModeAtomicSortedCommit(int fd,
+				     drmModeAtomicSortedReqPtr req,
+				     uint32_t flags,
+				     void *user_data);
+
 extern int drmModeCreatePropertyBlob(int fd, const void *data, size_t size,
 				     uint32_t *id);
 extern int drmModeDestroyPropertyBlob(int fd, uint32_t id);
 
+/*
+ * Per-fd cache of KMS property metadata. The properties of an object are
+ * read the first time the object is looked up, later lookups by name make
+ * no ioctls. Returned properties are owned by the cache and stay valid
+ * until it is invalidated or destroyed. Property and object ids may be
+ * reused after a hotplug event, so invalidate the cache when one arrives.
+ */
+typedef struct _drmModePropertyCache drmModePropertyCache,
+	*drmModePropertyCachePtr;
+
+extern drmModePropertyCachePtr drmModePropertyCacheCreate(int fd);
+extern void drmModePropertyCacheDestroy(drmModePropertyCachePtr cache);
+extern int drmModePropertyCacheInvalidate(drmModePropertyCachePtr cache);
+extern drmModePropertyPtr
+drmModePropertyCacheGetProperty(drmModePropertyCachePtr cache,
+				uint32_t property_id);
+extern drmModePropertyPtr drmModePropertyCacheFind(drmModePropertyCachePtr cache,
+						   uint32_t object_id,
+						   uint32_t object_type,
+						   const char *name);
+extern uint32_t drmModePropertyCacheGetId(drmModePropertyCachePtr cache,
+					  uint32_t object_id,
+					  uint32_t object_type,
+					  const char *name);
+
+
+/*
+ * The whole KMS state in a single allocation, read with one ioctl per
+ * object in the common case. Connectors, encoders and crtcs are in the
+ * order of the corresponding id arrays in resources, crtc_props and
+ * plane_props are parallel to crtcs and planes. Connectors report their
+ * current state unless DRM_MODE_SNAPSHOT_PROBE is passed, which forces a
+ * probe like drmModeGetConnector(). Release with drmModeFreeSnapshot().
+ */
+typedef struct _drmModeSnapshot {
+	drmModeRes resources;
+
+	drmModeConnectorPtr connectors;
+	drmModeEncoderPtr encoders;
+	drmModeCrtcPtr crtcs;
+	drmModeObjectPropertiesPtr crtc_props;
+
+	uint32_t count_planes;
+	drmModePlanePtr planes;
+	drmModeObjectPropertiesPtr plane_props;
+} drmModeSnapshot, *drmModeSnapshotPtr;
+
+#define DRM_MODE_SNAPSHOT_PROBE	(1 << 0)
+
+extern drmModeSnapshotPtr drmModeGetSnapshot(int fd, uint32_t flags);
+extern void drmModeFreeSnapshot(drmModeSnapshotPtr snapshot);
+
+/*
+ * Hotplug state tracker. drmModeStateTrackerRefresh() is meant to be called
+ * on every hotplug uevent: it reads all connectors without probing, probes
+ * only those whose connection status, EDID or link-status changed since the
+ * previous refresh, and returns the list of connectors that changed. The
+ * first refresh reports every connector as added. Connectors returned by
+ * drmModeStateTrackerGetConnector() stay valid until the next refresh.
+ * Cached property names are dropped whenever connectors are added or
+ * removed, so a tracker can live as long as its fd.
+ */
+typedef struct _drmModeStateTracker drmModeStateTracker,
+	*drmModeStateTrackerPtr;
+
+#define DRM_MODE_CHANGE_ADDED		(1 << 0)
+#define DRM_MODE_CHANGE_REMOVED		(1 << 1)
+#define DRM_MODE_CHANGE_CONNECTION	(1 << 2)
+#define DRM_MODE_CHANGE_EDID		(1 << 3)
+#define DRM_MODE_CHANGE_LINK_STATUS	(1 << 4)
+#define DRM_MODE_CHANGE_MODES		(1 << 5)
+#define DRM_MODE_CHANGE_ENCODER		(1 << 6)
+
+typedef struct _drmModeConnectorChange {
+	uint32_t connector_id;
+	uint32_t changes;		/* DRM_MODE_CHANGE_* */
+	drmModeConnection connection;
+} drmModeConnectorChange, *drmModeConnectorChangePtr;
+
+typedef struct _drmModeStateDiff {
+	uint32_t count_connectors;
+	drmModeConnectorChangePtr connectors;
+} drmModeStateDiff, *drmModeStateDiffPtr;
+
+extern drmModeStateTrackerPtr drmModeStateTrackerCreate(int fd);
+extern void drmModeStateTrackerDestroy(drmModeStateTrackerPtr tracker);
+extern drmModeStateDiffPtr
+drmModeStateTrackerRefresh(drmModeStateTrackerPtr tracker);
+extern drmModeConnectorPtr
+drmModeStateTrackerGetConnector(drmModeStateTrackerPtr tracker,
+				uint32_t connector_id);
+extern void drmModeFreeStateDiff(drmModeStateDiffPtr diff);
+
+/*
+ * Frame pacing scheduler. Feed it the events read by drmHandleEvent():
+ * drmModeFrameSchedulerVBlank() from the vblank handler and
+ * drmModeFrameSchedulerFlipDone() from the page flip handler. It tracks the
+ * refresh period and phase of every crtc from the event timestamps, which
+ * must be CLOCK_MONOTONIC (DRM_CAP_TIMESTAMP_MONOTONIC).
+ *
+ * drmModeFrameSchedulerGetDeadline() returns the earliest vblank that a
+ * frame taking render_ns to produce can still make, and the latest
+ * CLOCK_MONOTONIC time to start rendering it. Report the vblank targeted
+ * by each flip with drmModeFrameSchedulerSubmit() to get missed deadline
+ * statistics.
+ */
+typedef struct _drmModeFrameScheduler drmModeFrameScheduler,
+	*drmModeFrameSchedulerPtr;
+
+typedef struct _drmModeFrameStats {
+	uint64_t frames;		/* completed flips */
+	uint64_t missed;		/* flips that completed after their target */
+	uint64_t missed_vblanks;	/* vblanks lost by those flips */
+	uint64_t period_ns;		/* current refresh period estimate */
+} drmModeFrameStats, *drmModeFrameStatsPtr;
+
+extern drmModeFrameSchedulerPtr drmModeFrameSchedulerCreate(int fd);
+extern void drmModeFrameSchedulerDestroy(drmModeFrameSchedulerPtr sched);
+extern int drmModeFrameSchedulerVBlank(drmModeFrameSchedulerPtr sched,
+				       uint32_t crtc_id, unsigned int sequence,
+				       unsigned int tv_sec, unsigned int tv_usec);
+extern int drmModeFrameSchedulerFlipDone(drmModeFrameSchedulerPtr sched,
+					 uint32_t crtc_id,
+					 unsigned int sequence,
+					 unsigned int tv_sec,
+					 unsigned int tv_usec);
+extern int drmModeFrameSchedulerSubmit(drmModeFrameSchedulerPtr sched,
+				       uint32_t crtc_id,
+				       uint32_t target_sequence);
+extern int drmModeFrameSchedulerPredict(drmModeFrameSchedulerPtr sched,
+					uint32_t crtc_id, uint64_t ns,
+					uint32_t *sequence,
+					uint64_t *vblank_ns);
+extern int drmModeFrameSchedulerGetDeadline(drmModeFrameSchedulerPtr sched,
+					    uint32_t crtc_id,
+					    uint64_t render_ns,
+					    uint32_t *sequence,
+					    uint64_t *start_ns);
+extern int drmModeFrameSchedulerGetStats(drmModeFrameSchedulerPtr sched,
+					 uint32_t crtc_id,
+					 drmModeFrameStatsPtr stats);
+
+/*
+ * Plane assignment solver. drmModePlaneSolverAssign() picks a plane for
+ * every layer, given bottom to top, that supports the layer's format and
+ * crtc and keeps the stacking order, and validates the result with a
+ * TEST_ONLY commit. flags are the DRM_MODE_ATOMIC_* flags the caller will
+ * commit the result with, the test only allows a modeset when they include
+ * DRM_MODE_ATOMIC_ALLOW_MODESET. Outcomes are memoized per configuration
+ * and flags, so a repeated configuration is resolved without any ioctl. On
+ * success the plane ids are written to the layers, and the plane
+ * properties, including the disabling of planes the crtc no longer uses,
+ * are added to req when it is not NULL.
+ * Returns -ENOSPC when no assignment is accepted, and -EAGAIN when the
+ * search gave up after too many TEST_ONLY commits without finding one;
+ * retrying continues with the outcomes memoized so far. Call
+ * drmModePlaneSolverInvalidate() after a hotplug or when other clients
+ * moved planes around.
+ */
+typedef struct _drmModePlaneSolver drmModePlaneSolver,
+	*drmModePlaneSolverPtr;
+
+typedef struct _drmModePlaneLayer {
+	uint32_t fb_id;
+	uint32_t format;		/* DRM_FORMAT_* */
+	uint32_t src_x, src_y;		/* 16.16 fixed point */
+	uint32_t src_w, src_h;		/* 16.16 fixed point */
+	int32_t crtc_x, crtc_y;
+	uint32_t crtc_w, crtc_h;
+	uint32_t plane_id;		/* returned, the assigned plane */
+	uint64_t modifier;		/* DRM_FORMAT_MOD_*, 0 is linear */
+} drmModePlaneLayer, *drmModePlaneLayerPtr;
+
+typedef struct _drmModePlaneSolverStats {
+	uint64_t tests;			/* TEST_ONLY commits issued */
+	uint64_t cache_hits;		/* tests answered from the memo */
+	uint64_t failures;		/* assignments that found no planes */
+} drmModePlaneSolverStats, *drmModePlaneSolverStatsPtr;
+
+extern drmModePlaneSolverPtr drmModePlaneSolverCreate(int fd);
+extern void drmModePlaneSolverDestroy(drmModePlaneSolverPtr solver);
+extern int drmModePlaneSolverInvalidate(drmModePlaneSolverPtr solver);
+extern int drmModePlaneSolverAssign(drmModePlaneSolverPtr solver,
+				    uint32_t crtc_id,
+				    drmModePlaneLayerPtr layers,
+				    uint32_t count_layers, uint32_t flags,
+				    drmModeAtomicSortedReqPtr req);
+extern void drmModePlaneSolverGetStats(drmModePlaneSolverPtr solver,
+				       drmModePlaneSolverStatsPtr stats);
+
+/*
+ * Content addressed property blob cache. drmModeBlobCacheAcquire() returns
+ * the id of a blob holding the given bytes, reusing an existing blob of the
+ * same contents when there is one, and takes a reference on it. Blobs are
+ * destroyed lazily once drmModeBlobCacheRelease() dropped the last
+ * reference: a bounded number of unreferenced blobs is kept around for
+ * reuse until drmModeBlobCacheTrim() or drmModeBlobCacheDestroy().
+ */
+typedef struct _drmModeBlobCache drmModeBlobCache, *drmModeBlobCachePtr;
+
+typedef struct _drmModeBlobCacheStats {
+	uint64_t hits;			/* acquisitions served by a cached blob */
+	uint64_t created;		/* blobs created */
+	uint64_t destroyed;		/* blobs destroyed */
+} drmModeBlobCacheStats, *drmModeBlobCacheStatsPtr;
+
+extern drmModeBlobCachePtr drmModeBlobCacheCreate(int fd);
+extern void drmModeBlobCacheDestroy(drmModeBlobCachePtr cache);
+extern int drmModeBlobCacheAcquire(drmModeBlobCachePtr cache,
+				   const void *data, size_t size,
+				   uint32_t *blob_id);
+extern int drmModeBlobCacheRef(drmModeBlobCachePtr cache, uint32_t blob_id);
+extern int drmModeBlobCacheRelease(drmModeBlobCachePtr cache,
+				   uint32_t blob_id);
+extern void drmModeBlobCacheTrim(drmModeBlobCachePtr cache);
+extern void drmModeBlobCacheGetStats(drmModeBlobCachePtr cache,
+				     drmModeBlobCacheStatsPtr stats);
 
 #if defined(__cplusplus)
 }